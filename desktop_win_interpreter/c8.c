@@ -1,98 +1,361 @@
 #include "c8.h"
+#include "c8_trace.h"
+#include "c8_history.h"
+#include "c8_input.h"
+#include "c8_audio.h"
+#include "c8_blit.h"
 
-static bool initd = false;
-static bool rom_loaded = false;
-
-/* monochrome 64x32 - TODO: try to cleverly bitmap instead of storing byte for each pixel.
-makes setting and reading lot easier though */
-static uint8_t screenb[C8_WIDTH * C8_HEIGHT];
-static bool gfx_dirty = false;
-
-/* c8 countdown timers - */
-static uint8_t delay;
-static uint8_t snd;
-
-/* TODO: inputs */
-static uint8_t inputs[16];
-
-/* TODO: check this depth is accurate */
-static uint16_t stack[16];
-static uint16_t sp;
-/* note these are two words */
-static uint16_t i; /* index reg */
-static uint16_t pc; /* program counter */
-/* regs V0 - V15  (VF in hex). VF is flag register*/
-static uint8_t v[16];
-static uint8_t* vf = &v[15];
-
-/* main memory 0x1000*/
-static uint8_t mem[4096];
-/* current opcode */
-//static uint16_t op;
-static uint16_t rom_size = 0;
-
-static void c8_debug(const char* fmt, ...)
-{
-#if defined _DEBUG
-    va_list vl;
-    va_start(vl, fmt);
-    vprintf(fmt, vl);
-    va_end(vl);
-#endif
+static void c8_trace_add(c8_machine* m, uint8_t kind, uint16_t addr, uint16_t val)
+{
+    c8_trace_rec* rec = m->trace_rec;
+    if (rec->ndeltas < C8_TRACE_MAX_DELTAS)
+    {
+        c8_trace_delta* d = &rec->deltas[rec->ndeltas++];
+        d->kind = kind;
+        d->addr = addr;
+        d->val = val;
+    }
+}
+
+/* murmur3's finaliser */
+static uint64_t c8_hash_key(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+/* what one byte of memory or one word of screen adds to the running hashes. zero
+adds nothing, so cleared memory and a cleared plane hash to 0 */
+static uint64_t c8_mem_key(uint32_t addr, uint8_t val)
+{
+    return val ? c8_hash_key(((uint64_t)addr << 8 | val) * 0x9e3779b97f4a7c15ull) : 0;
+}
+
+static uint64_t c8_screen_key(uint32_t pos, uint64_t word)
+{
+    return word ? c8_hash_key(word ^ (pos + 1) * 0x9e3779b97f4a7c15ull) : 0;
+}
+
+/* n rows of a plane from y. lo-res never touches the second word */
+static uint64_t c8_rows_hash(const c8_display* d, uint8_t p, uint8_t y, uint8_t n)
+{
+    const uint8_t words = d->hires ? C8_ROW_WORDS : 1;
+    uint64_t h = 0;
+    for (uint8_t l = y; l < y + n; ++l)
+    {
+        for (uint8_t w = 0; w < words; ++w)
+            h ^= c8_screen_key(((uint32_t)p * C8_HIRES_HEIGHT + l) * C8_ROW_WORDS + w, d->rows[p][l][w]);
+    }
+    return h;
+}
+
+/* all memory writes from ops go through here so the trace sees them */
+static void c8_store(c8_machine* m, uint16_t addr, uint8_t val)
+{
+    addr &= m->s.mem_mask;
+    m->s.mem_hash ^= c8_mem_key(addr, m->s.mem[addr]) ^ c8_mem_key(addr, val);
+    m->s.mem[addr] = val;
+    if (m->trace_rec)
+    {
+        c8_trace_add(m, C8_TRACE_MEM, addr, val);
+    }
+}
+
+/* xorshift32, only needs to be cheap and the same every time from the same seed */
+static uint8_t c8_random(c8_state* s)
+{
+    uint32_t r = s->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    s->rng = r;
+    return (uint8_t)(r >> 24);
+}
+
+static const uint8_t c8_font[16 * 5] =
+{
+    0xf0, 0x90, 0x90, 0x90, 0xf0, 0x20, 0x60, 0x20, 0x20, 0x70, /* 0 1 */
+    0xf0, 0x10, 0xf0, 0x80, 0xf0, 0xf0, 0x10, 0xf0, 0x10, 0xf0, /* 2 3 */
+    0x90, 0x90, 0xf0, 0x10, 0x10, 0xf0, 0x80, 0xf0, 0x10, 0xf0, /* 4 5 */
+    0xf0, 0x80, 0xf0, 0x90, 0xf0, 0xf0, 0x10, 0x20, 0x40, 0x40, /* 6 7 */
+    0xf0, 0x90, 0xf0, 0x90, 0xf0, 0xf0, 0x90, 0xf0, 0x10, 0xf0, /* 8 9 */
+    0xf0, 0x90, 0xf0, 0x90, 0x90, 0xe0, 0x90, 0xe0, 0x90, 0xe0, /* A B */
+    0xf0, 0x80, 0x80, 0x80, 0xf0, 0xe0, 0x90, 0x90, 0x90, 0xe0, /* C D */
+    0xf0, 0x80, 0xf0, 0x80, 0xf0, 0xf0, 0x80, 0xf0, 0x80, 0x80, /* E F */
+};
+
+/* super-chip only had 0-9 big, A-F are the ones xo-chip roms expect */
+static const uint8_t c8_big_font[16 * 10] =
+{
+    0xff, 0xff, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xff, 0xff, /* 0 */
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xff, 0xff, /* 1 */
+    0xff, 0xff, 0x03, 0x03, 0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, /* 2 */
+    0xff, 0xff, 0x03, 0x03, 0xff, 0xff, 0x03, 0x03, 0xff, 0xff, /* 3 */
+    0xc3, 0xc3, 0xc3, 0xc3, 0xff, 0xff, 0x03, 0x03, 0x03, 0x03, /* 4 */
+    0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0x03, 0x03, 0xff, 0xff, /* 5 */
+    0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, /* 6 */
+    0xff, 0xff, 0x03, 0x03, 0x06, 0x0c, 0x18, 0x18, 0x18, 0x18, /* 7 */
+    0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, /* 8 */
+    0xff, 0xff, 0xc3, 0xc3, 0xff, 0xff, 0x03, 0x03, 0xff, 0xff, /* 9 */
+    0x7e, 0xff, 0xc3, 0xc3, 0xc3, 0xff, 0xff, 0xc3, 0xc3, 0xc3, /* A */
+    0xfc, 0xfc, 0xc3, 0xc3, 0xfc, 0xfc, 0xc3, 0xc3, 0xfc, 0xfc, /* B */
+    0x3c, 0xff, 0xc3, 0xc0, 0xc0, 0xc0, 0xc0, 0xc3, 0xff, 0x3c, /* C */
+    0xfc, 0xfe, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xc3, 0xfe, 0xfc, /* D */
+    0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, /* E */
+    0xff, 0xff, 0xc0, 0xc0, 0xff, 0xff, 0xc0, 0xc0, 0xc0, 0xc0, /* F */
+};
+
+static uint8_t c8_display_height(const c8_display* d)
+{
+    return d->hires ? C8_HIRES_HEIGHT : C8_HEIGHT;
+}
+
+/* after a scroll every row has moved, so the planes it went over are hashed again.
+only the rows the resolution has, nothing below them is ever lit */
+static void c8_screen_rehash(c8_state* s, uint8_t planes)
+{
+    for (uint8_t p = 0; p < C8_PLANES; ++p)
+    {
+        if (planes & (1 << p))
+            s->plane_hash[p] = c8_rows_hash(&s->screen, p, 0, c8_display_height(&s->screen));
+    }
 }
 
-static void c8_display_sprite(uint8_t x, uint8_t y, uint8_t nlines)
+static void c8_display_sprite(c8_machine* m, uint8_t x, uint8_t y, uint8_t nlines)
 {
-    c8_debug("c8_display_sprite: x = 0x%x y = 0x%x nlines=%x\n", x, y, nlines);
+    c8_state* s = &m->s;
+    c8_display* d = &s->screen;
+    const uint8_t h = c8_display_height(d);
 
-    /* flag is set if anything cleared in any loop */
-    *vf = 0;
+    /* flag is set if anything cleared in any row */
+    s->v[0xf] = 0;
 
-    /* normal 8 x nlines sprite, data starting at I */
-    /* few tricky bits - wrap across edges of overflow on x/y */
-    for (uint8_t l = 0; l < nlines; ++l)
+    /* DXY0 is super-chips 16x16, two bytes a row. otherwise 8 x nlines. rows wrap
+    at the bottom. with both xo-chip planes selected the second planes data follows
+    the firsts */
+    const bool big = nlines == 0;
+    const uint8_t rows = big ? 16 : nlines;
+    /* the rows before and after the wrap are each one run of consecutive screen rows */
+    const uint8_t y0 = y % h;
+    const uint8_t first = rows < h - y0 ? rows : h - y0;
+    const c8_blit_fn blit = c8_blit_best();
+    uint16_t src = s->i;
+    for (uint8_t p = 0; p < C8_PLANES; ++p)
     {
-        for (uint8_t b = 0; b < 8; ++b)
+        if (!(s->planes & (1 << p)))
+            continue;
+        uint64_t bits[C8_BLIT_MAX_ROWS];
+        for (uint8_t l = 0; l < rows; ++l)
         {
-            uint8_t source_bit = (mem[i + l] >> (7 - b)) & 1;
-            if (!source_bit)
-                continue;
-            /* dont forget, we are indexing into array , need an index that will fit lol */
-            uint32_t target = ((x + b) % C8_WIDTH) + ((y + l) % C8_HEIGHT) * C8_WIDTH;
-            if (screenb[target])
+            if (big)
             {
-                screenb[target] = 0;
-                *vf = 0x01;
+                bits[l] = ((uint64_t)s->mem[src & s->mem_mask] << 56) | ((uint64_t)s->mem[(src + 1) & s->mem_mask] << 48);
+                src += 2;
             }
             else
             {
-                screenb[target] = 0xff;
+                bits[l] = (uint64_t)s->mem[src & s->mem_mask] << 56;
+                ++src;
             }
         }
+        /* the rows it lands on, hashed out before and back in after */
+        const uint8_t rest = rows - first;
+        uint64_t rows_hash = c8_rows_hash(d, p, y0, first) ^ c8_rows_hash(d, p, 0, rest);
+        bool hit = blit(&d->rows[p][y0], bits, first, x, d->hires);
+        if (rest)
+            hit |= blit(&d->rows[p][0], bits + first, rest, x, d->hires);
+        rows_hash ^= c8_rows_hash(d, p, y0, first) ^ c8_rows_hash(d, p, 0, rest);
+        s->plane_hash[p] ^= rows_hash;
+        if (hit)
+            s->v[0xf] = 0x01;
+    }
+    m->gfx_dirty = true;
+}
+
+/* bytes a DXYN reads, for watchpoints */
+static uint16_t c8_sprite_bytes(const c8_state* s, uint8_t nlines)
+{
+    const uint16_t per_plane = nlines ? nlines : 32;
+    return per_plane * (uint16_t)(((s->planes >> 0) & 1) + ((s->planes >> 1) & 1));
+}
+
+/* 00CN */
+static void c8_scroll_down(c8_display* d, uint8_t planes, uint8_t n)
+{
+    const uint8_t h = c8_display_height(d);
+    if (n > h)
+        n = h;
+    for (uint8_t p = 0; p < C8_PLANES; ++p)
+    {
+        if (!(planes & (1 << p)))
+            continue;
+        memmove(d->rows[p][n], d->rows[p][0], (h - n) * sizeof(d->rows[p][0]));
+        memset(d->rows[p][0], 0, n * sizeof(d->rows[p][0]));
+    }
+}
+
+/* 00DN, xo-chip */
+static void c8_scroll_up(c8_display* d, uint8_t planes, uint8_t n)
+{
+    const uint8_t h = c8_display_height(d);
+    if (n > h)
+        n = h;
+    for (uint8_t p = 0; p < C8_PLANES; ++p)
+    {
+        if (!(planes & (1 << p)))
+            continue;
+        memmove(d->rows[p][0], d->rows[p][n], (h - n) * sizeof(d->rows[p][0]));
+        memset(d->rows[p][h - n], 0, n * sizeof(d->rows[p][0]));
+    }
+}
+
+/* 00FB / 00FC, 4 pixels. lo-res never touches the second word so it stays clear */
+static void c8_scroll_side(c8_display* d, uint8_t planes, bool right)
+{
+    const uint8_t h = c8_display_height(d);
+    for (uint8_t r = 0; r < h * C8_PLANES; ++r)
+    {
+        if (!(planes & (1 << (r / h))))
+            continue;
+        uint64_t* w = d->rows[r / h][r % h];
+        if (!d->hires)
+        {
+            w[0] = right ? w[0] >> 4 : w[0] << 4;
+        }
+        else if (right)
+        {
+            w[1] = (w[1] >> 4) | (w[0] << 60);
+            w[0] >>= 4;
+        }
+        else
+        {
+            w[0] = (w[0] << 4) | (w[1] >> 60);
+            w[1] <<= 4;
+        }
     }
+}
 
-    /* auto increment i ! dont forget this */
-    i += nlines;
-    gfx_dirty = true;
+static void c8_set_hires(c8_machine* m, bool hires)
+{
+    memset(&m->s.screen, 0, sizeof(m->s.screen));
+    memset(m->s.plane_hash, 0, sizeof(m->s.plane_hash));
+    m->s.screen.hires = hires;
+    m->gfx_dirty = true;
+}
+
+/* a bad op. it goes no further and c8_run stops on it with C8_STOP_FAULT, the process
+carries on. where and what op get filled in by c8_fault_note once the op is done */
+static void c8_fatal(c8_machine* m, c8_fault_reason why)
+{
+    m->faulted = true;
+    m->fault.reason = why;
 }
 
-static void c8_fatal(void)
+/* the op at op_pc faulted. leave the machine looking at it, halted there until the
+rom is reloaded, the machine reset or a debugger changes something */
+static void c8_fault_note(c8_machine* m, uint16_t op_pc)
 {
-    /* DEBUG HOOK */
-    abort();
+    const c8_state* s = &m->s;
+    m->fault.pc = op_pc;
+    m->fault.op = (uint16_t)(s->mem[op_pc & s->mem_mask] << 8 | s->mem[(op_pc + 1) & s->mem_mask]);
+    m->fault.cycle = s->cycles - 1;
+    m->s.pc = op_pc;
+    m->stop_addr = op_pc;
+}
+
+/* what mem[from..to) adds to the running hash, skipping zeroes 8 at a time */
+static uint64_t c8_mem_unhash(const uint8_t* mem, uint32_t from, uint32_t to)
+{
+    uint64_t h = 0;
+    uint32_t a = from;
+    for (; a < to && (a & 7); ++a)
+        h ^= c8_mem_key(a, mem[a]);
+    for (; a + 8 <= to; a += 8)
+    {
+        uint64_t word;
+        memcpy(&word, &mem[a], sizeof(word));
+        if (!word)
+            continue;
+        for (uint32_t b = a; b < a + 8; ++b)
+            h ^= c8_mem_key(b, mem[b]);
+    }
+    for (; a < to; ++a)
+        h ^= c8_mem_key(a, mem[a]);
+    return h;
+}
+
+/* nothing loaded, and nothing runs until something is */
+static void c8_rom_too_big(c8_machine* m)
+{
+    c8_fault_clear(m);
+    c8_fatal(m, C8_FAULT_ROM_TOO_BIG);
+    m->fault.pc = 0x200;
+    m->fault.cycle = m->s.cycles;
+}
+
+bool c8_load_rom_mem(c8_machine* m, const uint8_t* data, size_t size, bool xo)
+{
+    m->rom_size = 0;
+    m->rom_loaded = false;
+    c8_fault_clear(m);
+
+    if (size > C8_MEM_SIZE - 512)
+    {
+        fprintf(stderr, "c8_load_rom: rom is too big: %zu\n", size);
+        c8_rom_too_big(m);
+        return false;
+    }
+    else if (size > 0)
+    {
+        /* nothing left over from the last rom past the interpreter area, c8_init
+        does that. anything too big for 4k gets the xo-chip 64k */
+        xo = xo || size > C8_MEM_SIZE_CLASSIC - 512;
+        const uint32_t was_mask = m->s.mem_mask;
+        const uint32_t mask = xo ? C8_MEM_SIZE - 1 : C8_MEM_SIZE_CLASSIC - 1;
+        /* only what this rom can reach, past the mask is never read or copied. the
+        running hash is fixed up where a byte changes rather than redone, so loading
+        over a snapshot with nothing there costs about what the copy does */
+        uint8_t* mem = m->s.mem;
+        uint64_t h = m->s.mem_hash;
+        if (mask > was_mask)
+        {
+            /* never hashed, whatever is there */
+            memset(&mem[was_mask + 1], 0, mask - was_mask);
+        }
+        else
+        {
+            /* hashed but out of reach from now on */
+            h ^= c8_mem_unhash(mem, mask + 1, was_mask + 1);
+        }
+        for (uint32_t a = 512; a < 512 + size; ++a)
+        {
+            if (mem[a] != data[a - 512])
+                h ^= c8_mem_key(a, mem[a]) ^ c8_mem_key(a, data[a - 512]);
+        }
+        memcpy(&mem[512], data, size);
+        h ^= c8_mem_unhash(mem, 512 + (uint32_t)size, mask + 1);
+        memset(&mem[512 + size], 0, mask + 1 - 512 - size);
+        m->s.mem_hash = h;
+        m->s.mem_mask = (uint16_t)mask;
+        m->rom_size = (uint16_t)size;
+    }
+    m->rom_loaded = true;
+    return true;
 }
 
-bool c8_load_rom(const char* filename)
+bool c8_load_rom(c8_machine* m, const char* filename)
 {
-    rom_size = 0;
-    rom_loaded = false;
+    m->rom_size = 0;
+    m->rom_loaded = false;
 
     FILE* f = fopen(filename, "rb");
     if (!f)
     {
         fprintf(stderr, "c8_load_rom: failed to open file '%s'!\n", filename);
-        //c8_fatal();
-        /* solely for static code analysis */
         return false;
     }
 
@@ -100,80 +363,260 @@ bool c8_load_rom(const char* filename)
     size_t fsz = ftell(f);
     fseek(f, 0, SEEK_SET);
 
-    if (fsz > 4096 - 512)
+    if (fsz > C8_MEM_SIZE - 512)
     {
         fprintf(stderr, "c8_load_rom: file is too big: %zu\n", fsz);
-        c8_fatal();
+        c8_rom_too_big(m);
+        fclose(f);
+        return false;
     }
-    else if (fsz > 0)
+
+    uint8_t* buf = malloc(fsz ? fsz : 1);
+    if (!buf)
     {
-        /* made sure its not too big, skip first sector */
-        uint8_t* pmem1 = &mem[512];
-        fread(pmem1, 1, fsz, f);
-        c8_debug("c8_load_rom: loaded rom %s into memory (%zu bytes)\n", filename, fsz);
-        rom_size = (uint16_t)fsz;
+        fclose(f);
+        return false;
     }
+    const size_t got = fread(buf, 1, fsz, f);
     fclose(f);
-    rom_loaded = true;
-    return true;
+
+    /* named like an xo-chip rom gets the 64k whatever its size */
+    const char* ext = strrchr(filename, '.');
+    const bool ok = c8_load_rom_mem(m, buf, got, ext && !strcmp(ext, ".xo8"));
+    free(buf);
+    return ok;
 }
 
-static void c8_handle_fop(uint8_t x, uint8_t lobyte)
+void c8_seed(c8_machine* m, uint32_t seed)
 {
-    c8_debug("c8_handle_fop: x=%x op=%x\n", x, lobyte);
-    if (x >= C8_REG_MAX_IDX)
+    /* xorshift is stuck at 0 forever */
+    m->s.rng = seed ? seed : 0x2545f491;
+}
+
+void c8_set_keyq(c8_machine* m, c8_keyq* q)
+{
+    m->keyq = q;
+}
+
+void c8_set_audio(c8_machine* m, c8_audio* a)
+{
+    m->audio = a;
+}
+
+/* the beeper is on while ST is non zero, only the edges get sent */
+static void c8_sound(c8_machine* m, uint64_t cycle, bool on)
+{
+    if (m->audio)
+        c8_audio_post(m->audio, cycle, on ? C8_AUDIO_ON : C8_AUDIO_OFF, 0);
+}
+
+/* after a jump (rom drop, reverse) the audio thread needs everything again */
+static void c8_sound_sync(c8_machine* m)
+{
+    if (!m->audio)
+        return;
+    c8_audio_post(m->audio, m->s.cycles, C8_AUDIO_PITCH, m->s.pitch);
+    if (m->s.pattern_set)
+        c8_audio_pattern(m->audio, m->s.cycles, m->s.pattern);
+    c8_sound(m, m->s.cycles, m->s.snd != 0);
+}
+
+/* FX0A finishing between ops. the op was traced when it parked, this second record
+for it is the one with the key it got, at the cycle the key landed on */
+static void c8_trace_key_wait(c8_machine* m, uint8_t x, uint8_t v0)
+{
+    c8_state* s = &m->s;
+    if (!c8_trace_active() || s->cycles < m->trace_next)
+        return;
+    c8_trace_rec* rec = c8_trace_begin();
+    rec->cycle = s->cycles;
+    rec->pc = (s->pc - 2) & s->mem_mask;
+    rec->op = 0xf00a | x << 8;
+    rec->ndeltas = 0;
+    m->trace_rec = rec;
+    if (s->v[x] != v0)
+        c8_trace_add(m, C8_TRACE_V0 + x, 0, s->v[x]);
+    m->trace_rec = NULL;
+    c8_trace_commit();
+}
+
+static void c8_key(c8_machine* m, uint8_t key, bool down)
+{
+    c8_state* s = &m->s;
+    const uint16_t bit = (uint16_t)(1 << key);
+    s->keys = down ? s->keys | bit : s->keys & ~bit;
+    if (down && s->key_wait)
+    {
+        /* FX0A gets the key and the machine carries on */
+        const uint8_t x = s->key_wait & 0xf;
+        const uint8_t v0 = s->v[x];
+        s->v[x] = key;
+        s->key_wait = 0;
+        c8_trace_key_wait(m, x, v0);
+    }
+}
+
+void c8_set_keys(c8_machine* m, uint16_t keys)
+{
+    for (uint16_t changed = m->s.keys ^ keys; changed; changed &= changed - 1)
+    {
+        uint8_t key = 0;
+        while (!(changed & (1 << key)))
+            ++key;
+        c8_key(m, key, (keys >> key) & 1);
+    }
+}
+
+static void c8_history_edited(c8_machine* m);
+
+/* whatever the host sent since the last op. takes effect before the next op */
+static void c8_keys_drain(c8_machine* m)
+{
+    /* after reversing the machine replays the keys it had the first time round. a new
+    one from the host means this is a different future now */
+    c8_key_event e;
+    while (c8_keyq_pop(m->keyq, &e))
+    {
+        if (m->history)
+        {
+            if (m->s.cycles < c8_history_end(m->history))
+                c8_history_edited(m);
+            c8_history_key(m->history, m->s.cycles, e.key, e.down);
+        }
+        c8_key(m, e.key, e.down);
+    }
+}
+
+/* keys due before the next op, from the host or from history when re-running */
+static void c8_keys_poll(c8_machine* m)
+{
+    while (m->replay_left && m->replay_keys->cycle == m->s.cycles)
     {
-        c8_fatal();
+        c8_key(m, m->replay_keys->key, m->replay_keys->down);
+        ++m->replay_keys;
+        --m->replay_left;
     }
+    if (m->keyq && c8_keyq_pending(m->keyq))
+        c8_keys_drain(m);
+}
+
+/* FX0A has the machine parked - time passes, nothing runs. same timer ticks as
+ncycles worth of c8_timers, just without going round */
+static void c8_park(c8_machine* m, uint32_t ncycles)
+{
+    c8_state* s = &m->s;
+    const uint32_t div = s->timer_div + ncycles;
+    const uint32_t ticks = div / C8_CYCLES_PER_FRAME;
+    if (s->snd && ticks >= s->snd)
+    {
+        /* the tick that empties ST, c8_timers would have sent it then */
+        c8_sound(m, s->cycles + (C8_CYCLES_PER_FRAME - s->timer_div) + (s->snd - 1u) * C8_CYCLES_PER_FRAME, false);
+    }
+    s->timer_div = (uint8_t)(div % C8_CYCLES_PER_FRAME);
+    s->delay = s->delay > ticks ? (uint8_t)(s->delay - ticks) : 0;
+    s->snd = s->snd > ticks ? (uint8_t)(s->snd - ticks) : 0;
+    s->cycles += ncycles;
+}
+
+/* skips hop over F000 NNNN whole, its the only 4 byte op */
+static void c8_skip(c8_state* s)
+{
+    const bool long_op = s->mem[s->pc & s->mem_mask] == 0xf0 && s->mem[(s->pc + 1) & s->mem_mask] == 0x00;
+    s->pc += long_op ? 4 : 2;
+}
+
+static void c8_handle_fop(c8_machine* m, uint8_t x, uint8_t lobyte)
+{
+    c8_state* s = &m->s;
 
     switch (lobyte)
     {
+    case 0x00:
+        /* xo-chip F000 NNNN: I = the next word */
+        if (x)
+            break;
+        s->i = (uint16_t)((s->mem[s->pc & s->mem_mask] << 8) | s->mem[(s->pc + 1) & s->mem_mask]);
+        s->pc += 2;
+        break;
+    case 0x01:
+        /* xo-chip FN01: pick planes */
+        s->planes = x & 3;
+        break;
+    case 0x02:
+        /* xo-chip F002: 16 byte audio pattern from I */
+        if (x)
+            break;
+        for (uint8_t c = 0; c < sizeof(s->pattern); ++c)
+            s->pattern[c] = s->mem[(s->i + c) & s->mem_mask];
+        s->pattern_set = 1;
+        if (m->audio)
+            c8_audio_pattern(m->audio, s->cycles, s->pattern);
+        break;
     case 0x07:
-        v[x] = delay;
+        s->v[x] = s->delay;
         break;
     case 0x0a:
-        /* TODO: wait for keypress*/
-        /* this would be kinda a pita to ferry with our sdl event pump : - ) */
-        v[x] = 0x00;
+        /* park until a key goes down, c8_key finishes the op */
+        s->key_wait = 0x10 | x;
         break;
     case 0x15:
-        delay = v[x];
+        s->delay = s->v[x];
         break;
     case 0x18:
-        snd = v[x];
+        if (!s->snd != !s->v[x])
+            c8_sound(m, s->cycles, s->v[x] != 0);
+        s->snd = s->v[x];
         break;
     case 0x1e:
-        i += v[x];
+        s->i += s->v[x];
         break;
     case 0x29:
-        /* TODO: I = location of sprite for digit v[x] ?? font  */
+        s->i = C8_FONT_ADDR + (s->v[x] & 0xf) * 5;
+        break;
+    case 0x30:
+        /* super-chip 8x10 digits */
+        s->i = C8_BIG_FONT_ADDR + (s->v[x] & 0xf) * 10;
+        break;
+    case 0x75:
+        for (uint8_t c = 0; c <= x; ++c)
+            s->rpl[c] = s->v[c];
+        break;
+    case 0x85:
+        for (uint8_t c = 0; c <= x; ++c)
+            s->v[c] = s->rpl[c];
+        break;
+    case 0x3a:
+        /* xo-chip pitch register */
+        s->pitch = s->v[x];
+        if (m->audio)
+            c8_audio_post(m->audio, s->cycles, C8_AUDIO_PITCH, s->pitch);
         break;
     case 0x33:
         /* store bcd of v[x] in i, i+1, i+2 */
-        mem[i] = (v[x] / 100) % 10;
-        mem[i + 1] = (v[x] / 10) % 10;
-        mem[i + 2] = v[x] % 10;
+        c8_store(m, s->i, (s->v[x] / 100) % 10);
+        c8_store(m, s->i + 1, (s->v[x] / 10) % 10);
+        c8_store(m, s->i + 2, s->v[x] % 10);
         break;
     case 0x55:
         /* store V0 .. Vx into memory starting at i */
         for (uint8_t c = 0; c <= x; ++c)
         {
-            mem[i + c] = v[c];
+            c8_store(m, s->i + c, s->v[c]);
         }
         break;
     case 0x65:
         /* load V0 .. Vx from memory starting at i */
         for (uint8_t c = 0; c <= x; ++c)
         {
-            v[c] = mem[i + c];
+            s->v[c] = s->mem[(s->i + c) & s->mem_mask];
         }
         break;
     }
 }
 
-static void c8_handle_8op(uint8_t x, uint8_t y, uint8_t eightop)
+static void c8_handle_8op(c8_state* s, uint8_t x, uint8_t y, uint8_t eightop)
 {
-    c8_debug("c8_handle_8op: x=%x y=%x op=%x\n", x, y, eightop);
+    uint8_t* v = s->v;
 
     /* 0x8xyN has lots of ops - handle here */
     switch (eightop)
@@ -193,44 +636,45 @@ static void c8_handle_8op(uint8_t x, uint8_t y, uint8_t eightop)
     case 4:
     {
         bool carry = v[x] + v[y] > 255;
-        *vf = carry;
+        v[0xf] = carry;
         v[x] = v[x] + v[y];
         break;
     }
     case 5:
     {
         bool borrow = v[x] > v[y];
-        *vf = borrow;
+        v[0xf] = borrow;
         v[x] = v[x] - v[y];
         break;
     }
     case 6:
         /* TODO: check if flag is before or after */
-        *vf = (v[x] & 1) == 1;
+        v[0xf] = (v[x] & 1) == 1;
         v[x] = v[x] >> 1;
         break;
     case 7:
     {
         bool nborrow = v[y] > v[x];
-        *vf = nborrow;
+        v[0xf] = nborrow;
         v[x] = v[y] - v[x];
         break;
     }
     case 0xe:
         /* TODO: check if flag is before or after */
-        *vf = (v[x] & 128) != 0;
+        v[0xf] = (v[x] & 128) != 0;
         v[x] = v[x] << 1;
         break;
     }
 }
 
 /* take a look at whatever is current in op and act upon it. updates pc */
-static void c8_decode_op(void)
+static void c8_decode_op(c8_machine* m)
 {
-    const uint16_t op = (mem[pc] << 8) + mem[pc + 1];
+    c8_state* s = &m->s;
+    const uint16_t op = (s->mem[s->pc & s->mem_mask] << 8) + s->mem[(s->pc + 1) & s->mem_mask];
 
     /* we read it, increment right away. makes jumping around below easier */
-    pc += 2;
+    s->pc += 2;
 
     /*  hi nibble / lo nibble - dont forget its big endian */
     const uint8_t nib1 = (op & 0xf000) >> 12;
@@ -241,8 +685,6 @@ static void c8_decode_op(void)
     const uint8_t y = (op & 0x00f0) >> 4;
     const uint8_t last_nib = op & 0x000f;
 
-    c8_debug("c8_decode_op: raw=%04x - ", op);
-
     /* most opcodes can be completely keyed off first nibble */
     switch (nib1)
     {
@@ -252,18 +694,59 @@ static void c8_decode_op(void)
         /* 00EE - return from sub */
         if (nib1 == 0)
         {
-            if (lobyte == 0xe0)
+            if (op == 0x00e0)
+            {
+                for (uint8_t p = 0; p < C8_PLANES; ++p)
+                {
+                    if (s->planes & (1 << p))
+                    {
+                        memset(s->screen.rows[p], 0, sizeof(s->screen.rows[p]));
+                        s->plane_hash[p] = 0;
+                    }
+                }
+                m->gfx_dirty = true;
+            }
+            else if (op == 0x00ee)
             {
-                c8_debug("cls\n");
-                memset(&screenb, 0, sizeof(screenb));
-                gfx_dirty = true;
+                /* ret - pop stack. nothing on it is a bad rom, not a trip past the end
+                of the stack */
+                if (s->sp == 0)
+                {
+                    c8_fatal(m, C8_FAULT_STACK_UNDERFLOW);
+                }
+                else
+                {
+                    s->pc = s->stack[s->sp];
+                    --s->sp;
+                }
             }
-            else if (lobyte == 0xee)
+            /* super-chip */
+            else if ((op & 0xfff0) == 0x00c0)
             {
-                c8_debug("ret\n");
-                /* ret - pop stack */
-                pc = stack[sp];
-                --sp;
+                c8_scroll_down(&s->screen, s->planes, last_nib);
+                c8_screen_rehash(s, s->planes);
+                m->gfx_dirty = true;
+            }
+            else if ((op & 0xfff0) == 0x00d0)
+            {
+                c8_scroll_up(&s->screen, s->planes, last_nib);
+                c8_screen_rehash(s, s->planes);
+                m->gfx_dirty = true;
+            }
+            else if (op == 0x00fb || op == 0x00fc)
+            {
+                c8_scroll_side(&s->screen, s->planes, op == 0x00fb);
+                c8_screen_rehash(s, s->planes);
+                m->gfx_dirty = true;
+            }
+            else if (op == 0x00fd)
+            {
+                /* exit - sit on this op forever */
+                s->pc -= 2;
+            }
+            else if (op == 0x00fe || op == 0x00ff)
+            {
+                c8_set_hires(m, op == 0x00ff);
             }
 
             /* 0nnn - SYS not implemented */
@@ -272,24 +755,23 @@ static void c8_decode_op(void)
     case 1:
     {
         /* goto 0xNNN */
-        pc = nnn;
-        c8_debug("goto 0x%03x\n", nnn);
+        s->pc = nnn;
         break;
     }
     case 2:
     {
         /* call subroutine at 0xNNN */
-        ++sp;
-        if (sp > 15)
+        ++s->sp;
+        if (s->sp > 15)
         {
-            /* stack too big */
-            c8_fatal();
+            /* stack too big, leave it full rather than past the end */
+            --s->sp;
+            c8_fatal(m, C8_FAULT_STACK_OVERFLOW);
         }
         else
         {
-            c8_debug("call 0x%03x\n", nnn);
-            stack[sp] = pc; /* TODO: check this needs to be incr before? */
-            pc = nnn;
+            s->stack[s->sp] = s->pc; /* TODO: check this needs to be incr before? */
+            s->pc = nnn;
         }
         break;
     }
@@ -297,147 +779,171 @@ static void c8_decode_op(void)
     case 4: /* intentional fallthrough */
     {
         uint8_t cmp = op & 0xff;
-        c8_debug("skip next if v%x %s 0x%02x\n", x, nib1 == 3 ? "==" : "!=", cmp);
-        if (x >= C8_REG_MAX_IDX)
-        {
-            /* err */
-            c8_fatal();
-        }
-        else if ((nib1 == 3 && v[x] == cmp) || (nib1 == 4 && v[x] != cmp))
+        if ((nib1 == 3 && s->v[x] == cmp) || (nib1 == 4 && s->v[x] != cmp))
         {
             /* skip next */
-            pc += 2;
+            c8_skip(s);
         }
         break;
     }
     case 5:
     {
-        c8_debug("skip next if v%x == v%x\n", x, y);
-        if (x == y)
+        if (last_nib == 0 && s->v[x] == s->v[y])
         {
             /* skip next */
-            pc += 2;
+            c8_skip(s);
         }
-        break;
-    }
-    case 6:
-    {
-        if (x >= C8_REG_MAX_IDX)
-        {
-            c8_fatal();
-        }
-        else
+        else if (last_nib == 2 || last_nib == 3)
         {
-            c8_debug("v%x = %x\n", x, lobyte);
-            v[x] = lobyte;
+            /* xo-chip 5XY2 / 5XY3 - save or load Vx..Vy at I, either direction, I
+            stays put */
+            const int8_t dir = x <= y ? 1 : -1;
+            for (uint8_t r = x, a = 0;; r += dir, ++a)
+            {
+                if (last_nib == 2)
+                    c8_store(m, s->i + a, s->v[r]);
+                else
+                    s->v[r] = s->mem[(s->i + a) & s->mem_mask];
+                if (r == y)
+                    break;
+            }
         }
         break;
     }
+    case 6:
+        s->v[x] = lobyte;
+        break;
     case 7:
-    {
-        if (x >= C8_REG_MAX_IDX)
-        {
-            c8_fatal();
-        }
-        else
-        {
-            c8_debug("v%x = v%x + %x\n", x, x, lobyte);
-            v[x] = v[x] + lobyte;
-        }
+        s->v[x] = s->v[x] + lobyte;
         break;
-    }
     case 8:
-        c8_handle_8op(x, y, last_nib);
+        c8_handle_8op(s, x, y, last_nib);
         break;
     case 9:
-        if (x >= C8_REG_MAX_IDX || y >= C8_REG_MAX_IDX)
+        if (s->v[x] != s->v[y])
         {
-            c8_fatal();
-        }
-
-        c8_debug("skip next if v%x != v%x\n", x, y);
-        if (v[x] != v[y])
-        {
-            pc += 4;
+            c8_skip(s);
         }
         break;
     case 0xa:
-        c8_debug("I = 0x%03x\n", nnn);
-        i = nnn;
+        s->i = nnn;
         break;
     case 0xb:
         /* jmp to nnn + v0 - check if we need to multiply v[0] */
-        c8_debug("jmp to 0x%03x\n", nnn);
-        pc = nnn + v[0];
+        s->pc = nnn + s->v[0];
         break;
     case 0xc:
     {
         /* vx = random byte & kk */
-        if (x >= C8_REG_MAX_IDX)
-        {
-            c8_fatal();
-        }
-
-        uint8_t rv = rand() % 256;
-        c8_debug("v%x = randbyte & 0x%02x\n", x, lobyte);
-        v[x] = rv & lobyte;
+        uint8_t rv = c8_random(s);
+        s->v[x] = rv & lobyte;
         break;
     }
     case 0xd:
-        if (x >= C8_REG_MAX_IDX || y >= C8_REG_MAX_IDX)
-        {
-            c8_fatal();
-        }
-
-        c8_display_sprite(v[x], v[y], last_nib);
+        c8_display_sprite(m, s->v[x], s->v[y], last_nib);
         break;
     case 0xe:
         if (lobyte == 0x9e)
         {
             /* skip next if key w/ value of vx pressed */
-            if (x >= C8_REG_MAX_IDX)
+            if (s->keys & (1 << (s->v[x] & 0xf)))
             {
-                c8_fatal();
+                c8_skip(s);
             }
-            c8_debug("skip next if key %x pressed\n", x);
-            /* TODO: */
         }
         else if (lobyte == 0xa1)
         {
             /* skip next instructino if key with value of vx is not pressed */
-            if (x >= C8_REG_MAX_IDX)
+            if (!(s->keys & (1 << (s->v[x] & 0xf))))
             {
-                c8_fatal();
+                c8_skip(s);
             }
-
-            c8_debug("skip next if key %x not pressed\n", x);
-            /* TODO: */
         }
         break;
     case 0xf:
-        c8_handle_fop(x, lobyte);
+        c8_handle_fop(m, x, lobyte);
         break;
     }
 }
 
-static void c8_timers(void)
+static void c8_timers(c8_machine* m)
 {
-    if (snd)
+    c8_state* s = &m->s;
+    /* DT and ST count down at 60hz, a frame is C8_CYCLES_PER_FRAME ops */
+    if (++s->timer_div < C8_CYCLES_PER_FRAME)
+        return;
+    s->timer_div = 0;
+
+    if (s->snd && !--s->snd)
+    {
+        /* ticks at the end of this op */
+        c8_sound(m, s->cycles + 1, false);
+    }
+
+    if (s->delay)
     {
-        /* buzzer here */
-        --snd;
+        --s->delay;
     }
+}
+
+/* same as c8_decode_op but fills a trace record with whatever the op changed */
+static void c8_decode_op_traced(c8_machine* m)
+{
+    c8_state* s = &m->s;
+    uint8_t v0[16];
+    memcpy(v0, s->v, sizeof(s->v));
+    const uint16_t i0 = s->i;
+    const uint16_t sp0 = s->sp;
+    const uint8_t delay0 = s->delay;
+    const uint8_t snd0 = s->snd;
+
+    c8_trace_rec* rec = c8_trace_begin();
+    rec->cycle = s->cycles;
+    rec->pc = s->pc;
+    rec->op = (s->mem[s->pc & s->mem_mask] << 8) + s->mem[(s->pc + 1) & s->mem_mask];
+    rec->ndeltas = 0;
+    m->trace_rec = rec;
 
-    if (delay)
+    c8_decode_op(m);
+
+    for (uint8_t r = 0; r < 16; ++r)
     {
-        --delay;
+        if (s->v[r] != v0[r])
+            c8_trace_add(m, C8_TRACE_V0 + r, 0, s->v[r]);
     }
+    if (s->i != i0)
+        c8_trace_add(m, C8_TRACE_I, 0, s->i);
+    if (s->sp != sp0)
+        c8_trace_add(m, C8_TRACE_SP, 0, s->sp);
+    if (s->delay != delay0)
+        c8_trace_add(m, C8_TRACE_DT, 0, s->delay);
+    if (s->snd != snd0)
+        c8_trace_add(m, C8_TRACE_ST, 0, s->snd);
+
+    m->trace_rec = NULL;
+    m->trace_next = s->cycles + 1;
+    c8_trace_commit();
 }
 
-void c8_cycle(void)
+/* one op, traced if a trace is open */
+static void c8_step(c8_machine* m)
 {
-    c8_decode_op();
-    c8_timers();
+    c8_keys_poll(m);
+    if (m->s.key_wait)
+    {
+        c8_park(m, 1);
+        return;
+    }
+
+    const uint16_t op_pc = m->s.pc;
+    if (c8_trace_active() && m->s.cycles >= m->trace_next)
+        c8_decode_op_traced(m);
+    else
+        c8_decode_op(m);
+    c8_timers(m);
+    ++m->s.cycles;
+    if (m->faulted)
+        c8_fault_note(m, op_pc);
 
 #if 0
     /* this is a safety guard to catch roms that fall off / bad */
@@ -448,51 +954,658 @@ void c8_cycle(void)
 #endif
 }
 
-void c8_init(void)
+void c8_cycle(c8_machine* m)
 {
-    /* reset all memory incase something was left oevr from previous rom */
-    memset(screenb, 0, sizeof(screenb));
+    if (!m->faulted)
+        c8_step(m);
+}
 
-    /* TODO: load any fonts into sector */
+static void c8_debug_flags(c8_machine* m, uint16_t addr, uint8_t set, uint8_t clear)
+{
+    addr &= C8_MEM_SIZE - 1;
+    const uint8_t old = m->debug_flags[addr];
+    m->debug_flags[addr] = (old | set) & ~clear;
+    for (uint8_t b = 1; b; b <<= 1)
+    {
+        if ((old & b) && !(m->debug_flags[addr] & b))
+            --m->debug_armed;
+        else if (!(old & b) && (m->debug_flags[addr] & b))
+            ++m->debug_armed;
+    }
+}
+
+void c8_break_set(c8_machine* m, uint16_t addr)
+{
+    c8_debug_flags(m, addr, C8_BREAK, 0);
+}
+
+void c8_break_clear(c8_machine* m, uint16_t addr)
+{
+    c8_debug_flags(m, addr, 0, C8_BREAK);
+}
+
+void c8_watch_set(c8_machine* m, uint16_t addr, uint8_t kinds)
+{
+    c8_debug_flags(m, addr, kinds & (C8_WATCH_READ | C8_WATCH_WRITE), 0);
+}
+
+void c8_watch_clear(c8_machine* m, uint16_t addr, uint8_t kinds)
+{
+    c8_debug_flags(m, addr, 0, kinds & (C8_WATCH_READ | C8_WATCH_WRITE));
+}
+
+void c8_watch_reg(c8_machine* m, uint8_t reg, bool watch)
+{
+    const uint16_t bit = (uint16_t)(1 << (reg & 0xf));
+    if (watch && !(m->reg_watch & bit))
+        ++m->debug_armed;
+    else if (!watch && (m->reg_watch & bit))
+        --m->debug_armed;
+    m->reg_watch = watch ? m->reg_watch | bit : m->reg_watch & ~bit;
+}
+
+void c8_debug_clear_all(c8_machine* m)
+{
+    memset(m->debug_flags, 0, sizeof(m->debug_flags));
+    m->reg_watch = 0;
+    m->debug_armed = 0;
+}
+
+void c8_debug_attach(c8_machine* m, bool attach)
+{
+    /* every loop in c8_run notices faults, attaching doesnt need the instrumented one */
+    m->debug_attached = attach;
+    c8_fault_clear(m);
+}
+
+/* the debugger changed the machine under us. replaying from an older checkpoint
+wont give this state, so history from here on starts again */
+static void c8_history_edited(c8_machine* m)
+{
+    if (m->history)
+    {
+        c8_history_truncate(m->history, m->s.cycles);
+        c8_history_save(m->history, &m->s);
+    }
+    m->replay_left = 0;
+}
+
+void c8_get_regs(const c8_machine* m, c8_regs* r)
+{
+    memcpy(r->v, m->s.v, sizeof(m->s.v));
+    r->i = m->s.i;
+    r->pc = m->s.pc;
+    r->sp = m->s.sp;
+    r->delay = m->s.delay;
+    r->snd = m->s.snd;
+}
+
+void c8_set_regs(c8_machine* m, const c8_regs* r)
+{
+    if (r->pc != m->s.pc)
+        m->stop_skip = false;
+    memcpy(m->s.v, r->v, sizeof(m->s.v));
+    m->s.i = r->i;
+    m->s.pc = r->pc;
+    m->s.sp = r->sp & 0xf;
+    m->s.delay = r->delay;
+    m->s.snd = r->snd;
+    /* whatever faulted may be fixed now, let it try again */
+    c8_fault_clear(m);
+    c8_history_edited(m);
+}
 
-    pc = 512; /* skip first sector - orig had chip8 vm, modern puts fonts in there */
-    i = 0;
-    sp = 0;
-    initd = true;
+const uint8_t* c8_memory(const c8_machine* m)
+{
+    return m->s.mem;
 }
 
-bool c8_running(void)
+bool c8_write_memory(c8_machine* m, uint16_t addr, const uint8_t* data, uint16_t len)
 {
-    return initd && rom_loaded;
+    const uint32_t size = (uint32_t)m->s.mem_mask + 1;
+    if (addr >= size || len > size - addr)
+        return false;
+    for (uint16_t n = 0; n < len; ++n)
+    {
+        const uint16_t a = addr + n;
+        m->s.mem_hash ^= c8_mem_key(a, m->s.mem[a]) ^ c8_mem_key(a, data[n]);
+        m->s.mem[a] = data[n];
+    }
+    c8_fault_clear(m);
+    c8_history_edited(m);
+    return true;
 }
 
-bool c8_gfx_dirty(void)
+uint16_t c8_stop_addr(const c8_machine* m)
 {
-    return gfx_dirty;
+    return m->stop_addr;
 }
 
-/* convert our mono bitmap to display format. this sucks, probably a better way*/
-static void c8_draw_points(SDL_Renderer* renderer)
+/* memory the op is about to read or write, apart from fetching itself */
+static bool c8_op_access(const c8_state* s, uint16_t op, uint16_t* addr, uint16_t* len, uint8_t* kind)
 {
-    /* offset slightly into our buffer area for border*/
-    int idx = 0;
+    const uint8_t x = (op & 0x0f00) >> 8;
+    *addr = s->i;
+    switch (op >> 12)
+    {
+    case 0x5:
+    {
+        const uint8_t y = (op & 0x00f0) >> 4;
+        if ((op & 0xf) != 2 && (op & 0xf) != 3)
+            break;
+        *len = (x <= y ? y - x : x - y) + 1;
+        *kind = (op & 0xf) == 2 ? C8_WATCH_WRITE : C8_WATCH_READ;
+        return true;
+    }
+    case 0xd:
+        *len = c8_sprite_bytes(s, op & 0xf);
+        *kind = C8_WATCH_READ;
+        return *len != 0;
+    case 0xf:
+        switch (op & 0xff)
+        {
+        case 0x02:
+            *len = x ? 0 : 16;
+            *kind = C8_WATCH_READ;
+            return *len != 0;
+        case 0x33:
+            *len = 3;
+            *kind = C8_WATCH_WRITE;
+            return true;
+        case 0x55:
+            *len = x + 1;
+            *kind = C8_WATCH_WRITE;
+            return true;
+        case 0x65:
+            *len = x + 1;
+            *kind = C8_WATCH_READ;
+            return true;
+        }
+        break;
+    }
+    return false;
+}
+
+/* checked before an op runs, so a hit leaves the machine sitting on the op */
+static c8_stop c8_debug_check(c8_machine* m)
+{
+    const c8_state* s = &m->s;
+    if (m->debug_flags[s->pc & s->mem_mask] & C8_BREAK)
+    {
+        m->stop_addr = s->pc;
+        return C8_STOP_BREAK;
+    }
 
-    for (int y = 0; y < C8_HEIGHT; ++y)
+    uint16_t addr, len;
+    uint8_t kind;
+    const uint16_t op = (s->mem[s->pc & s->mem_mask] << 8) + s->mem[(s->pc + 1) & s->mem_mask];
+    if (c8_op_access(s, op, &addr, &len, &kind))
     {
-        for (int x = 0; x < C8_WIDTH; ++x, ++idx)
+        for (uint16_t a = 0; a < len; ++a)
         {
-            if (screenb[idx])
+            if (m->debug_flags[(addr + a) & s->mem_mask] & kind)
             {
-                SDL_RenderDrawPoint(renderer, x, y);
+                m->stop_addr = (addr + a) & s->mem_mask;
+                return kind == C8_WATCH_READ ? C8_STOP_WATCH_READ : C8_STOP_WATCH_WRITE;
             }
         }
     }
+    return C8_STOP_NONE;
+}
+
+/* did the op just run change a watched register */
+static bool c8_reg_watch_hit(const c8_machine* m, const uint8_t* v0)
+{
+    for (uint8_t r = 0; r < 16; ++r)
+    {
+        if ((m->reg_watch & (1 << r)) && m->s.v[r] != v0[r])
+            return true;
+    }
+    return false;
+}
+
+/* instrumented loop, only used while something is armed */
+static c8_stop c8_run_debug(c8_machine* m, int ncycles)
+{
+    bool skip = m->stop_skip;
+    m->stop_skip = false;
+
+    for (int n = 0; n < ncycles; ++n)
+    {
+        /* keys first so the check sees what the op will */
+        c8_keys_poll(m);
+
+        if (skip)
+        {
+            skip = false;
+        }
+        else if (!m->s.key_wait)
+        {
+            c8_stop stop = c8_debug_check(m);
+            if (stop != C8_STOP_NONE)
+            {
+                m->stop_skip = true;
+                return stop;
+            }
+        }
+        const uint16_t op_pc = m->s.pc;
+        uint8_t v0[16];
+        if (m->reg_watch)
+            memcpy(v0, m->s.v, sizeof(v0));
+        c8_step(m);
+        if (m->faulted)
+            return C8_STOP_FAULT;
+        if (m->reg_watch && c8_reg_watch_hit(m, v0))
+        {
+            m->stop_addr = op_pc;
+            return C8_STOP_WATCH_REG;
+        }
+    }
+    return C8_STOP_NONE;
+}
+
+static c8_stop c8_run_chunk(c8_machine* m, int ncycles)
+{
+    if (m->debug_armed)
+        return c8_run_debug(m, ncycles);
+
+    if (c8_trace_active())
+    {
+        for (int n = 0; n < ncycles; ++n)
+        {
+            c8_step(m);
+            if (m->faulted)
+                return C8_STOP_FAULT;
+        }
+        return C8_STOP_NONE;
+    }
+
+    /* the normal release loop, keep it this way */
+    for (int n = 0; n < ncycles; ++n)
+    {
+        if (m->replay_left || (m->keyq && c8_keyq_pending(m->keyq)))
+            c8_keys_poll(m);
+        if (m->s.key_wait)
+        {
+            /* no point going round, idle until the next key we know about or the end
+            of the slice */
+            uint32_t idle = (uint32_t)(ncycles - n);
+            if (m->replay_left && m->replay_keys->cycle - m->s.cycles < idle)
+                idle = (uint32_t)(m->replay_keys->cycle - m->s.cycles);
+            c8_park(m, idle);
+            n += idle - 1;
+            continue;
+        }
+        const uint16_t op_pc = m->s.pc;
+        c8_decode_op(m);
+        c8_timers(m);
+        ++m->s.cycles;
+        /* the cycle counts like it does in c8_step, so both loops agree */
+        if (m->faulted)
+        {
+            c8_fault_note(m, op_pc);
+            return C8_STOP_FAULT;
+        }
+    }
+    return C8_STOP_NONE;
+}
+
+c8_stop c8_run(c8_machine* m, int ncycles)
+{
+    /* halted on a fault, c8_get_fault says why */
+    if (m->faulted)
+        return C8_STOP_FAULT;
+    if (!m->history)
+        return c8_run_chunk(m, ncycles);
+
+    /* same thing, cut up at checkpoints */
+    while (ncycles > 0)
+    {
+        uint64_t due = c8_history_due(m->history);
+        if (m->s.cycles >= due)
+        {
+            c8_history_save(m->history, &m->s);
+            due = c8_history_due(m->history);
+        }
+
+        int chunk = ncycles;
+        if (due > m->s.cycles && due - m->s.cycles < (uint64_t)chunk)
+            chunk = (int)(due - m->s.cycles);
+
+        c8_stop stop = c8_run_chunk(m, chunk);
+        if (stop != C8_STOP_NONE)
+            return stop;
+        ncycles -= chunk;
+    }
+    return C8_STOP_NONE;
+}
+
+bool c8_reverse_enable(c8_machine* m, bool enable)
+{
+    if (!enable)
+    {
+        c8_history_destroy(m->history);
+        m->history = NULL;
+        m->replay_left = 0;
+        return true;
+    }
+
+    if (!m->history)
+    {
+        m->history = c8_history_create();
+        if (!m->history)
+            return false;
+        c8_history_save(m->history, &m->s);
+    }
+    return true;
 }
 
-void c8_draw_frame(SDL_Renderer* renderer)
+/* during a replay keys come from the history instead of the host */
+static void c8_replay_keys(c8_machine* m, const c8_key_event** keys, uint32_t* nkeys)
 {
-    if (!gfx_dirty)
+    while (*nkeys && (*keys)->cycle == m->s.cycles)
+    {
+        c8_key(m, (*keys)->key, (*keys)->down);
+        ++*keys;
+        --*nkeys;
+    }
+}
+
+static void c8_replay_op(c8_machine* m, const c8_key_event** keys, uint32_t* nkeys)
+{
+    c8_replay_keys(m, keys, nkeys);
+    if (m->s.key_wait)
+    {
+        c8_park(m, 1);
         return;
-    c8_draw_points(renderer);
-    gfx_dirty = false;
+    }
+    c8_decode_op(m);
+    c8_timers(m);
+    ++m->s.cycles;
+}
+
+/* put the machine back to how it was at cycle target by re-running from the checkpoint
+before it. keys that came in at target are applied too, same as a live run does
+before the op. nothing is traced or checked on the way */
+static void c8_replay_to(c8_machine* m, const c8_state* from, uint64_t target)
+{
+    uint32_t nkeys;
+    const c8_key_event* keys = c8_history_keys(m->history, from->cycles, &nkeys);
+    c8_audio* audio = m->audio;
+    m->audio = NULL;
+    c8_state_copy(&m->s, from);
+    while (m->s.cycles < target)
+        c8_replay_op(m, &keys, &nkeys);
+    c8_replay_keys(m, &keys, &nkeys);
+    m->gfx_dirty = true;
+    /* back before any fault, a scan may have run into one on the way */
+    c8_fault_clear(m);
+
+    /* quiet on the way, then the beeper picks up wherever it ended */
+    m->audio = audio;
+    c8_sound_sync(m);
+
+    /* running forward from here gets the rest of them */
+    m->replay_keys = keys;
+    m->replay_left = nkeys;
+}
+
+c8_stop c8_reverse_step(c8_machine* m)
+{
+    const c8_state* from = m->history && m->s.cycles ? c8_history_find(m->history, m->s.cycles - 1) : NULL;
+    if (!from)
+        return C8_STOP_HISTORY_START;
+
+    c8_replay_to(m, from, m->s.cycles - 1);
+    m->stop_skip = true;
+    return C8_STOP_NONE;
+}
+
+static c8_stop c8_reverse_scan(c8_machine* m)
+{
+    /* walk back a checkpoint at a time. each stretch is re-run forward remembering the
+    last op that would have stopped it, the first stretch with one has the answer */
+    uint64_t end = m->s.cycles;
+    const c8_state* from;
+    while (end && (from = c8_history_find(m->history, end - 1)) != NULL)
+    {
+        uint64_t hit = UINT64_MAX;
+        c8_stop hit_why = C8_STOP_NONE;
+        uint16_t hit_addr = 0;
+
+        uint32_t nkeys;
+        const c8_key_event* keys = c8_history_keys(m->history, from->cycles, &nkeys);
+        c8_state_copy(&m->s, from);
+        while (m->s.cycles < end)
+        {
+            const uint64_t at = m->s.cycles;
+            const uint16_t op_pc = m->s.pc;
+            c8_replay_keys(m, &keys, &nkeys);
+            c8_stop why = m->s.key_wait ? C8_STOP_NONE : c8_debug_check(m);
+            if (why != C8_STOP_NONE)
+            {
+                hit = at;
+                hit_why = why;
+                hit_addr = m->stop_addr;
+            }
+
+            uint8_t v0[16];
+            memcpy(v0, m->s.v, sizeof(v0));
+            c8_replay_op(m, &keys, &nkeys);
+            if (m->reg_watch && c8_reg_watch_hit(m, v0))
+            {
+                hit = at;
+                hit_why = C8_STOP_WATCH_REG;
+                hit_addr = op_pc;
+            }
+        }
+
+        if (hit != UINT64_MAX)
+        {
+            c8_replay_to(m, from, hit);
+            m->stop_addr = hit_addr;
+            m->stop_skip = true;
+            return hit_why;
+        }
+        end = from->cycles;
+    }
+
+    from = c8_history_oldest(m->history);
+    if (from)
+        c8_replay_to(m, from, from->cycles);
+    m->stop_skip = true;
+    return C8_STOP_HISTORY_START;
+}
+
+c8_stop c8_reverse_continue(c8_machine* m)
+{
+    if (!m->history)
+        return C8_STOP_HISTORY_START;
+
+    /* the scan re-runs whole stretches, none of that should reach the speaker */
+    c8_audio* audio = m->audio;
+    m->audio = NULL;
+    c8_stop stop = c8_reverse_scan(m);
+    m->audio = audio;
+    c8_sound_sync(m);
+    return stop;
+}
+
+void c8_print_state(const c8_machine* m, FILE* out)
+{
+    const c8_state* s = &m->s;
+    fprintf(out, "pc=0x%03x op=%02x%02x I=0x%03x sp=%u dt=%u st=%u cycle=%llu\n", s->pc, s->mem[s->pc & s->mem_mask],
+        s->mem[(s->pc + 1) & s->mem_mask], s->i, s->sp, s->delay, s->snd, (unsigned long long)s->cycles);
+    for (uint8_t r = 0; r < 16; ++r)
+        fprintf(out, "V%X=%02x%s", r, s->v[r], r == 7 || r == 15 ? "\n" : " ");
+}
+
+const char* c8_stop_name(c8_stop stop)
+{
+    static const char* names[] = { "", "breakpoint", "read watchpoint", "write watchpoint", "fault",
+        "register watch", "start of history" };
+    return stop < sizeof(names) / sizeof(names[0]) ? names[stop] : "?";
+}
+
+void c8_fault_clear(c8_machine* m)
+{
+    m->faulted = false;
+    memset(&m->fault, 0, sizeof(m->fault));
+}
+
+bool c8_get_fault(const c8_machine* m, c8_fault* out)
+{
+    if (!m->faulted)
+        return false;
+    *out = m->fault;
+    return true;
+}
+
+const char* c8_fault_name(c8_fault_reason why)
+{
+    static const char* names[] = { "", "stack overflow", "return with nothing on the stack", "rom too big" };
+    return why < sizeof(names) / sizeof(names[0]) ? names[why] : "?";
+}
+
+void c8_init(c8_machine* m)
+{
+    /* reset all memory incase something was left oevr from previous rom. above 0x200
+    c8_load_rom already has */
+    memset(&m->s.screen, 0, sizeof(m->s.screen));
+    memset(m->s.mem, 0, 512);
+    m->s.planes = 1;
+    if (!m->s.mem_mask)
+        m->s.mem_mask = C8_MEM_SIZE_CLASSIC - 1;
+
+    memcpy(&m->s.mem[C8_FONT_ADDR], c8_font, sizeof(c8_font));
+    memcpy(&m->s.mem[C8_BIG_FONT_ADDR], c8_big_font, sizeof(c8_big_font));
+    c8_state_rehash(&m->s);
+
+    m->s.pc = 512; /* skip first sector - orig had chip8 vm, modern puts fonts in there */
+    m->s.i = 0;
+    m->s.sp = 0;
+    m->s.keys = 0;
+    m->s.key_wait = 0;
+    m->s.timer_div = 0;
+    m->replay_left = 0;
+    m->initd = true;
+    c8_fault_clear(m);
+    m->s.pitch = 64;
+    m->s.pattern_set = 0;
+    c8_sound_sync(m);
+
+    /* nothing before this is worth going back to */
+    if (m->history)
+    {
+        c8_history_reset(m->history);
+        c8_history_save(m->history, &m->s);
+    }
+}
+
+bool c8_waiting(const c8_machine* m)
+{
+    return m->s.key_wait != 0;
+}
+
+bool c8_running(const c8_machine* m)
+{
+    return m->initd && m->rom_loaded;
+}
+
+bool c8_grab_frame(c8_machine* m, c8_display* out)
+{
+    if (!m->gfx_dirty)
+        return false;
+    *out = m->s.screen;
+    m->gfx_dirty = false;
+    return true;
+}
+
+void c8_idle(c8_machine* m, uint32_t ncycles)
+{
+    if (m->s.key_wait)
+        c8_park(m, ncycles);
+}
+
+static uint64_t c8_hash_mix(uint64_t h, uint64_t w)
+{
+    h ^= w * 0x9e3779b97f4a7c15ull;
+    h = (h << 31) | (h >> 33);
+    return h * 0xbf58476d1ce4e5b9ull;
+}
+
+/* four words side by side so the multiplies overlap, a state is a few kb and
+hashing it is most of what deduping costs */
+static void c8_hash_bytes(uint64_t h[4], const uint8_t* p, size_t len)
+{
+    uint64_t w[4];
+    for (; len >= 32; p += 32, len -= 32)
+    {
+        memcpy(w, p, 32);
+        h[0] = c8_hash_mix(h[0], w[0]);
+        h[1] = c8_hash_mix(h[1], w[1]);
+        h[2] = c8_hash_mix(h[2], w[2]);
+        h[3] = c8_hash_mix(h[3], w[3]);
+    }
+    for (; len >= 8; p += 8, len -= 8)
+    {
+        memcpy(w, p, 8);
+        h[0] = c8_hash_mix(h[0], w[0]);
+    }
+    if (len)
+    {
+        w[0] = 0;
+        memcpy(w, p, len);
+        h[1] = c8_hash_mix(h[1], w[0] ^ ((uint64_t)len << 56));
+    }
+}
+
+static uint64_t c8_hash_end(const uint64_t h[4])
+{
+    uint64_t r = c8_hash_mix(c8_hash_mix(h[0], h[1]), c8_hash_mix(h[2], h[3]));
+    r ^= r >> 29;
+    return r;
+}
+
+static uint64_t c8_screen_combine(const uint64_t planes[C8_PLANES], uint8_t hires)
+{
+    uint64_t h = c8_hash_mix(5, hires);
+    for (uint8_t p = 0; p < C8_PLANES; ++p)
+        h = c8_hash_mix(h, planes[p]);
+    return c8_hash_key(h);
+}
+
+uint64_t c8_state_hash(const c8_state* s)
+{
+    /* the registers and the rest of the small stuff every time, it's about a hundred
+    bytes. the running hashes stand in for memory and screen */
+    uint64_t h[4] = { 1, 2, 3, 4 };
+    const uint8_t* p = (const uint8_t*)s;
+    c8_hash_bytes(h, p, offsetof(c8_state, cycles));
+    c8_hash_bytes(h, p + offsetof(c8_state, stack), offsetof(c8_state, screen) - offsetof(c8_state, stack));
+    h[0] = c8_hash_mix(h[0], s->mem_hash);
+    h[1] = c8_hash_mix(h[1], c8_state_screen_hash(s));
+    return c8_hash_end(h);
+}
+
+uint64_t c8_state_screen_hash(const c8_state* s)
+{
+    return c8_screen_combine(s->plane_hash, s->screen.hires);
+}
+
+uint64_t c8_screen_hash(const c8_display* d)
+{
+    uint64_t planes[C8_PLANES];
+    for (uint8_t p = 0; p < C8_PLANES; ++p)
+        planes[p] = c8_rows_hash(d, p, 0, C8_HIRES_HEIGHT);
+    return c8_screen_combine(planes, d->hires);
+}
+
+void c8_state_rehash(c8_state* s)
+{
+    s->mem_hash = 0;
+    for (uint32_t a = 0; a <= s->mem_mask; ++a)
+        s->mem_hash ^= c8_mem_key(a, s->mem[a]);
+    for (uint8_t p = 0; p < C8_PLANES; ++p)
+        s->plane_hash[p] = c8_rows_hash(&s->screen, p, 0, C8_HIRES_HEIGHT);
 }
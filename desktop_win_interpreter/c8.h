@@ -6,10 +6,16 @@
 #include <stdbool.h>
 #include <time.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <SDL.h>
+#include "c8_trace.h"
 
 #define C8_WIDTH (64)
 #define C8_HEIGHT (32)
+/* super-chip hi-res */
+#define C8_HIRES_WIDTH          (128)
+#define C8_HIRES_HEIGHT         (64)
+#define C8_ROW_WORDS            (C8_HIRES_WIDTH / 64)
 
 //#define TEST_ROM_FILE ("../roms/maze.ch8")
 
@@ -18,9 +24,239 @@
 #define C8_CYCLES_PER_FRAME     (15)
 #define C8_FRAME_DELAY_MS       (16)
 
-bool c8_load_rom(const char* filename);
-void c8_cycle(void);
-void c8_init(void);
-void c8_draw_frame(SDL_Renderer* renderer);
-bool c8_running(void);
-bool c8_gfx_dirty(void);
+/* why c8_run came back early */
+typedef enum
+{
+    C8_STOP_NONE = 0,
+    C8_STOP_BREAK,          /* pc hit a breakpoint */
+    C8_STOP_WATCH_READ,     /* op is about to read a watched address */
+    C8_STOP_WATCH_WRITE,    /* op is about to write a watched address */
+    C8_STOP_FAULT,          /* bad op, pc is left on it. see c8_get_fault */
+    C8_STOP_WATCH_REG,      /* op just changed a watched register (reversing: is about to) */
+    C8_STOP_HISTORY_START,  /* reversed back to the oldest checkpoint */
+} c8_stop;
+
+/* why a machine faulted. a faulted machine is halted, c8_run keeps coming back with
+C8_STOP_FAULT until it's reloaded, reset or a debugger changes it */
+typedef enum
+{
+    C8_FAULT_NONE = 0,
+    C8_FAULT_STACK_OVERFLOW,    /* 2NNN with the stack full */
+    C8_FAULT_STACK_UNDERFLOW,   /* 00EE with nothing on it */
+    C8_FAULT_ROM_TOO_BIG,       /* c8_load_rom, nothing got loaded */
+} c8_fault_reason;
+
+typedef struct
+{
+    c8_fault_reason reason;
+    uint16_t pc;            /* the op that faulted, 0x200 for a rom that didnt load */
+    uint16_t op;
+    uint64_t cycle;         /* the cycle it ran on */
+} c8_fault;
+
+#define C8_BREAK                (0x01)
+#define C8_WATCH_READ           (0x02)
+#define C8_WATCH_WRITE          (0x04)
+
+#define C8_MEM_SIZE             (0x10000) /* xo-chip. everything else lives in the first 4k */
+#define C8_MEM_SIZE_CLASSIC     (0x1000)
+#define C8_FONT_ADDR            (0x000) /* 5 byte digits, FX29 */
+#define C8_BIG_FONT_ADDR        (0x050) /* 10 byte digits, FX30 */
+#define C8_PLANES               (2) /* xo-chip bitplanes */
+
+/* the screen as packed rows, bit 63 of the first word is the left most pixel. lo-res
+only uses the top left 64x32 so a lo-res row is one word. scrolls are word shifts and
+a sprite row is one or two xors. plane 0 is the only one plain chip-8 draws on */
+typedef struct
+{
+    uint64_t rows[C8_PLANES][C8_HIRES_HEIGHT][C8_ROW_WORDS];
+    uint8_t hires;
+} c8_display;
+
+/* everything that makes up the running machine. plain data so a checkpoint is just a
+copy of it - c8_state_copy, which stops at the end of the memory the rom can reach.
+what every op touches is up front so it shares a cache line or two, the screen and
+memory come last */
+typedef struct
+{
+    uint8_t v[16]; /* V0 - VF. VF is the flag register */
+    uint16_t i; /* index reg */
+    uint16_t pc;
+    uint16_t sp;
+    uint8_t delay;
+    uint8_t snd;
+    uint16_t keys; /* bit per keypad key held down */
+    uint8_t key_wait; /* 0x10 | x while FX0A has the machine parked */
+    uint8_t timer_div; /* ops since DT/ST last ticked */
+    /* C8_MEM_SIZE_CLASSIC - 1 for chip-8 and super-chip roms, C8_MEM_SIZE - 1 for xo-chip.
+    addresses wrap at it */
+    uint16_t mem_mask;
+    uint8_t planes; /* xo-chip FN01, which planes draws, clears and scrolls hit */
+    /* CXNN comes from here rather than rand() so re-running from a checkpoint does
+    the same thing */
+    uint32_t rng;
+    /* total cycles run. never reset so a trace stays cycle ordered across rom drops */
+    uint64_t cycles;
+    /* hashes of the memory the rom can reach and of each screen plane. every write
+    xors out what was there and xors in what is, so c8_state_hash never goes over
+    them. anything changing mem or screen by hand calls c8_state_rehash after */
+    uint64_t mem_hash;
+    uint64_t plane_hash[C8_PLANES];
+    /* TODO: check this depth is accurate */
+    uint16_t stack[16];
+    /* super-chip FX75 / FX85 flag registers */
+    uint8_t rpl[16];
+    /* xo-chip audio. the pattern only replaces the plain beep once a rom loads one */
+    uint8_t pattern[16];
+    uint8_t pitch;
+    uint8_t pattern_set;
+    c8_display screen;
+    /* keep last, see c8_state_size */
+    uint8_t mem[C8_MEM_SIZE];
+} c8_state;
+
+/* bytes of a state that mean anything. a classic rom cant reach past 4k so the
+other 60k never needs copying around */
+static inline size_t c8_state_size(const c8_state* s)
+{
+    return offsetof(c8_state, mem) + (size_t)s->mem_mask + 1;
+}
+
+static inline void c8_state_copy(c8_state* dst, const c8_state* src)
+{
+    memcpy(dst, src, c8_state_size(src));
+}
+
+typedef struct c8_history c8_history;
+typedef struct c8_keyq c8_keyq;
+typedef struct c8_key_event c8_key_event;
+typedef struct c8_audio c8_audio;
+
+/* one interpreter. nothing in the core is global so any number of these can run.
+laid out hot to cold - the bookkeeping c8_run looks at every op, then the state with
+its registers and screen ahead of its memory, then the debug flags nothing reads
+unless something is armed. a 4k rom only ever touches the first few pages */
+typedef struct
+{
+    bool initd;
+    bool rom_loaded;
+    bool gfx_dirty;
+    uint16_t rom_size;
+
+    /* record for the op being executed when tracing, NULL otherwise */
+    c8_trace_rec* trace_rec;
+    /* first cycle not yet traced. ops re-run after reversing arent traced twice */
+    uint64_t trace_next;
+
+    /* breakpoints and watchpoints armed, the flags themselves are at the end. none of
+    this is looked at unless something is - c8_run keeps the plain loop otherwise */
+    uint32_t debug_armed;
+    uint16_t reg_watch; /* bit per V register */
+    uint16_t stop_addr;
+    /* resuming after a stop steps over the op we stopped on */
+    bool stop_skip;
+    /* set while a debugger is attached */
+    bool debug_attached;
+    /* halted on a fault, the details are in fault */
+    bool faulted;
+    c8_fault fault;
+
+    /* key events from the host, drained between ops. NULL for no keypad */
+    c8_keyq* keyq;
+    /* sound timer edges go here if set */
+    c8_audio* audio;
+
+    /* checkpoints for reverse execution, NULL unless enabled */
+    c8_history* history;
+    /* keys from history still to come while running forward after a reverse */
+    const c8_key_event* replay_keys;
+    uint32_t replay_left;
+
+    c8_state s;
+
+    /* C8_BREAK / C8_WATCH_* bits per address */
+    uint8_t debug_flags[C8_MEM_SIZE];
+} c8_machine;
+
+typedef struct
+{
+    uint8_t v[16];
+    uint16_t i;
+    uint16_t pc;
+    uint16_t sp;
+    uint8_t delay;
+    uint8_t snd;
+} c8_regs;
+
+bool c8_load_rom(c8_machine* m, const char* filename);
+/* the same from memory. xo gives it the xo-chip 64k even if it would fit in 4k, like a
+.xo8 name does */
+bool c8_load_rom_mem(c8_machine* m, const uint8_t* data, size_t size, bool xo);
+void c8_seed(c8_machine* m, uint32_t seed);
+/* host pushes keypad events into q (see c8_input.h) */
+void c8_set_keyq(c8_machine* m, c8_keyq* q);
+void c8_set_audio(c8_machine* m, c8_audio* a);
+/* the whole keypad at once, bit per key held, for hosts that drive the machine
+themselves instead of through a keyq. keys going down finish an FX0A. not recorded
+in reverse history */
+void c8_set_keys(c8_machine* m, uint16_t keys);
+void c8_cycle(c8_machine* m);
+/* run up to ncycles. stops before an op that hits a breakpoint or watchpoint, running
+again steps over it. a bad op stops it too, with C8_STOP_FAULT and pc on the op, and
+the machine stays halted there */
+c8_stop c8_run(c8_machine* m, int ncycles);
+void c8_break_set(c8_machine* m, uint16_t addr);
+void c8_break_clear(c8_machine* m, uint16_t addr);
+void c8_watch_set(c8_machine* m, uint16_t addr, uint8_t kinds);
+void c8_watch_clear(c8_machine* m, uint16_t addr, uint8_t kinds);
+/* stop once an op changes V[reg] */
+void c8_watch_reg(c8_machine* m, uint8_t reg, bool watch);
+void c8_debug_clear_all(c8_machine* m);
+/* breakpoint pc or watched address behind the last stop. for register watches the pc
+of the op that changed it */
+uint16_t c8_stop_addr(const c8_machine* m);
+void c8_print_state(const c8_machine* m, FILE* out);
+const char* c8_stop_name(c8_stop stop);
+/* true and the fault if the machine is halted on one */
+bool c8_get_fault(const c8_machine* m, c8_fault* out);
+/* lets a halted machine run again as it is. c8_init, loading a rom and the debugger
+writing registers or memory do it too */
+void c8_fault_clear(c8_machine* m);
+const char* c8_fault_name(c8_fault_reason why);
+/* debugger hooks */
+void c8_debug_attach(c8_machine* m, bool attach);
+void c8_get_regs(const c8_machine* m, c8_regs* r);
+void c8_set_regs(c8_machine* m, const c8_regs* r);
+/* C8_MEM_SIZE bytes, only mem_mask + 1 of them reachable */
+const uint8_t* c8_memory(const c8_machine* m);
+bool c8_write_memory(c8_machine* m, uint16_t addr, const uint8_t* data, uint16_t len);
+
+/* reverse execution. checkpoints are taken as the machine runs and going backwards
+re-runs forward from the nearest one, so it only works back to when it was enabled */
+bool c8_reverse_enable(c8_machine* m, bool enable);
+/* back one op */
+c8_stop c8_reverse_step(c8_machine* m);
+/* back to the last op that would have stopped a forward run: breakpoints, watchpoints
+and watched registers. C8_STOP_HISTORY_START if nothing did */
+c8_stop c8_reverse_continue(c8_machine* m);
+
+void c8_init(c8_machine* m);
+bool c8_running(const c8_machine* m);
+/* parked on FX0A. nothing happens until a key comes in so the host can sleep, then
+c8_idle the cycles it slept through to keep the timers right */
+bool c8_waiting(const c8_machine* m);
+/* time passing while parked. unlike c8_run keys still queued stay queued, so a key
+that woke the host lands after the idle time instead of before it */
+void c8_idle(c8_machine* m, uint32_t ncycles);
+/* copies out the screen if it changed since the last grab */
+bool c8_grab_frame(c8_machine* m, c8_display* out);
+
+/* hash of everything that decides what the machine does next, which is all of the
+state but the cycle count. for telling states apart, not for anything secure.
+memory and screen come from the running hashes so it costs the same at any point */
+uint64_t c8_state_hash(const c8_state* s);
+/* the screen on its own, the same for a state's screen as for a copy of it */
+uint64_t c8_state_screen_hash(const c8_state* s);
+uint64_t c8_screen_hash(const c8_display* d);
+/* running hashes from scratch, after poking mem or screen directly */
+void c8_state_rehash(c8_state* s);
@@ -0,0 +1,162 @@
+#include "c8_audio.h"
+#include <math.h>
+
+#define C8_AUDIO_FREQ           (48000)
+#define C8_AUDIO_SAMPLES        (512)
+#define C8_BEEP_HZ              (440)
+#define C8_BEEP_VOLUME          (0x0c00)
+#define C8_PATTERN_BIT_SHIFT    (25) /* 128 bits in 32 bits of phase */
+
+/* the block the producer published next becomes current, the old one goes back */
+static void c8_audio_next_pattern(c8_audio* a)
+{
+    if (a->pattern_held)
+        c8_ring_release(&a->pattern_ring, 1);
+    /* published before its event, so its there. this is just for the barrier */
+    c8_ring_avail(&a->pattern_ring);
+    a->pattern = a->patterns[c8_ring_tail_slot(&a->pattern_ring, C8_AUDIO_PATTERNS)];
+    a->pattern_held = true;
+}
+
+/* box filter over the pattern bits this sample covers. the top pitches play bits
+faster than the output rate so point sampling would alias badly */
+static int16_t c8_audio_pattern_sample(c8_audio* a)
+{
+    const uint32_t step = a->pitch_step[a->pitch];
+    uint32_t pos = a->pattern_phase;
+    uint32_t left = step;
+    int64_t acc = 0;
+    while (left)
+    {
+        const uint32_t bit = pos >> C8_PATTERN_BIT_SHIFT;
+        const uint32_t to_next = (1u << C8_PATTERN_BIT_SHIFT) - (pos & ((1u << C8_PATTERN_BIT_SHIFT) - 1));
+        const uint32_t run = left < to_next ? left : to_next;
+        acc += ((a->pattern[bit >> 3] >> (7 - (bit & 7))) & 1) ? (int64_t)run : -(int64_t)run;
+        pos += run;
+        left -= run;
+    }
+    a->pattern_phase = pos;
+    return (int16_t)(acc * C8_BEEP_VOLUME / step);
+}
+
+static void SDLCALL c8_audio_callback(void* user, Uint8* stream, int len)
+{
+    c8_audio* a = (c8_audio*)user;
+    int16_t* out = (int16_t*)stream;
+    const int nsamples = len / (int)sizeof(int16_t);
+
+    const uint32_t avail = c8_ring_avail(&a->ring);
+    uint32_t used = 0;
+    if (avail)
+    {
+        /* the last entry is as far as the machine has got. if playback has wandered more
+        than the lag away from where it should be (reverse step, machine stalled behind a
+        debugger, clock drift) jump straight there */
+        a->newest = a->events[(a->ring.tail + avail - 1) & (C8_AUDIO_RING_SIZE - 1)].cycle;
+        const uint64_t target = a->newest > a->lag ? a->newest - a->lag : 0;
+        if (a->play + a->lag < target || a->play > target + a->lag)
+        {
+            a->play = target;
+            a->play_sub = 0;
+        }
+    }
+
+    for (int s = 0; s < nsamples; ++s)
+    {
+        while (used < avail)
+        {
+            const c8_audio_event* e = &a->events[(a->ring.tail + used) & (C8_AUDIO_RING_SIZE - 1)];
+            /* anything past the newest is left over from before a jump back, let it through */
+            if (e->cycle > a->play && e->cycle <= a->newest)
+                break;
+            switch (e->what)
+            {
+            case C8_AUDIO_OFF:
+            case C8_AUDIO_ON:
+                a->level = e->what == C8_AUDIO_ON;
+                break;
+            case C8_AUDIO_PITCH:
+                a->pitch = e->arg;
+                break;
+            case C8_AUDIO_PATTERN:
+                c8_audio_next_pattern(a);
+                break;
+            }
+            ++used;
+        }
+
+        /* caught up with the machine (paused, parked) - hold still and keep quiet */
+        if (a->play >= a->newest)
+        {
+            out[s] = 0;
+            continue;
+        }
+
+        if (!a->level)
+            out[s] = 0;
+        else if (a->pattern)
+            out[s] = c8_audio_pattern_sample(a);
+        else
+            out[s] = (a->phase & 0x80000000u) ? C8_BEEP_VOLUME : -C8_BEEP_VOLUME;
+        a->phase += a->phase_step;
+
+        /* C8_CYCLES_PER_SEC cycles every freq samples, exactly */
+        a->play_sub += C8_CYCLES_PER_SEC;
+        if (a->play_sub >= (uint32_t)a->freq)
+        {
+            a->play_sub -= a->freq;
+            ++a->play;
+        }
+    }
+
+    c8_ring_release(&a->ring, used);
+}
+
+bool c8_audio_open(c8_audio* a)
+{
+    memset(a, 0, sizeof(*a));
+
+    if (!SDL_WasInit(SDL_INIT_AUDIO) && SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+    {
+        fprintf(stderr, "c8_audio_open: %s\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_AudioSpec want, have;
+    SDL_zero(want);
+    want.freq = C8_AUDIO_FREQ;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = C8_AUDIO_SAMPLES;
+    want.callback = c8_audio_callback;
+    want.userdata = a;
+    a->dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (!a->dev)
+    {
+        fprintf(stderr, "c8_audio_open: %s\n", SDL_GetError());
+        return false;
+    }
+
+    a->freq = have.freq;
+    a->phase_step = (uint32_t)(((uint64_t)C8_BEEP_HZ << 32) / (uint64_t)have.freq);
+    /* xo-chip plays pattern bits at 4000 * 2^((pitch - 64) / 48) hz */
+    for (int p = 0; p < 256; ++p)
+    {
+        const double bits_per_sec = 4000.0 * pow(2.0, (p - 64) / 48.0);
+        a->pitch_step[p] = (uint32_t)(bits_per_sec * (1u << C8_PATTERN_BIT_SHIFT) / have.freq);
+    }
+    a->pitch = 64;
+    /* one device buffer plus a couple of frames, so the clock entry for a slice is
+    always in before its samples are due */
+    a->lag = (uint64_t)have.samples * C8_CYCLES_PER_SEC / have.freq + 2 * C8_CYCLES_PER_FRAME + 1;
+
+    SDL_PauseAudioDevice(a->dev, 0);
+    return true;
+}
+
+void c8_audio_close(c8_audio* a)
+{
+    if (a->dev)
+        SDL_CloseAudioDevice(a->dev);
+    a->dev = 0;
+}
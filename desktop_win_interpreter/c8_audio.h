@@ -0,0 +1,85 @@
+#pragma once
+#include "c8.h"
+#include "c8_ring.h"
+#include <SDL_audio.h>
+
+/* beeper. the machine posts sound timer edges stamped with the cycle they happened on,
+the host posts a clock entry after every slice it runs. the sdl audio callback plays
+them back a fixed lag behind the newest clock so edges land on the exact sample their
+cycle maps to. neither side ever waits on the other - a full ring drops the entry.
+
+xo-chip patterns go through a second small ring of 16 byte blocks. the audio thread
+plays a block straight out of its slot and only hands it back once the next one takes
+over, so an upload is never copied again or locked */
+
+#define C8_AUDIO_RING_SIZE      (256)
+#define C8_AUDIO_PATTERNS       (8)
+#define C8_AUDIO_PATTERN_BYTES  (16)
+#define C8_CYCLES_PER_SEC       (60 * C8_CYCLES_PER_FRAME)
+
+enum
+{
+    C8_AUDIO_OFF,
+    C8_AUDIO_ON,
+    C8_AUDIO_CLOCK, /* machine got this far, nothing changed */
+    C8_AUDIO_PITCH, /* arg is the xo-chip pitch register */
+    C8_AUDIO_PATTERN, /* next block in the pattern ring takes over */
+};
+
+typedef struct
+{
+    uint64_t cycle;
+    uint8_t what;
+    uint8_t arg;
+} c8_audio_event;
+
+struct c8_audio
+{
+    c8_ring ring;
+    c8_audio_event events[C8_AUDIO_RING_SIZE];
+    c8_ring pattern_ring;
+    uint8_t patterns[C8_AUDIO_PATTERNS][C8_AUDIO_PATTERN_BYTES];
+
+    /* everything below belongs to the audio thread once the device is open */
+    SDL_AudioDeviceID dev;
+    int freq;
+    uint64_t lag; /* cycles played behind the newest clock */
+    uint64_t newest; /* cycle of the last entry seen */
+    uint64_t play; /* cycle the next sample is in */
+    uint32_t play_sub; /* how far into it, in 1/freq of a cycle */
+    bool level;
+    uint32_t phase;
+    uint32_t phase_step;
+    const uint8_t* pattern; /* NULL plays the plain beep */
+    bool pattern_held; /* the ring slot pattern points into hasnt been released */
+    uint32_t pattern_phase; /* top 7 bits are the bit being played */
+    uint8_t pitch;
+    uint32_t pitch_step[256]; /* pattern_phase per sample for each pitch */
+};
+
+/* opens the default output device and starts it. false if there isnt one, the machine
+runs fine without */
+bool c8_audio_open(c8_audio* a);
+void c8_audio_close(c8_audio* a);
+
+/* machine side */
+static inline void c8_audio_post(c8_audio* a, uint64_t cycle, uint8_t what, uint8_t arg)
+{
+    if (!c8_ring_free(&a->ring, C8_AUDIO_RING_SIZE))
+        return;
+    c8_audio_event* e = &a->events[c8_ring_head_slot(&a->ring, C8_AUDIO_RING_SIZE)];
+    e->cycle = cycle;
+    e->what = what;
+    e->arg = arg;
+    c8_ring_publish(&a->ring, 1);
+}
+
+/* machine side. both rings need room or neither gets anything */
+static inline void c8_audio_pattern(c8_audio* a, uint64_t cycle, const uint8_t* pattern)
+{
+    if (!c8_ring_free(&a->pattern_ring, C8_AUDIO_PATTERNS) || !c8_ring_free(&a->ring, C8_AUDIO_RING_SIZE))
+        return;
+    memcpy(a->patterns[c8_ring_head_slot(&a->pattern_ring, C8_AUDIO_PATTERNS)], pattern, C8_AUDIO_PATTERN_BYTES);
+    c8_ring_publish(&a->pattern_ring, 1);
+    c8_audio_post(a, cycle, C8_AUDIO_PATTERN, 0);
+}
@@ -0,0 +1,141 @@
+#include "c8_blit.h"
+#include <SDL_cpuinfo.h>
+
+/* shift counts for the two words of a row mask. mask word w = (bits >> right[w]) |
+(bits << left[w]), a count of 64 gives 0 - which is what the simd shifts do with it */
+static void c8_blit_counts(uint8_t x, bool hires, uint32_t right[2], uint32_t left[2])
+{
+    if (!hires)
+    {
+        /* lo-res rotates inside the first word */
+        x &= C8_WIDTH - 1;
+        right[0] = x;
+        left[0] = 64 - x;
+        right[1] = 64;
+        left[1] = 64;
+        return;
+    }
+
+    /* hi-res spills into the second word, or starts in it past x = 64 */
+    x &= C8_HIRES_WIDTH - 1;
+    const uint32_t r = x & 63;
+    if (x < 64)
+    {
+        right[0] = r;
+        left[0] = 64;
+        right[1] = 64;
+        left[1] = 64 - r;
+    }
+    else
+    {
+        right[0] = 64;
+        left[0] = 64 - r;
+        right[1] = r;
+        left[1] = 64;
+    }
+}
+
+static uint64_t c8_blit_shift(uint64_t bits, uint32_t right, uint32_t left)
+{
+    return (right < 64 ? bits >> right : 0) | (left < 64 ? bits << left : 0);
+}
+
+bool c8_blit_scalar(uint64_t (*rows)[C8_ROW_WORDS], const uint64_t* bits, uint8_t nrows, uint8_t x, bool hires)
+{
+    uint32_t right[2], left[2];
+    c8_blit_counts(x, hires, right, left);
+
+    uint64_t hit = 0;
+    for (uint8_t l = 0; l < nrows; ++l)
+    {
+        const uint64_t m0 = c8_blit_shift(bits[l], right[0], left[0]);
+        const uint64_t m1 = c8_blit_shift(bits[l], right[1], left[1]);
+        hit |= (rows[l][0] & m0) | (rows[l][1] & m1);
+        rows[l][0] ^= m0;
+        rows[l][1] ^= m1;
+    }
+    return hit != 0;
+}
+
+#if C8_X86
+
+bool c8_blit_sse2(uint64_t (*rows)[C8_ROW_WORDS], const uint64_t* bits, uint8_t nrows, uint8_t x, bool hires)
+{
+    uint32_t right[2], left[2];
+    c8_blit_counts(x, hires, right, left);
+
+    /* sse2 only shifts both words by the same count, so shift by each words count
+    and take that word from each result */
+    const __m128i r0 = _mm_cvtsi32_si128((int)right[0]);
+    const __m128i r1 = _mm_cvtsi32_si128((int)right[1]);
+    const __m128i l0 = _mm_cvtsi32_si128((int)left[0]);
+    const __m128i l1 = _mm_cvtsi32_si128((int)left[1]);
+
+    __m128i hit = _mm_setzero_si128();
+    for (uint8_t l = 0; l < nrows; ++l)
+    {
+        const __m128i b = _mm_set1_epi64x((long long)bits[l]);
+        const __m128i lo = _mm_or_si128(_mm_srl_epi64(b, r0), _mm_sll_epi64(b, l0));
+        const __m128i hi = _mm_or_si128(_mm_srl_epi64(b, r1), _mm_sll_epi64(b, l1));
+        const __m128i mask = _mm_unpacklo_epi64(lo, hi);
+
+        __m128i* row = (__m128i*)rows[l];
+        const __m128i cur = _mm_loadu_si128(row);
+        hit = _mm_or_si128(hit, _mm_and_si128(cur, mask));
+        _mm_storeu_si128(row, _mm_xor_si128(cur, mask));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128())) != 0xffff;
+}
+
+C8_TARGET_AVX2
+bool c8_blit_avx2(uint64_t (*rows)[C8_ROW_WORDS], const uint64_t* bits, uint8_t nrows, uint8_t x, bool hires)
+{
+    uint32_t right[2], left[2];
+    c8_blit_counts(x, hires, right, left);
+
+    /* two rows a register, variable shifts give each word its own count */
+    const __m256i rc = _mm256_setr_epi64x(right[0], right[1], right[0], right[1]);
+    const __m256i lc = _mm256_setr_epi64x(left[0], left[1], left[0], left[1]);
+
+    __m256i hit = _mm256_setzero_si256();
+    uint8_t l = 0;
+    for (; l + 2 <= nrows; l += 2)
+    {
+        /* {b0, b0, b1, b1} */
+        const __m256i pair = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)&bits[l]));
+        const __m256i b = _mm256_permute4x64_epi64(pair, 0x50);
+        const __m256i mask = _mm256_or_si256(_mm256_srlv_epi64(b, rc), _mm256_sllv_epi64(b, lc));
+
+        __m256i* row = (__m256i*)rows[l];
+        const __m256i cur = _mm256_loadu_si256(row);
+        hit = _mm256_or_si256(hit, _mm256_and_si256(cur, mask));
+        _mm256_storeu_si256(row, _mm256_xor_si256(cur, mask));
+    }
+    if (l < nrows)
+    {
+        /* odd one out, half a register */
+        const __m128i b = _mm_set1_epi64x((long long)bits[l]);
+        const __m128i mask = _mm_or_si128(_mm_srlv_epi64(b, _mm256_castsi256_si128(rc)),
+            _mm_sllv_epi64(b, _mm256_castsi256_si128(lc)));
+
+        __m128i* row = (__m128i*)rows[l];
+        const __m128i cur = _mm_loadu_si128(row);
+        hit = _mm256_or_si256(hit, _mm256_castsi128_si256(_mm_and_si128(cur, mask)));
+        _mm_storeu_si128(row, _mm_xor_si128(cur, mask));
+    }
+    return !_mm256_testz_si256(hit, hit);
+}
+
+#endif
+
+c8_blit_fn c8_blit_best(void)
+{
+#if C8_X86
+    static c8_blit_fn best = NULL;
+    if (!best)
+        best = SDL_HasAVX2() ? c8_blit_avx2 : c8_blit_sse2;
+    return best;
+#else
+    return c8_blit_scalar;
+#endif
+}
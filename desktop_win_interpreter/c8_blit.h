@@ -0,0 +1,26 @@
+#pragma once
+#include "c8.h"
+#include "c8_simd.h"
+
+/* sprite rows into the packed screen. each sprite row gets rotated right by x into a
+full 128 bit row mask (lo-res leaves the second word 0), and/ored for collision and
+xored in. the sse2 and avx2 versions do one and two whole rows an instruction with
+the per word shift counts in a register, the scalar one is the fallback for anything
+else and the reference the others are checked against */
+
+/* most a single call takes. DXY0 is 16 rows a plane */
+#define C8_BLIT_MAX_ROWS        (16)
+
+/* xor nrows sprite rows (bits left aligned, one word each) into consecutive screen
+rows starting at rows[0], wrapping at the right edge. true if any pixel went off */
+typedef bool (*c8_blit_fn)(uint64_t (*rows)[C8_ROW_WORDS], const uint64_t* bits, uint8_t nrows, uint8_t x, bool hires);
+
+bool c8_blit_scalar(uint64_t (*rows)[C8_ROW_WORDS], const uint64_t* bits, uint8_t nrows, uint8_t x, bool hires);
+#if C8_X86
+bool c8_blit_sse2(uint64_t (*rows)[C8_ROW_WORDS], const uint64_t* bits, uint8_t nrows, uint8_t x, bool hires);
+/* only call if SDL_HasAVX2 */
+bool c8_blit_avx2(uint64_t (*rows)[C8_ROW_WORDS], const uint64_t* bits, uint8_t nrows, uint8_t x, bool hires);
+#endif
+
+/* fastest one this cpu has. checked once */
+c8_blit_fn c8_blit_best(void);
@@ -0,0 +1,410 @@
+#include "c8_disasm.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define C8_CODEMAP_MAGIC        ("C8CM")
+#define C8_CODEMAP_VERSION      (2)
+
+uint64_t c8_disasm_hash(const uint8_t* rom, size_t size)
+{
+    /* fnv-1a, plenty for telling roms apart */
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t b = 0; b < size; ++b)
+    {
+        h ^= rom[b];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static bool c8_disasm_in_rom(const c8_codemap* map, uint32_t addr)
+{
+    /* need both bytes of the op */
+    return addr >= map->start && addr + 1 < map->end;
+}
+
+/* queue an op for decoding if its in the rom and we havent been there yet */
+static void c8_disasm_push(c8_codemap* map, uint16_t* work, uint32_t* nwork, uint32_t addr)
+{
+    if (c8_disasm_in_rom(map, addr) && !(map->flags[addr] & C8_DIS_CODE))
+    {
+        map->flags[addr] |= C8_DIS_CODE;
+        work[(*nwork)++] = (uint16_t)addr;
+    }
+}
+
+/* where a skip at a lands when it skips. like c8_skip, F000 NNNN is skipped whole */
+static uint32_t c8_disasm_skip_to(const uint8_t* rom, const c8_codemap* map, uint16_t a)
+{
+    const bool long_op = c8_disasm_in_rom(map, a + 2u) && rom[a + 2 - C8_DIS_ORIGIN] == 0xf0
+        && rom[a + 3 - C8_DIS_ORIGIN] == 0x00;
+    return a + (long_op ? 6u : 4u);
+}
+
+static void c8_disasm_push_skip(const uint8_t* rom, c8_codemap* map, uint16_t* work, uint32_t* nwork, uint16_t a)
+{
+    const uint32_t to = c8_disasm_skip_to(rom, map, a);
+    c8_disasm_push(map, work, nwork, a + 2);
+    c8_disasm_push(map, work, nwork, to);
+    if (to < map->end)
+        map->flags[to] |= C8_DIS_LABEL_JUMP;
+}
+
+void c8_codemap_free(c8_codemap* map)
+{
+    free(map->flags);
+    map->flags = NULL;
+}
+
+bool c8_disasm_analyze(const uint8_t* rom, size_t size, c8_codemap* map)
+{
+    memset(map, 0, sizeof(*map));
+    if (size > C8_DIS_MEM_SIZE - C8_DIS_ORIGIN)
+        size = C8_DIS_MEM_SIZE - C8_DIS_ORIGIN;
+    map->hash = c8_disasm_hash(rom, size);
+    map->start = C8_DIS_ORIGIN;
+    map->end = (uint32_t)(C8_DIS_ORIGIN + size);
+
+    /* every address is pushed at most once (it gets marked before pushing) so a slot
+    per rom byte is enough */
+    map->flags = calloc(map->end, 1);
+    uint16_t* work = malloc((size ? size : 1) * sizeof(*work));
+    if (!map->flags || !work)
+    {
+        free(work);
+        c8_codemap_free(map);
+        return false;
+    }
+    uint32_t nwork = 0;
+
+    c8_disasm_push(map, work, &nwork, C8_DIS_ORIGIN);
+    if (C8_DIS_ORIGIN < map->end)
+        map->flags[C8_DIS_ORIGIN] |= C8_DIS_LABEL_JUMP;
+
+    while (nwork)
+    {
+        const uint16_t a = work[--nwork];
+        const uint8_t* p = &rom[a - C8_DIS_ORIGIN];
+        const uint16_t op = (uint16_t)((p[0] << 8) | p[1]);
+        const uint16_t nnn = op & 0x0fff;
+        const uint8_t lobyte = op & 0x00ff;
+
+        map->flags[a + 1] |= C8_DIS_CODE_LO;
+
+        switch (op >> 12)
+        {
+        case 0x0:
+            /* 00EE returns, 00FD exits, everything else (CLS, SYS, scrolls) carries on */
+            if (op != 0x00ee && op != 0x00fd)
+                c8_disasm_push(map, work, &nwork, a + 2);
+            break;
+        case 0x1:
+            if (nnn < map->end)
+                map->flags[nnn] |= C8_DIS_LABEL_JUMP;
+            c8_disasm_push(map, work, &nwork, nnn);
+            break;
+        case 0x2:
+            if (nnn < map->end)
+                map->flags[nnn] |= C8_DIS_LABEL_CALL;
+            c8_disasm_push(map, work, &nwork, nnn);
+            c8_disasm_push(map, work, &nwork, a + 2);
+            break;
+        case 0x3:
+        case 0x4:
+        case 0x9:
+            /* skips - both the next op and the one after it are reachable */
+            c8_disasm_push_skip(rom, map, work, &nwork, a);
+            break;
+        case 0x5:
+            /* only 5XY0 skips, 5XY2 / 5XY3 and the rest carry on */
+            if ((op & 0xf) == 0)
+                c8_disasm_push_skip(rom, map, work, &nwork, a);
+            else
+                c8_disasm_push(map, work, &nwork, a + 2);
+            break;
+        case 0xa:
+            if (nnn < map->end)
+                map->flags[nnn] |= C8_DIS_LABEL_DATA;
+            c8_disasm_push(map, work, &nwork, a + 2);
+            break;
+        case 0xb:
+            /* jump table - cant know V0 statically, flag it and stop */
+            map->flags[a] |= C8_DIS_INDIRECT;
+            if (nnn < map->end)
+                map->flags[nnn] |= C8_DIS_LABEL_JUMP;
+            break;
+        case 0xe:
+            if (lobyte == 0x9e || lobyte == 0xa1)
+            {
+                c8_disasm_push_skip(rom, map, work, &nwork, a);
+            }
+            else
+            {
+                c8_disasm_push(map, work, &nwork, a + 2);
+            }
+            break;
+        case 0xf:
+            /* F000 NNNN carries its operand in the next word */
+            c8_disasm_push(map, work, &nwork, op == 0xf000 ? a + 4 : a + 2);
+            break;
+        default:
+            c8_disasm_push(map, work, &nwork, a + 2);
+            break;
+        }
+    }
+    free(work);
+    return true;
+}
+
+static void c8_disasm_label(const c8_codemap* map, uint16_t addr, char* buf, size_t len)
+{
+    uint8_t f = map && addr < map->end ? map->flags[addr] : 0;
+    if (map && addr == map->start)
+        snprintf(buf, len, "start");
+    else if (f & C8_DIS_LABEL_CALL)
+        snprintf(buf, len, "sub_%03x", addr);
+    else if ((f & C8_DIS_LABEL_JUMP) && (f & C8_DIS_CODE))
+        snprintf(buf, len, "L%03x", addr);
+    else if ((f & C8_DIS_LABEL_DATA) && !(f & C8_DIS_CODE))
+        snprintf(buf, len, "data_%03x", addr);
+    else
+        snprintf(buf, len, "0x%03x", addr);
+}
+
+void c8_disasm_op(uint16_t op, const c8_codemap* map, char* buf, size_t len)
+{
+    const uint8_t x = (op & 0x0f00) >> 8;
+    const uint8_t y = (op & 0x00f0) >> 4;
+    const uint8_t n = op & 0x000f;
+    const uint8_t nn = op & 0x00ff;
+    const uint16_t nnn = op & 0x0fff;
+    char target[16];
+    c8_disasm_label(map, nnn, target, sizeof(target));
+
+    switch (op >> 12)
+    {
+    case 0x0:
+        if (op == 0x00e0)
+            snprintf(buf, len, "CLS");
+        else if (op == 0x00ee)
+            snprintf(buf, len, "RET");
+        else if ((op & 0xfff0) == 0x00c0)
+            snprintf(buf, len, "SCD %u", n);
+        else if ((op & 0xfff0) == 0x00d0)
+            snprintf(buf, len, "SCU %u", n);
+        else if (op == 0x00fb)
+            snprintf(buf, len, "SCR");
+        else if (op == 0x00fc)
+            snprintf(buf, len, "SCL");
+        else if (op == 0x00fd)
+            snprintf(buf, len, "EXIT");
+        else if (op == 0x00fe)
+            snprintf(buf, len, "LOW");
+        else if (op == 0x00ff)
+            snprintf(buf, len, "HIGH");
+        else
+            snprintf(buf, len, "SYS %s", target);
+        return;
+    case 0x1:
+        snprintf(buf, len, "JP %s", target);
+        return;
+    case 0x2:
+        snprintf(buf, len, "CALL %s", target);
+        return;
+    case 0x3:
+        snprintf(buf, len, "SE V%X, 0x%02x", x, nn);
+        return;
+    case 0x4:
+        snprintf(buf, len, "SNE V%X, 0x%02x", x, nn);
+        return;
+    case 0x5:
+        if (n == 0)
+        {
+            snprintf(buf, len, "SE V%X, V%X", x, y);
+            return;
+        }
+        if (n == 2 || n == 3)
+        {
+            snprintf(buf, len, "%s V%X - V%X", n == 2 ? "SAVE" : "LOAD", x, y);
+            return;
+        }
+        break;
+    case 0x6:
+        snprintf(buf, len, "LD V%X, 0x%02x", x, nn);
+        return;
+    case 0x7:
+        snprintf(buf, len, "ADD V%X, 0x%02x", x, nn);
+        return;
+    case 0x8:
+    {
+        static const char* ops[16] = { "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+            0, 0, 0, 0, 0, 0, "SHL", 0 };
+        if (ops[n])
+        {
+            snprintf(buf, len, "%s V%X, V%X", ops[n], x, y);
+            return;
+        }
+        break;
+    }
+    case 0x9:
+        if (n == 0)
+        {
+            snprintf(buf, len, "SNE V%X, V%X", x, y);
+            return;
+        }
+        break;
+    case 0xa:
+        snprintf(buf, len, "LD I, %s", target);
+        return;
+    case 0xb:
+        snprintf(buf, len, "JP V0, %s", target);
+        return;
+    case 0xc:
+        snprintf(buf, len, "RND V%X, 0x%02x", x, nn);
+        return;
+    case 0xd:
+        snprintf(buf, len, "DRW V%X, V%X, %u", x, y, n);
+        return;
+    case 0xe:
+        if (nn == 0x9e)
+        {
+            snprintf(buf, len, "SKP V%X", x);
+            return;
+        }
+        if (nn == 0xa1)
+        {
+            snprintf(buf, len, "SKNP V%X", x);
+            return;
+        }
+        break;
+    case 0xf:
+        if (op == 0xf000)
+        {
+            snprintf(buf, len, "LD I, LONG");
+            return;
+        }
+        if (op == 0xf002)
+        {
+            snprintf(buf, len, "AUDIO");
+            return;
+        }
+        if (nn == 0x01)
+        {
+            snprintf(buf, len, "PLANE %u", x);
+            return;
+        }
+        switch (nn)
+        {
+        case 0x07: snprintf(buf, len, "LD V%X, DT", x); return;
+        case 0x0a: snprintf(buf, len, "LD V%X, K", x); return;
+        case 0x15: snprintf(buf, len, "LD DT, V%X", x); return;
+        case 0x18: snprintf(buf, len, "LD ST, V%X", x); return;
+        case 0x1e: snprintf(buf, len, "ADD I, V%X", x); return;
+        case 0x29: snprintf(buf, len, "LD F, V%X", x); return;
+        case 0x30: snprintf(buf, len, "LD HF, V%X", x); return;
+        case 0x33: snprintf(buf, len, "LD B, V%X", x); return;
+        case 0x3a: snprintf(buf, len, "PITCH V%X", x); return;
+        case 0x55: snprintf(buf, len, "LD [I], V%X", x); return;
+        case 0x65: snprintf(buf, len, "LD V%X, [I]", x); return;
+        case 0x75: snprintf(buf, len, "LD R, V%X", x); return;
+        case 0x85: snprintf(buf, len, "LD V%X, R", x); return;
+        }
+        break;
+    }
+
+    snprintf(buf, len, "DW 0x%04x", op);
+}
+
+void c8_disasm_print(FILE* out, const uint8_t* rom, const c8_codemap* map)
+{
+    char label[16];
+    char text[48];
+
+    fprintf(out, "; rom hash %016llx, %u bytes\n", (unsigned long long)map->hash, map->end - map->start);
+
+    uint32_t a = map->start;
+    while (a < map->end)
+    {
+        const uint8_t f = map->flags[a];
+        if (f & (C8_DIS_LABEL_JUMP | C8_DIS_LABEL_CALL | C8_DIS_LABEL_DATA) || a == map->start)
+        {
+            c8_disasm_label(map, (uint16_t)a, label, sizeof(label));
+            if (label[0] != '0')
+                fprintf(out, "%s:\n", label);
+        }
+
+        if ((f & C8_DIS_CODE) && a + 1 < map->end)
+        {
+            const uint16_t op = (uint16_t)((rom[a - C8_DIS_ORIGIN] << 8) | rom[a + 1 - C8_DIS_ORIGIN]);
+            c8_disasm_op(op, map, text, sizeof(text));
+            if (f & C8_DIS_INDIRECT)
+                fprintf(out, "    0x%03x  %02x %02x   %-24s; indirect, not followed\n", a, op >> 8, op & 0xff, text);
+            else
+                fprintf(out, "    0x%03x  %02x %02x   %s\n", a, op >> 8, op & 0xff, text);
+            /* an op that starts on the second byte of another one gets its own line
+            on the next pass - rare, but self modifying roms do it */
+            a += (map->flags[a + 1] & C8_DIS_CODE) ? 1 : 2;
+            continue;
+        }
+
+        /* data - one byte a line so sprites are readable */
+        const uint8_t b = rom[a - C8_DIS_ORIGIN];
+        char bits[9];
+        for (int bit = 0; bit < 8; ++bit)
+            bits[bit] = (b >> (7 - bit)) & 1 ? '#' : '.';
+        bits[8] = 0;
+        fprintf(out, "    0x%03x  %02x      DB 0x%02x                 ; %s\n", a, b, b, bits);
+        ++a;
+    }
+}
+
+static void c8_codemap_path(const char* dir, uint64_t hash, char* buf, size_t len)
+{
+    snprintf(buf, len, "%s/%016llx.c8map", dir, (unsigned long long)hash);
+}
+
+bool c8_codemap_load(const char* dir, uint64_t hash, c8_codemap* map)
+{
+    char path[512];
+    c8_codemap_path(dir, hash, path, sizeof(path));
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    /* header then a flag byte per address up to end */
+    char magic[4];
+    uint32_t version = 0;
+    memset(map, 0, sizeof(*map));
+    bool ok = fread(magic, 1, 4, f) == 4 && memcmp(magic, C8_CODEMAP_MAGIC, 4) == 0
+        && fread(&version, sizeof(version), 1, f) == 1 && version == C8_CODEMAP_VERSION
+        && fread(&map->hash, sizeof(map->hash), 1, f) == 1 && map->hash == hash
+        && fread(&map->start, sizeof(map->start), 1, f) == 1 && fread(&map->end, sizeof(map->end), 1, f) == 1
+        && map->start == C8_DIS_ORIGIN && map->start <= map->end && map->end <= C8_DIS_MEM_SIZE;
+    if (ok)
+    {
+        map->flags = malloc(map->end ? map->end : 1);
+        ok = map->flags && fread(map->flags, 1, map->end, f) == map->end;
+    }
+    fclose(f);
+    if (!ok)
+        c8_codemap_free(map);
+    return ok;
+}
+
+bool c8_codemap_save(const char* dir, const c8_codemap* map)
+{
+    char path[512];
+    c8_codemap_path(dir, map->hash, path, sizeof(path));
+    FILE* f = fopen(path, "wb");
+    if (!f)
+    {
+        fprintf(stderr, "c8_codemap_save: failed to open file '%s'!\n", path);
+        return false;
+    }
+
+    const uint32_t version = C8_CODEMAP_VERSION;
+    bool ok = fwrite(C8_CODEMAP_MAGIC, 1, 4, f) == 4 && fwrite(&version, sizeof(version), 1, f) == 1
+        && fwrite(&map->hash, sizeof(map->hash), 1, f) == 1 && fwrite(&map->start, sizeof(map->start), 1, f) == 1
+        && fwrite(&map->end, sizeof(map->end), 1, f) == 1 && fwrite(map->flags, 1, map->end, f) == map->end;
+    return fclose(f) == 0 && ok;
+}
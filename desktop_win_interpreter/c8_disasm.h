@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* recursive traversal disassembler. follows control flow from 0x200 (jumps, calls,
+returns and both sides of every skip) so sprite data sitting after the code doesnt
+get decoded as ops. anything never reached is data.
+
+the code/data map is keyed by a hash of the rom so it can be cached on disk and
+handed to anything else that wants to know where the ops are */
+
+/* xo-chip, the most a rom can have. the map only goes as far as the rom does */
+#define C8_DIS_MEM_SIZE         (0x10000)
+#define C8_DIS_ORIGIN           (0x200)
+
+/* per byte flags in the map */
+#define C8_DIS_CODE             (0x01) /* first byte of a reachable op */
+#define C8_DIS_CODE_LO          (0x02) /* second byte of a reachable op */
+#define C8_DIS_LABEL_JUMP       (0x04) /* target of a jump or skip */
+#define C8_DIS_LABEL_CALL       (0x08) /* target of a call */
+#define C8_DIS_LABEL_DATA       (0x10) /* loaded into I somewhere */
+#define C8_DIS_INDIRECT         (0x20) /* BNNN - target depends on V0, not followed */
+
+typedef struct
+{
+    uint64_t hash;
+    uint16_t start;
+    uint32_t end; /* one past the last rom byte */
+    /* a byte per address below end, from c8_disasm_analyze or c8_codemap_load */
+    uint8_t* flags;
+} c8_codemap;
+
+uint64_t c8_disasm_hash(const uint8_t* rom, size_t size);
+
+/* rom is loaded at C8_DIS_ORIGIN. false if theres no memory for the map */
+bool c8_disasm_analyze(const uint8_t* rom, size_t size, c8_codemap* map);
+void c8_codemap_free(c8_codemap* map);
+
+/* "LD V0, 0x04", "JP L204" etc. map may be NULL, otherwise targets with labels use them */
+void c8_disasm_op(uint16_t op, const c8_codemap* map, char* buf, size_t len);
+
+/* full listing with labels, code and data */
+void c8_disasm_print(FILE* out, const uint8_t* rom, const c8_codemap* map);
+
+/* cache file is <dir>/<hash>.c8map. load fails quietly on a miss. a map is only
+checked against itself, the caller checks end against the rom it has before
+c8_disasm_print indexes the rom with it */
+bool c8_codemap_load(const char* dir, uint64_t hash, c8_codemap* map);
+bool c8_codemap_save(const char* dir, const c8_codemap* map);
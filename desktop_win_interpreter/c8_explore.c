@@ -0,0 +1,674 @@
+#include "c8_explore.h"
+#include "c8_pool.h"
+
+#define C8_EXPLORE_MAX_THREADS  (64)
+/* frontier states a worker takes at a time, so the lock is taken once a batch */
+#define C8_EXPLORE_BATCH        (16)
+/* free frontier slots a worker keeps to hand */
+#define C8_EXPLORE_RESERVE      (64)
+/* a CXNN forks at most 256 ways */
+#define C8_EXPLORE_FORKS        (256)
+#define C8_EXPLORE_MAX_FAULTS   (1024)
+/* what the CXNN generator goes back to after every random op */
+#define C8_EXPLORE_RNG          (0x2545f491)
+/* heap keys are priority above this many bits of push order */
+#define C8_EXPLORE_SEQ_BITS     (40)
+
+typedef enum
+{
+    C8_EXPLORE_DECIDE = 0,  /* stopped on a decision, goes on the frontier */
+    C8_EXPLORE_HALT,        /* 00FD or a jump to itself */
+    C8_EXPLORE_RAN_OUT,     /* max_run cycles with nothing to decide */
+    C8_EXPLORE_FAULT,
+} c8_explore_end;
+
+/* insert only set of 64 bit hashes, shared by every worker without a lock. a slot
+holds the top 32 bits of a hash (never 0, thats empty) and the bottom bits pick
+where probing starts, so two states are only taken for the same if they agree on
+the start and the top half */
+typedef struct
+{
+    SDL_atomic_t* slots;
+    uint32_t mask;
+} c8_explore_set;
+
+/* in front of every state on the frontier */
+typedef struct
+{
+    uint32_t node;
+    uint16_t depth;
+    uint16_t dry;           /* decisions since the path last found a new screen */
+} c8_explore_head;
+
+typedef struct
+{
+    uint64_t key;           /* priority, then push order. smallest goes first */
+    uint32_t slot;
+} c8_explore_entry;
+
+typedef struct
+{
+    c8_explore* x;
+    c8_machine* m;
+    SDL_Thread* thread;
+    uint32_t reserve[C8_EXPLORE_RESERVE];
+    uint32_t nreserve;
+    /* new states from the batch being expanded, pushed when it's done */
+    c8_explore_entry out[C8_EXPLORE_BATCH * C8_EXPLORE_FORKS];
+    uint32_t nout;
+    uint64_t expanded;
+    uint64_t dupes;
+    uint64_t dropped;
+    uint64_t ends;
+    uint32_t depth;
+} c8_explore_worker;
+
+struct c8_explore
+{
+    c8_explore_opts o;
+    c8_pool* pool;
+    c8_explore_worker* workers;
+    uint32_t nworkers;
+    uint64_t start_cycles;
+
+    c8_explore_set states;
+    c8_explore_set screens;
+    c8_explore_step* steps;
+    SDL_atomic_t nstates;
+    SDL_atomic_t nscreens;
+    SDL_atomic_t nfaults;
+    SDL_atomic_t stop;
+
+    /* the frontier and everything below, under lock */
+    SDL_mutex* lock;
+    SDL_cond* more;
+    uint8_t* slab;
+    size_t slot_size;
+    uint32_t nslots;
+    uint32_t* free_slots;
+    uint32_t nfree;
+    c8_explore_entry* heap;
+    uint32_t nheap;
+    uint64_t seq;
+    uint32_t busy;
+
+    c8_explore_fault faults[C8_EXPLORE_MAX_FAULTS];
+    c8_explore_screen* kept;
+    uint32_t nkept;
+
+    c8_explore_stats stats;
+};
+
+static bool c8_explore_set_init(c8_explore_set* set, uint32_t nkeys)
+{
+    /* at most half full keeps the probes short */
+    uint32_t cap = 1024;
+    while (cap < nkeys * 2)
+        cap <<= 1;
+    set->slots = malloc(sizeof(SDL_atomic_t) * cap);
+    set->mask = cap - 1;
+    return set->slots != NULL;
+}
+
+static void c8_explore_set_clear(c8_explore_set* set)
+{
+    memset(set->slots, 0, sizeof(SDL_atomic_t) * ((size_t)set->mask + 1));
+}
+
+/* true if hash wasnt in the set. whoever gets a slot first owns the hash */
+static bool c8_explore_set_add(c8_explore_set* set, uint64_t hash)
+{
+    const int tag = (int)(uint32_t)((hash >> 32) | 1);
+    uint32_t at = (uint32_t)hash & set->mask;
+    for (;;)
+    {
+        const int cur = SDL_AtomicGet(&set->slots[at]);
+        if (cur == tag)
+            return false;
+        if (cur)
+        {
+            at = (at + 1) & set->mask;
+            continue;
+        }
+        /* lost the race, look at the same slot again - it might be ours now */
+        if (SDL_AtomicCAS(&set->slots[at], 0, tag))
+            return true;
+    }
+}
+
+static c8_explore_head* c8_explore_slot(const c8_explore* x, uint32_t slot)
+{
+    return (c8_explore_head*)(x->slab + slot * x->slot_size);
+}
+
+static c8_state* c8_explore_slot_state(const c8_explore* x, uint32_t slot)
+{
+    return (c8_state*)(x->slab + slot * x->slot_size + sizeof(c8_explore_head));
+}
+
+static void c8_explore_heap_push(c8_explore* x, c8_explore_entry e)
+{
+    uint32_t at = x->nheap++;
+    while (at)
+    {
+        const uint32_t up = (at - 1) / 2;
+        if (x->heap[up].key <= e.key)
+            break;
+        x->heap[at] = x->heap[up];
+        at = up;
+    }
+    x->heap[at] = e;
+}
+
+static uint32_t c8_explore_heap_pop(c8_explore* x)
+{
+    const uint32_t top = x->heap[0].slot;
+    const c8_explore_entry last = x->heap[--x->nheap];
+    uint32_t at = 0;
+    for (;;)
+    {
+        uint32_t down = at * 2 + 1;
+        if (down >= x->nheap)
+            break;
+        if (down + 1 < x->nheap && x->heap[down + 1].key < x->heap[down].key)
+            ++down;
+        if (last.key <= x->heap[down].key)
+            break;
+        x->heap[at] = x->heap[down];
+        at = down;
+    }
+    if (x->nheap)
+        x->heap[at] = last;
+    return top;
+}
+
+/* under lock */
+static void c8_explore_refill(c8_explore* x, c8_explore_worker* w)
+{
+    while (w->nreserve < C8_EXPLORE_RESERVE && x->nfree)
+        w->reserve[w->nreserve++] = x->free_slots[--x->nfree];
+}
+
+/* under lock. the priority was put in the key's top bits when the state was made */
+static void c8_explore_push(c8_explore* x, c8_explore_worker* w)
+{
+    for (uint32_t n = 0; n < w->nout; ++n)
+    {
+        c8_explore_entry e = w->out[n];
+        e.key |= x->seq++ & ((1ull << C8_EXPLORE_SEQ_BITS) - 1);
+        c8_explore_heap_push(x, e);
+    }
+    w->nout = 0;
+}
+
+static uint16_t c8_explore_op(const c8_state* s, uint16_t pc)
+{
+    return (uint16_t)(s->mem[pc & s->mem_mask] << 8 | s->mem[(pc + 1) & s->mem_mask]);
+}
+
+static c8_decision c8_explore_decision(uint16_t op)
+{
+    switch (op >> 12)
+    {
+    case 0xc:
+        /* CXN0 can only come out one way */
+        return (op & 0xff) ? C8_DECIDE_RANDOM : C8_DECIDE_NONE;
+    case 0xe:
+        return (op & 0xff) == 0x9e || (op & 0xff) == 0xa1 ? C8_DECIDE_KEY : C8_DECIDE_NONE;
+    case 0xf:
+        return (op & 0xff) == 0x0a ? C8_DECIDE_WAIT : C8_DECIDE_NONE;
+    }
+    return C8_DECIDE_NONE;
+}
+
+/* up to the next decision, leaves the machine in front of it */
+static c8_explore_end c8_explore_run_on(const c8_explore* x, c8_machine* m)
+{
+    for (uint32_t n = 0; n < x->o.max_run; ++n)
+    {
+        const uint16_t pc = m->s.pc;
+        const uint16_t op = c8_explore_op(&m->s, pc);
+        if (c8_explore_decision(op) != C8_DECIDE_NONE)
+            return C8_EXPLORE_DECIDE;
+        if (op == 0x00fd || ((op & 0xf000) == 0x1000 && (op & 0x0fff) == pc))
+            return C8_EXPLORE_HALT;
+        c8_cycle(m);
+        if (m->faulted)
+        {
+            /* left looking at the bad op, same as c8_run does */
+            m->s.pc = pc;
+            return C8_EXPLORE_FAULT;
+        }
+    }
+    return C8_EXPLORE_RAN_OUT;
+}
+
+static void c8_explore_keep_screen(c8_explore* x, uint64_t hash, uint32_t node, const c8_display* d)
+{
+    SDL_AtomicAdd(&x->nscreens, 1);
+    SDL_LockMutex(x->lock);
+    if (x->nkept < x->o.max_screens)
+    {
+        c8_explore_screen* sc = &x->kept[x->nkept++];
+        sc->hash = hash;
+        sc->node = node;
+        sc->screen = *d;
+    }
+    SDL_UnlockMutex(x->lock);
+}
+
+static void c8_explore_keep_fault(c8_explore* x, uint32_t node, const c8_state* s)
+{
+    const int n = SDL_AtomicAdd(&x->nfaults, 1);
+    if (n >= C8_EXPLORE_MAX_FAULTS)
+        return;
+    /* slots are claimed by the count, the lock is only so the last write is seen */
+    SDL_LockMutex(x->lock);
+    x->faults[n].node = node;
+    x->faults[n].pc = s->pc;
+    x->faults[n].op = c8_explore_op(s, s->pc);
+    SDL_UnlockMutex(x->lock);
+}
+
+static bool c8_explore_slot_get(c8_explore_worker* w, uint32_t* slot)
+{
+    c8_explore* x = w->x;
+    if (!w->nreserve)
+    {
+        SDL_LockMutex(x->lock);
+        c8_explore_refill(x, w);
+        SDL_UnlockMutex(x->lock);
+        if (!w->nreserve)
+            return false;
+    }
+    *slot = w->reserve[--w->nreserve];
+    return true;
+}
+
+/* the machine just got somewhere. give it a node if its new, and a place on the
+frontier if theres more to decide */
+static void c8_explore_found(c8_explore_worker* w, const c8_explore_step* step, uint32_t depth, uint32_t dry,
+    c8_explore_end end)
+{
+    c8_explore* x = w->x;
+    const c8_state* s = &w->m->s;
+    const uint64_t hash = c8_state_hash(s);
+    if (!c8_explore_set_add(&x->states, hash))
+    {
+        ++w->dupes;
+        return;
+    }
+    const uint32_t node = (uint32_t)SDL_AtomicAdd(&x->nstates, 1);
+    if (node >= x->o.max_states)
+    {
+        SDL_AtomicSet(&x->stop, 1);
+        return;
+    }
+    x->steps[node] = *step;
+    if (depth > w->depth)
+        w->depth = depth;
+
+    const uint64_t screen = c8_state_screen_hash(s);
+    if (c8_explore_set_add(&x->screens, screen))
+    {
+        dry = 0;
+        c8_explore_keep_screen(x, screen, node, &s->screen);
+    }
+
+    if (end == C8_EXPLORE_FAULT)
+    {
+        c8_explore_keep_fault(x, node, s);
+        return;
+    }
+    if (end != C8_EXPLORE_DECIDE || (x->o.max_depth && depth >= x->o.max_depth))
+    {
+        ++w->ends;
+        return;
+    }
+
+    uint32_t slot;
+    if (!c8_explore_slot_get(w, &slot))
+    {
+        ++w->dropped;
+        return;
+    }
+    c8_explore_head* head = c8_explore_slot(x, slot);
+    head->node = node;
+    head->depth = (uint16_t)(depth < 0xffff ? depth : 0xffff);
+    head->dry = (uint16_t)(dry < 0xffff ? dry : 0xffff);
+    c8_state_copy(c8_explore_slot_state(x, slot), s);
+
+    /* breadth first is depth order. new screens first puts paths that keep finding
+    them ahead, shallower first among equals */
+    const uint64_t prio = x->o.best_first ? (uint64_t)(dry < 0xff ? dry : 0xff) << 16 | head->depth : head->depth;
+    c8_explore_entry* e = &w->out[w->nout++];
+    e->key = prio << C8_EXPLORE_SEQ_BITS;
+    e->slot = slot;
+}
+
+static void c8_explore_fork(c8_explore_worker* w, const c8_explore_head* head, const c8_state* from,
+    c8_decision kind, uint8_t choice)
+{
+    c8_explore* x = w->x;
+    c8_machine* m = w->m;
+    c8_state_copy(&m->s, from);
+    m->faulted = false;
+
+    c8_explore_step step;
+    step.parent = head->node;
+    step.cycle = (uint32_t)(m->s.cycles - x->start_cycles);
+    step.pc = m->s.pc;
+    step.kind = (uint8_t)kind;
+    step.choice = choice;
+
+    const uint8_t vx = (uint8_t)((c8_explore_op(from, from->pc) >> 8) & 0xf);
+    switch (kind)
+    {
+    case C8_DECIDE_KEY:
+        step.choice = (uint8_t)((m->s.v[vx] & 0xf) | (choice ? 0x10 : 0));
+        m->s.keys = choice ? (uint16_t)(1 << (m->s.v[vx] & 0xf)) : 0;
+        c8_cycle(m);
+        m->s.keys = 0;
+        break;
+    case C8_DECIDE_WAIT:
+        /* parks, then the key comes in straight away */
+        c8_cycle(m);
+        if (!m->faulted)
+        {
+            m->s.v[m->s.key_wait & 0xf] = choice;
+            m->s.key_wait = 0;
+        }
+        break;
+    case C8_DECIDE_RANDOM:
+        c8_cycle(m);
+        m->s.v[vx] = choice;
+        m->s.rng = C8_EXPLORE_RNG;
+        break;
+    default:
+        break;
+    }
+    ++w->expanded;
+
+    c8_explore_end end;
+    if (m->faulted)
+    {
+        m->s.pc = step.pc;
+        end = C8_EXPLORE_FAULT;
+    }
+    else
+    {
+        end = c8_explore_run_on(x, m);
+    }
+    c8_explore_found(w, &step, (uint32_t)head->depth + 1, (uint32_t)head->dry + 1, end);
+}
+
+static void c8_explore_expand(c8_explore_worker* w, uint32_t slot)
+{
+    const c8_explore_head* head = c8_explore_slot(w->x, slot);
+    const c8_state* s = c8_explore_slot_state(w->x, slot);
+    const uint16_t op = c8_explore_op(s, s->pc);
+    const c8_decision kind = c8_explore_decision(op);
+
+    if (kind == C8_DECIDE_KEY)
+    {
+        c8_explore_fork(w, head, s, kind, 0);
+        c8_explore_fork(w, head, s, kind, 1);
+    }
+    else if (kind == C8_DECIDE_WAIT)
+    {
+        for (uint8_t k = 0; k < 16; ++k)
+            c8_explore_fork(w, head, s, kind, k);
+    }
+    else if (kind == C8_DECIDE_RANDOM)
+    {
+        /* every value the mask lets through */
+        const uint8_t mask = (uint8_t)op;
+        for (uint8_t v = mask;; v = (uint8_t)((v - 1) & mask))
+        {
+            c8_explore_fork(w, head, s, kind, v);
+            if (!v)
+                break;
+        }
+    }
+}
+
+static int c8_explore_worker_main(void* data)
+{
+    c8_explore_worker* w = data;
+    c8_explore* x = w->x;
+    uint32_t batch[C8_EXPLORE_BATCH];
+    uint32_t nbatch = 0;
+
+    for (;;)
+    {
+        SDL_LockMutex(x->lock);
+        /* the last batch's new states go on and its old ones free up */
+        const bool pushed = w->nout != 0;
+        c8_explore_push(x, w);
+        for (uint32_t n = 0; n < nbatch; ++n)
+            x->free_slots[x->nfree++] = batch[n];
+        if (nbatch)
+            --x->busy;
+        nbatch = 0;
+        c8_explore_refill(x, w);
+        if (pushed || !x->busy)
+            SDL_CondBroadcast(x->more);
+
+        /* an empty frontier is only the end once nobody's still adding to it */
+        while (!x->nheap && x->busy && !SDL_AtomicGet(&x->stop))
+            SDL_CondWait(x->more, x->lock);
+        if (!x->nheap || SDL_AtomicGet(&x->stop))
+        {
+            SDL_CondBroadcast(x->more);
+            SDL_UnlockMutex(x->lock);
+            break;
+        }
+        while (nbatch < C8_EXPLORE_BATCH && x->nheap)
+            batch[nbatch++] = c8_explore_heap_pop(x);
+        ++x->busy;
+        SDL_UnlockMutex(x->lock);
+
+        for (uint32_t n = 0; n < nbatch && !SDL_AtomicGet(&x->stop); ++n)
+            c8_explore_expand(w, batch[n]);
+    }
+    return 0;
+}
+
+void c8_explore_defaults(c8_explore_opts* o)
+{
+    o->threads = 0;
+    o->max_states = 1000000;
+    o->max_depth = 0;
+    o->max_run = 100000;
+    o->max_screens = 4096;
+    o->frontier_bytes = (size_t)1024 * 1024 * 1024;
+    o->best_first = false;
+}
+
+c8_explore* c8_explore_create(const c8_explore_opts* o)
+{
+    c8_explore* x = calloc(1, sizeof(c8_explore));
+    if (!x)
+        return NULL;
+    x->o = *o;
+    if (!x->o.max_states || x->o.max_states > 0x40000000)
+        x->o.max_states = 0x40000000;
+    if (!x->o.max_run)
+        x->o.max_run = 1;
+
+    x->nworkers = o->threads ? o->threads : (uint32_t)SDL_GetCPUCount();
+    if (x->nworkers < 1)
+        x->nworkers = 1;
+    if (x->nworkers > C8_EXPLORE_MAX_THREADS)
+        x->nworkers = C8_EXPLORE_MAX_THREADS;
+
+    x->workers = calloc(x->nworkers, sizeof(c8_explore_worker));
+    x->pool = c8_pool_create(x->nworkers);
+    x->steps = malloc(sizeof(c8_explore_step) * x->o.max_states);
+    x->kept = malloc(sizeof(c8_explore_screen) * (x->o.max_screens ? x->o.max_screens : 1));
+    x->lock = SDL_CreateMutex();
+    x->more = SDL_CreateCond();
+    if (!x->workers || !x->pool || !x->steps || !x->kept || !x->lock || !x->more ||
+        !c8_explore_set_init(&x->states, x->o.max_states) || !c8_explore_set_init(&x->screens, x->o.max_states))
+    {
+        fprintf(stderr, "c8_explore: out of memory\n");
+        c8_explore_destroy(x);
+        return NULL;
+    }
+    for (uint32_t n = 0; n < x->nworkers; ++n)
+    {
+        x->workers[n].x = x;
+        x->workers[n].m = c8_pool_acquire(x->pool);
+    }
+    return x;
+}
+
+void c8_explore_destroy(c8_explore* x)
+{
+    if (!x)
+        return;
+    free(x->slab);
+    free(x->free_slots);
+    free(x->heap);
+    free(x->states.slots);
+    free(x->screens.slots);
+    free(x->steps);
+    free(x->kept);
+    free(x->workers);
+    c8_pool_destroy(x->pool);
+    if (x->more)
+        SDL_DestroyCond(x->more);
+    if (x->lock)
+        SDL_DestroyMutex(x->lock);
+    free(x);
+}
+
+bool c8_explore_run(c8_explore* x, const c8_machine* base)
+{
+    const uint64_t t0 = SDL_GetPerformanceCounter();
+
+    /* every state is the same size, the rom decides it */
+    const size_t slot_size = (sizeof(c8_explore_head) + c8_state_size(&base->s) + 7) & ~(size_t)7;
+    size_t nslots = x->o.frontier_bytes / slot_size;
+    if (nslots > 0x7fffffff)
+        nslots = 0x7fffffff;
+    if (slot_size != x->slot_size || nslots != x->nslots)
+    {
+        free(x->slab);
+        free(x->free_slots);
+        free(x->heap);
+        x->slot_size = slot_size;
+        x->nslots = (uint32_t)nslots;
+        x->slab = malloc(nslots * slot_size);
+        x->free_slots = malloc(sizeof(uint32_t) * nslots);
+        x->heap = malloc(sizeof(c8_explore_entry) * nslots);
+        if (!nslots || !x->slab || !x->free_slots || !x->heap)
+        {
+            fprintf(stderr, "c8_explore: no room for a frontier\n");
+            x->nslots = 0;
+            x->slot_size = 0;
+            return false;
+        }
+    }
+
+    c8_explore_set_clear(&x->states);
+    c8_explore_set_clear(&x->screens);
+    SDL_AtomicSet(&x->nstates, 0);
+    SDL_AtomicSet(&x->nscreens, 0);
+    SDL_AtomicSet(&x->nfaults, 0);
+    SDL_AtomicSet(&x->stop, 0);
+    for (uint32_t n = 0; n < x->nslots; ++n)
+        x->free_slots[n] = x->nslots - 1 - n;
+    x->nfree = x->nslots;
+    x->nheap = 0;
+    x->seq = 0;
+    x->busy = 0;
+    x->nkept = 0;
+    x->start_cycles = base->s.cycles;
+
+    for (uint32_t n = 0; n < x->nworkers; ++n)
+    {
+        c8_explore_worker* w = &x->workers[n];
+        c8_machine* m = w->m;
+        c8_state_copy(&m->s, &base->s);
+        m->initd = base->initd;
+        m->rom_loaded = base->rom_loaded;
+        m->rom_size = base->rom_size;
+        /* so a bad op stops the path instead of the process */
+        c8_debug_attach(m, true);
+        w->nreserve = 0;
+        w->nout = 0;
+        w->expanded = 0;
+        w->dupes = 0;
+        w->dropped = 0;
+        w->ends = 0;
+        w->depth = 0;
+    }
+
+    /* the first state, run up to the first decision here so the workers start with
+    something on the frontier */
+    c8_explore_worker* first = &x->workers[0];
+    first->m->s.rng = C8_EXPLORE_RNG;
+    first->m->s.keys = 0;
+    c8_explore_step root;
+    root.parent = C8_EXPLORE_ROOT;
+    root.cycle = 0;
+    root.pc = first->m->s.pc;
+    root.kind = C8_DECIDE_NONE;
+    root.choice = 0;
+    c8_explore_refill(x, first);
+    c8_explore_found(first, &root, 0, 0, c8_explore_run_on(x, first->m));
+    c8_explore_push(x, first);
+
+    for (uint32_t n = 0; n < x->nworkers; ++n)
+        x->workers[n].thread = SDL_CreateThread(c8_explore_worker_main, "c8explore", &x->workers[n]);
+    for (uint32_t n = 0; n < x->nworkers; ++n)
+    {
+        /* no thread, do its share here. the others carry on without it either way */
+        if (!x->workers[n].thread)
+            c8_explore_worker_main(&x->workers[n]);
+        else
+            SDL_WaitThread(x->workers[n].thread, NULL);
+    }
+
+    c8_explore_stats* st = &x->stats;
+    memset(st, 0, sizeof(*st));
+    for (uint32_t n = 0; n < x->nworkers; ++n)
+    {
+        const c8_explore_worker* w = &x->workers[n];
+        st->expanded += w->expanded;
+        st->dupes += w->dupes;
+        st->dropped += w->dropped;
+        st->ends += w->ends;
+        if (w->depth > st->depth)
+            st->depth = w->depth;
+    }
+    const uint32_t nstates = (uint32_t)SDL_AtomicGet(&x->nstates);
+    st->states = nstates < x->o.max_states ? nstates : x->o.max_states;
+    st->screens = (uint32_t)SDL_AtomicGet(&x->nscreens);
+    st->faults = (uint32_t)SDL_AtomicGet(&x->nfaults);
+    st->secs = (double)(SDL_GetPerformanceCounter() - t0) / (double)SDL_GetPerformanceFrequency();
+    return true;
+}
+
+void c8_explore_get_stats(const c8_explore* x, c8_explore_stats* st)
+{
+    *st = x->stats;
+}
+
+const c8_explore_step* c8_explore_step_at(const c8_explore* x, uint32_t node)
+{
+    return node < x->stats.states ? &x->steps[node] : NULL;
+}
+
+uint32_t c8_explore_faults(const c8_explore* x, const c8_explore_fault** faults)
+{
+    *faults = x->faults;
+    return x->stats.faults < C8_EXPLORE_MAX_FAULTS ? x->stats.faults : C8_EXPLORE_MAX_FAULTS;
+}
+
+uint32_t c8_explore_screens(const c8_explore* x, const c8_explore_screen** screens)
+{
+    *screens = x->kept;
+    return x->nkept;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "c8.h"
+
+/* walks every way a rom can go. a machine runs until the next op whose outcome
+comes from outside - a key check (EX9E / EXA1), a key wait (FX0A) or a random
+number (CXNN) - and then forks, once for every outcome that op can have. each
+fork runs on to its own next decision and its state is hashed. states seen before
+are dropped and new ones go on the frontier, which threads on every core work
+through breadth first or new screens first.
+
+keys are only held for the op that checks them and FX0A gets its key straight
+away, so paths dont branch on timing. the CXNN generator is reset after every
+random op, its outcomes are all taken anyway. every distinct state gets a node
+and a step back to the node it came from, so the choices behind any screen or
+fault can be replayed */
+
+#define C8_EXPLORE_ROOT         (0xffffffffu)
+
+typedef enum
+{
+    C8_DECIDE_NONE = 0,     /* the first state, nothing decided yet */
+    C8_DECIDE_KEY,          /* EX9E / EXA1, choice is the key, | 0x10 if it was down */
+    C8_DECIDE_WAIT,         /* FX0A, choice is the key pressed */
+    C8_DECIDE_RANDOM,       /* CXNN, choice is the value VX got */
+} c8_decision;
+
+typedef struct
+{
+    uint32_t threads;       /* 0 for one a core */
+    uint32_t max_states;    /* stop after this many distinct states */
+    uint32_t max_depth;     /* decisions along one path, 0 for no limit */
+    uint32_t max_run;       /* cycles without a decision before a path is given up on */
+    uint32_t max_screens;   /* distinct screens kept to look at afterwards */
+    size_t frontier_bytes;  /* states waiting to be expanded, past this new ones are dropped */
+    bool best_first;        /* paths that just found a new screen go first */
+} c8_explore_opts;
+
+/* how the state with this node number was reached */
+typedef struct
+{
+    uint32_t parent;        /* C8_EXPLORE_ROOT for the first state */
+    uint32_t cycle;         /* cycles after the start the deciding op ran at */
+    uint16_t pc;            /* of the deciding op */
+    uint8_t kind;           /* c8_decision */
+    uint8_t choice;
+} c8_explore_step;
+
+typedef struct
+{
+    uint32_t node;          /* state the machine faulted in */
+    uint16_t pc;
+    uint16_t op;
+} c8_explore_fault;
+
+typedef struct
+{
+    uint64_t hash;
+    uint32_t node;          /* first state it was seen in */
+    c8_display screen;
+} c8_explore_screen;
+
+typedef struct
+{
+    uint64_t expanded;      /* forks run */
+    uint32_t states;        /* distinct */
+    uint64_t dupes;         /* forks that ended in a state seen before */
+    uint64_t dropped;       /* new states the frontier had no room for */
+    uint64_t ends;          /* paths that halted, hit max_run or max_depth */
+    uint32_t screens;       /* distinct, kept or not */
+    uint32_t faults;
+    uint32_t depth;         /* deepest path */
+    double secs;
+} c8_explore_stats;
+
+typedef struct c8_explore c8_explore;
+
+void c8_explore_defaults(c8_explore_opts* o);
+c8_explore* c8_explore_create(const c8_explore_opts* o);
+void c8_explore_destroy(c8_explore* x);
+
+/* from base as it stands, loaded and c8_init'd. blocks until the frontier is empty
+or max_states is reached. can be run again, it starts over */
+bool c8_explore_run(c8_explore* x, const c8_machine* base);
+
+void c8_explore_get_stats(const c8_explore* x, c8_explore_stats* st);
+const c8_explore_step* c8_explore_step_at(const c8_explore* x, uint32_t node);
+uint32_t c8_explore_faults(const c8_explore* x, const c8_explore_fault** faults);
+uint32_t c8_explore_screens(const c8_explore* x, const c8_explore_screen** screens);
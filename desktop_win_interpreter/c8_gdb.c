@@ -0,0 +1,623 @@
+#include "c8_gdb.h"
+#include "c8_net.h"
+
+#define C8_GDB_PACKET_SIZE      (0x4000)
+
+/* gdb has no idea what a chip-8 is, describe the registers ourselves. 16 bit regs
+go over the wire little endian like everything else gdb speaks */
+static const char c8_gdb_target_xml[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\"><feature name=\"org.chip8.core\">"
+    "<reg name=\"v0\" bitsize=\"8\" regnum=\"0\"/><reg name=\"v1\" bitsize=\"8\"/>"
+    "<reg name=\"v2\" bitsize=\"8\"/><reg name=\"v3\" bitsize=\"8\"/>"
+    "<reg name=\"v4\" bitsize=\"8\"/><reg name=\"v5\" bitsize=\"8\"/>"
+    "<reg name=\"v6\" bitsize=\"8\"/><reg name=\"v7\" bitsize=\"8\"/>"
+    "<reg name=\"v8\" bitsize=\"8\"/><reg name=\"v9\" bitsize=\"8\"/>"
+    "<reg name=\"va\" bitsize=\"8\"/><reg name=\"vb\" bitsize=\"8\"/>"
+    "<reg name=\"vc\" bitsize=\"8\"/><reg name=\"vd\" bitsize=\"8\"/>"
+    "<reg name=\"ve\" bitsize=\"8\"/><reg name=\"vf\" bitsize=\"8\"/>"
+    "<reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>"
+    "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>"
+    "<reg name=\"sp\" bitsize=\"8\"/>"
+    "<reg name=\"dt\" bitsize=\"8\"/>"
+    "<reg name=\"st\" bitsize=\"8\"/>"
+    "</feature></target>";
+
+#define C8_GDB_NREGS            (21)
+
+static c8_machine* machine = NULL;
+static c8_sock listener = C8_SOCK_INVALID;
+static c8_sock client = C8_SOCK_INVALID;
+static bool running = false; /* client said continue */
+static bool noack = false;
+
+/* incoming bytes not yet parsed into a packet */
+static char rx[C8_GDB_PACKET_SIZE + 8];
+static int rx_len = 0;
+/* outgoing packet, $ + body + #xx. memory reads hex straight into this */
+static char tx[C8_GDB_PACKET_SIZE * 2 + 8];
+
+static void c8_gdb_drop(void);
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static int c8_gdb_unhex(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static uint32_t c8_gdb_parse_hex(const char** p)
+{
+    uint32_t v = 0;
+    int d;
+    while ((d = c8_gdb_unhex(**p)) >= 0)
+    {
+        v = (v << 4) | (uint32_t)d;
+        ++*p;
+    }
+    return v;
+}
+
+static char* c8_gdb_put_hex(char* out, const uint8_t* bytes, int len)
+{
+    for (int b = 0; b < len; ++b)
+    {
+        *out++ = hexdigits[bytes[b] >> 4];
+        *out++ = hexdigits[bytes[b] & 0xf];
+    }
+    return out;
+}
+
+/* body has already been written at tx + 1 */
+static void c8_gdb_send_body(int body_len)
+{
+    uint8_t sum = 0;
+    for (int c = 1; c <= body_len; ++c)
+        sum += (uint8_t)tx[c];
+    tx[0] = '$';
+    tx[body_len + 1] = '#';
+    tx[body_len + 2] = hexdigits[sum >> 4];
+    tx[body_len + 3] = hexdigits[sum & 0xf];
+    if (!c8_net_send(client, tx, body_len + 4))
+    {
+        c8_gdb_drop();
+        c8_gdb_listen(NULL, 0);
+    }
+}
+
+static void c8_gdb_send(const char* body)
+{
+    int len = (int)strlen(body);
+    memcpy(tx + 1, body, len);
+    c8_gdb_send_body(len);
+}
+
+/* register n as it goes over the wire */
+static int c8_gdb_reg_bytes(const c8_regs* r, int n, uint8_t* out)
+{
+    if (n < 16)
+    {
+        out[0] = r->v[n];
+        return 1;
+    }
+    switch (n)
+    {
+    case 16:
+        out[0] = r->i & 0xff;
+        out[1] = r->i >> 8;
+        return 2;
+    case 17:
+        out[0] = r->pc & 0xff;
+        out[1] = r->pc >> 8;
+        return 2;
+    case 18:
+        out[0] = (uint8_t)r->sp;
+        return 1;
+    case 19:
+        out[0] = r->delay;
+        return 1;
+    case 20:
+        out[0] = r->snd;
+        return 1;
+    }
+    return 0;
+}
+
+static void c8_gdb_set_reg(c8_regs* r, int n, uint32_t le)
+{
+    if (n < 16)
+        r->v[n] = (uint8_t)le;
+    else if (n == 16)
+        r->i = (uint16_t)le;
+    else if (n == 17)
+        r->pc = (uint16_t)le;
+    else if (n == 18)
+        r->sp = (uint16_t)(le & 0xf);
+    else if (n == 19)
+        r->delay = (uint8_t)le;
+    else if (n == 20)
+        r->snd = (uint8_t)le;
+}
+
+/* little endian hex -> value, for the P and G packets */
+static uint32_t c8_gdb_parse_le(const char** p, int nbytes)
+{
+    uint32_t v = 0;
+    for (int b = 0; b < nbytes; ++b)
+    {
+        int hi = c8_gdb_unhex((*p)[0]);
+        int lo = hi >= 0 ? c8_gdb_unhex((*p)[1]) : -1;
+        if (lo < 0)
+            break;
+        v |= (uint32_t)((hi << 4) | lo) << (8 * b);
+        *p += 2;
+    }
+    return v;
+}
+
+static void c8_gdb_stop_reply(c8_stop why)
+{
+    char body[64];
+    switch (why)
+    {
+    case C8_STOP_WATCH_READ:
+        snprintf(body, sizeof(body), "T05rwatch:%x;", c8_stop_addr(machine));
+        break;
+    case C8_STOP_WATCH_WRITE:
+        snprintf(body, sizeof(body), "T05watch:%x;", c8_stop_addr(machine));
+        break;
+    case C8_STOP_FAULT:
+        snprintf(body, sizeof(body), "T0b"); /* SIGSEGV */
+        break;
+    case C8_STOP_NONE:
+        snprintf(body, sizeof(body), "T02"); /* SIGINT - client asked us to stop */
+        break;
+    case C8_STOP_WATCH_REG:
+        snprintf(body, sizeof(body), "T05");
+        break;
+    case C8_STOP_HISTORY_START:
+        snprintf(body, sizeof(body), "T05replaylog:begin;");
+        break;
+    default:
+        snprintf(body, sizeof(body), "T05swbreak:;");
+        break;
+    }
+    c8_gdb_send(body);
+}
+
+/* Z/z packets: type,addr,kind */
+static void c8_gdb_breakpoint(const char* p, bool set)
+{
+    uint32_t type = c8_gdb_parse_hex(&p);
+    if (*p++ != ',')
+    {
+        c8_gdb_send("E01");
+        return;
+    }
+    uint32_t addr = c8_gdb_parse_hex(&p);
+    uint32_t len = 1;
+    if (*p == ',')
+    {
+        ++p;
+        len = c8_gdb_parse_hex(&p);
+    }
+
+    uint8_t kinds;
+    switch (type)
+    {
+    case 0: /* software */
+    case 1: /* hardware, same thing for us */
+        if (set)
+            c8_break_set(machine, (uint16_t)addr);
+        else
+            c8_break_clear(machine, (uint16_t)addr);
+        c8_gdb_send("OK");
+        return;
+    case 2:
+        kinds = C8_WATCH_WRITE;
+        break;
+    case 3:
+        kinds = C8_WATCH_READ;
+        break;
+    case 4:
+        kinds = C8_WATCH_READ | C8_WATCH_WRITE;
+        break;
+    default:
+        c8_gdb_send("");
+        return;
+    }
+
+    for (uint32_t a = 0; a < len && a < C8_MEM_SIZE; ++a)
+    {
+        if (set)
+            c8_watch_set(machine, (uint16_t)(addr + a), kinds);
+        else
+            c8_watch_clear(machine, (uint16_t)(addr + a), kinds);
+    }
+    c8_gdb_send("OK");
+}
+
+static void c8_gdb_qxfer_target(const char* p)
+{
+    /* qXfer:features:read:target.xml:offset,length */
+    const char* args = strstr(p, "target.xml:");
+    if (!args)
+    {
+        c8_gdb_send("E00");
+        return;
+    }
+    args += strlen("target.xml:");
+    uint32_t offset = c8_gdb_parse_hex(&args);
+    if (*args == ',')
+        ++args;
+    uint32_t len = c8_gdb_parse_hex(&args);
+
+    const uint32_t total = (uint32_t)sizeof(c8_gdb_target_xml) - 1;
+    if (offset >= total)
+    {
+        c8_gdb_send("l");
+        return;
+    }
+    if (len > total - offset)
+        len = total - offset;
+    if (len > C8_GDB_PACKET_SIZE - 1)
+        len = C8_GDB_PACKET_SIZE - 1;
+
+    tx[1] = offset + len < total ? 'm' : 'l';
+    memcpy(tx + 2, c8_gdb_target_xml + offset, len);
+    c8_gdb_send_body((int)len + 1);
+}
+
+static void c8_gdb_handle(char* pkt)
+{
+    c8_regs r;
+    const char* p = pkt + 1;
+
+    switch (pkt[0])
+    {
+    case '?':
+        running = false;
+        c8_gdb_stop_reply(C8_STOP_BREAK);
+        return;
+    case 'g':
+    {
+        c8_get_regs(machine, &r);
+        char* out = tx + 1;
+        uint8_t bytes[2];
+        for (int n = 0; n < C8_GDB_NREGS; ++n)
+            out = c8_gdb_put_hex(out, bytes, c8_gdb_reg_bytes(&r, n, bytes));
+        c8_gdb_send_body((int)(out - (tx + 1)));
+        return;
+    }
+    case 'G':
+    {
+        c8_get_regs(machine, &r);
+        uint8_t bytes[2];
+        for (int n = 0; n < C8_GDB_NREGS && *p; ++n)
+            c8_gdb_set_reg(&r, n, c8_gdb_parse_le(&p, c8_gdb_reg_bytes(&r, n, bytes)));
+        c8_set_regs(machine, &r);
+        c8_gdb_send("OK");
+        return;
+    }
+    case 'p':
+    {
+        int n = (int)c8_gdb_parse_hex(&p);
+        uint8_t bytes[2];
+        c8_get_regs(machine, &r);
+        int len = n < C8_GDB_NREGS ? c8_gdb_reg_bytes(&r, n, bytes) : 0;
+        if (!len)
+        {
+            c8_gdb_send("E00");
+            return;
+        }
+        char* out = c8_gdb_put_hex(tx + 1, bytes, len);
+        c8_gdb_send_body((int)(out - (tx + 1)));
+        return;
+    }
+    case 'P':
+    {
+        int n = (int)c8_gdb_parse_hex(&p);
+        uint8_t bytes[2];
+        if (*p++ != '=' || n >= C8_GDB_NREGS)
+        {
+            c8_gdb_send("E00");
+            return;
+        }
+        c8_get_regs(machine, &r);
+        c8_gdb_set_reg(&r, n, c8_gdb_parse_le(&p, c8_gdb_reg_bytes(&r, n, bytes)));
+        c8_set_regs(machine, &r);
+        c8_gdb_send("OK");
+        return;
+    }
+    case 'm':
+    {
+        /* served in one go straight out of machine memory. only what the rom can
+        reach, past the mask is whatever an older rom left there */
+        const uint32_t size = (uint32_t)machine->s.mem_mask + 1;
+        uint32_t addr = c8_gdb_parse_hex(&p);
+        uint32_t len = *p == ',' ? (++p, c8_gdb_parse_hex(&p)) : 0;
+        if (addr >= size)
+        {
+            c8_gdb_send("E01");
+            return;
+        }
+        if (len > size - addr)
+            len = size - addr;
+        if (len > C8_GDB_PACKET_SIZE / 2)
+            len = C8_GDB_PACKET_SIZE / 2;
+        char* out = c8_gdb_put_hex(tx + 1, c8_memory(machine) + addr, (int)len);
+        c8_gdb_send_body((int)(out - (tx + 1)));
+        return;
+    }
+    case 'M':
+    {
+        uint32_t addr = c8_gdb_parse_hex(&p);
+        uint32_t len = *p == ',' ? (++p, c8_gdb_parse_hex(&p)) : 0;
+        /* c8_write_memory turns down anything past what the rom can reach */
+        if (*p++ != ':' || addr >= C8_MEM_SIZE || len > C8_MEM_SIZE - addr || len > UINT16_MAX)
+        {
+            c8_gdb_send("E01");
+            return;
+        }
+        static uint8_t data[C8_MEM_SIZE];
+        for (uint32_t b = 0; b < len; ++b)
+            data[b] = (uint8_t)c8_gdb_parse_le(&p, 1);
+        c8_gdb_send(c8_write_memory(machine, (uint16_t)addr, data, (uint16_t)len) ? "OK" : "E01");
+        return;
+    }
+    case 'c':
+        if (*p)
+        {
+            c8_get_regs(machine, &r);
+            r.pc = (uint16_t)c8_gdb_parse_hex(&p);
+            c8_set_regs(machine, &r);
+        }
+        running = true;
+        return;
+    case 's':
+    {
+        if (*p)
+        {
+            c8_get_regs(machine, &r);
+            r.pc = (uint16_t)c8_gdb_parse_hex(&p);
+            c8_set_regs(machine, &r);
+        }
+        c8_stop why = c8_running(machine) ? c8_run(machine, 1) : C8_STOP_NONE;
+        c8_gdb_stop_reply(why == C8_STOP_NONE ? C8_STOP_BREAK : why);
+        return;
+    }
+    case 'b':
+        /* bs / bc - reverse step and continue */
+        if (pkt[1] == 's')
+        {
+            c8_stop why = c8_reverse_step(machine);
+            c8_gdb_stop_reply(why == C8_STOP_NONE ? C8_STOP_BREAK : why);
+        }
+        else if (pkt[1] == 'c')
+        {
+            c8_gdb_stop_reply(c8_reverse_continue(machine));
+        }
+        else
+        {
+            c8_gdb_send("");
+        }
+        return;
+    case 'Z':
+    case 'z':
+        c8_gdb_breakpoint(p, pkt[0] == 'Z');
+        return;
+    case 'H':
+        c8_gdb_send("OK");
+        return;
+    case 'T':
+        c8_gdb_send("OK");
+        return;
+    case 'k':
+    case 'D':
+        c8_gdb_send("OK");
+        c8_gdb_drop();
+        c8_gdb_listen(NULL, 0);
+        return;
+    case 'q':
+        if (!strncmp(pkt, "qSupported", 10))
+        {
+            char body[96];
+            snprintf(body, sizeof(body), "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+;swbreak+;ReverseStep+;ReverseContinue+",
+                C8_GDB_PACKET_SIZE);
+            c8_gdb_send(body);
+        }
+        else if (!strncmp(pkt, "qXfer:features:read:", 20))
+            c8_gdb_qxfer_target(pkt);
+        else if (!strcmp(pkt, "qAttached"))
+            c8_gdb_send("1");
+        else if (!strcmp(pkt, "qC"))
+            c8_gdb_send("QC1");
+        else if (!strcmp(pkt, "qfThreadInfo"))
+            c8_gdb_send("m1");
+        else if (!strcmp(pkt, "qsThreadInfo"))
+            c8_gdb_send("l");
+        else
+            c8_gdb_send("");
+        return;
+    case 'Q':
+        if (!strcmp(pkt, "QStartNoAckMode"))
+        {
+            c8_gdb_send("OK");
+            noack = true;
+            return;
+        }
+        c8_gdb_send("");
+        return;
+    default:
+        /* empty reply = not supported */
+        c8_gdb_send("");
+        return;
+    }
+}
+
+/* pull complete packets out of rx */
+static void c8_gdb_parse(void)
+{
+    int pos = 0;
+    while (pos < rx_len && client != C8_SOCK_INVALID)
+    {
+        char c = rx[pos];
+        if (c == 0x03)
+        {
+            /* ctrl-c */
+            ++pos;
+            if (running)
+            {
+                running = false;
+                c8_gdb_stop_reply(C8_STOP_NONE);
+            }
+            continue;
+        }
+        if (c != '$')
+        {
+            /* acks and line noise */
+            ++pos;
+            continue;
+        }
+
+        char* end = memchr(rx + pos, '#', rx_len - pos);
+        if (!end || end + 2 >= rx + rx_len)
+            break; /* need the rest of it */
+
+        *end = 0;
+        if (!noack && !c8_net_send(client, "+", 1))
+        {
+            c8_gdb_drop();
+            c8_gdb_listen(NULL, 0);
+            break;
+        }
+        c8_gdb_handle(rx + pos + 1);
+        pos = (int)(end - rx) + 3;
+    }
+
+    if (client == C8_SOCK_INVALID)
+    {
+        rx_len = 0;
+        return;
+    }
+    memmove(rx, rx + pos, rx_len - pos);
+    rx_len -= pos;
+    if (rx_len == (int)sizeof(rx))
+        rx_len = 0; /* garbage that never ended, drop it */
+}
+
+static uint16_t listen_port = 0;
+
+bool c8_gdb_listen(c8_machine* m, uint16_t port)
+{
+    /* port 0 means listen again on the last one after a client leaves */
+    if (port)
+    {
+        machine = m;
+        if (!c8_net_init())
+            return false;
+        listen_port = port;
+    }
+    if (listener == C8_SOCK_INVALID)
+        listener = c8_net_tcp_listen(listen_port);
+    if (listener == C8_SOCK_INVALID)
+    {
+        fprintf(stderr, "c8_gdb_listen: cant listen on 127.0.0.1:%u\n", listen_port);
+        return false;
+    }
+    fprintf(stderr, "gdb stub listening on 127.0.0.1:%u\n", listen_port);
+    return true;
+}
+
+/* client went away or detached, machine runs free again */
+static void c8_gdb_drop(void)
+{
+    if (client != C8_SOCK_INVALID)
+    {
+        c8_net_close(client);
+        client = C8_SOCK_INVALID;
+        c8_debug_attach(machine, false);
+    }
+    running = false;
+    noack = false;
+    rx_len = 0;
+}
+
+void c8_gdb_close(void)
+{
+    c8_gdb_drop();
+    if (listener != C8_SOCK_INVALID)
+    {
+        c8_net_close(listener);
+        listener = C8_SOCK_INVALID;
+    }
+}
+
+bool c8_gdb_listening(void)
+{
+    return listener != C8_SOCK_INVALID;
+}
+
+bool c8_gdb_attached(void)
+{
+    return client != C8_SOCK_INVALID;
+}
+
+bool c8_gdb_poll(int timeout_ms)
+{
+    if (client == C8_SOCK_INVALID)
+    {
+        if (listener == C8_SOCK_INVALID)
+            return true;
+        client = c8_net_tcp_accept(listener);
+        if (client == C8_SOCK_INVALID)
+            return true;
+
+        /* one client at a time. gdb expects the target to be stopped when it attaches */
+        c8_net_close(listener);
+        listener = C8_SOCK_INVALID;
+        c8_debug_attach(machine, true);
+        /* so reverse-step works from here on */
+        c8_reverse_enable(machine, true);
+        running = false;
+        fprintf(stderr, "gdb attached\n");
+    }
+
+    if (!running && timeout_ms > 0)
+        c8_net_wait(client, timeout_ms);
+
+    for (;;)
+    {
+        int got = c8_net_recv(client, rx + rx_len, (int)sizeof(rx) - rx_len);
+        if (got < 0)
+            break;
+        if (got == 0)
+        {
+            fprintf(stderr, "gdb detached\n");
+            c8_gdb_drop();
+            c8_gdb_listen(NULL, 0);
+            return true;
+        }
+        rx_len += got;
+        c8_gdb_parse();
+        if (client == C8_SOCK_INVALID)
+            return true;
+    }
+
+    return running;
+}
+
+void c8_gdb_stopped(c8_stop why)
+{
+    if (client == C8_SOCK_INVALID || !running)
+        return;
+    running = false;
+    c8_gdb_stop_reply(why);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "c8.h"
+
+/* gdb remote serial protocol stub. listens on 127.0.0.1:port, one client at a time.
+registers are V0-VF, I, PC, SP, DT, ST (see the target.xml in c8_gdb.c). reverse step and
+continue are there too, history starts when the client attaches. the host loop polls
+it every frame and only runs the machine when it says so */
+
+bool c8_gdb_listen(c8_machine* m, uint16_t port);
+void c8_gdb_close(void);
+bool c8_gdb_attached(void);
+/* listening with nobody attached yet. accepting happens in c8_gdb_poll so the host
+has to keep calling it */
+bool c8_gdb_listening(void);
+
+/* handle whatever the client sent. while the debugger has the machine stopped this
+waits up to timeout_ms for the next packet so stepping isnt held up by frame pacing.
+returns true if the machine is free to run */
+bool c8_gdb_poll(int timeout_ms);
+
+/* c8_run stopped on its own (breakpoint, watchpoint, fault) - tell the client */
+void c8_gdb_stopped(c8_stop why);
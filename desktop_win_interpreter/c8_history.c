@@ -0,0 +1,177 @@
+#include "c8_history.h"
+
+struct c8_history
+{
+    uint32_t count;
+    uint32_t cap; /* slots that fit at slot_size */
+    size_t slot_size;
+    uint64_t interval;
+    c8_key_event* keys;
+    uint32_t nkeys;
+    uint32_t keys_cap;
+    uint8_t* slots;
+};
+
+static c8_state* c8_history_slot(const c8_history* h, uint32_t n)
+{
+    return (c8_state*)(h->slots + n * h->slot_size);
+}
+
+c8_history* c8_history_create(void)
+{
+    c8_history* h = malloc(sizeof(c8_history));
+    if (h)
+    {
+        h->keys = NULL;
+        h->keys_cap = 0;
+        h->slots = NULL;
+        h->slot_size = 0;
+        h->cap = 0;
+        c8_history_reset(h);
+    }
+    return h;
+}
+
+void c8_history_destroy(c8_history* h)
+{
+    if (h)
+    {
+        free(h->keys);
+        free(h->slots);
+    }
+    free(h);
+}
+
+void c8_history_reset(c8_history* h)
+{
+    h->count = 0;
+    h->nkeys = 0;
+    h->interval = C8_HISTORY_INTERVAL;
+}
+
+uint64_t c8_history_due(const c8_history* h)
+{
+    if (!h->count)
+        return 0;
+    return c8_history_slot(h, h->count - 1)->cycles + h->interval;
+}
+
+/* the rom changed size class, everything so far is for a different machine anyway */
+static void c8_history_resize(c8_history* h, size_t slot_size)
+{
+    free(h->slots);
+    h->slot_size = slot_size;
+    h->cap = (uint32_t)(C8_HISTORY_BYTES / slot_size);
+    if (h->cap > C8_HISTORY_SLOTS)
+        h->cap = C8_HISTORY_SLOTS;
+    h->slots = malloc(h->cap * slot_size);
+    if (!h->slots)
+    {
+        fprintf(stderr, "c8_history: out of memory, no checkpoints\n");
+        h->cap = 0;
+    }
+    c8_history_reset(h);
+}
+
+void c8_history_save(c8_history* h, const c8_state* s)
+{
+    /* keep slots 8 byte aligned for the cycle counter */
+    const size_t size = (c8_state_size(s) + 7) & ~(size_t)7;
+    if (size != h->slot_size)
+        c8_history_resize(h, size);
+    if (h->cap < 2)
+        return;
+
+    /* already have this cycle */
+    if (h->count && s->cycles <= c8_history_slot(h, h->count - 1)->cycles)
+        return;
+
+    if (h->count == h->cap)
+    {
+        /* keep the oldest, thin out the rest */
+        uint32_t kept = 1;
+        for (uint32_t c = 2; c < h->count; c += 2)
+            memcpy(c8_history_slot(h, kept++), c8_history_slot(h, c), h->slot_size);
+        h->count = kept;
+        h->interval *= 2;
+    }
+    c8_state_copy(c8_history_slot(h, h->count++), s);
+}
+
+const c8_state* c8_history_find(const c8_history* h, uint64_t cycle)
+{
+    if (!h->count || c8_history_slot(h, 0)->cycles > cycle)
+        return NULL;
+
+    /* last slot with cycles <= cycle */
+    uint32_t lo = 0;
+    uint32_t hi = h->count;
+    while (hi - lo > 1)
+    {
+        const uint32_t mid = (lo + hi) / 2;
+        if (c8_history_slot(h, mid)->cycles <= cycle)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return c8_history_slot(h, lo);
+}
+
+const c8_state* c8_history_oldest(const c8_history* h)
+{
+    return h->count ? c8_history_slot(h, 0) : NULL;
+}
+
+void c8_history_key(c8_history* h, uint64_t cycle, uint8_t key, bool down)
+{
+    if (h->nkeys == h->keys_cap)
+    {
+        const uint32_t cap = h->keys_cap ? h->keys_cap * 2 : 256;
+        c8_key_event* keys = realloc(h->keys, cap * sizeof(c8_key_event));
+        if (!keys)
+        {
+            /* replays past here will be wrong, better than crashing a debug session */
+            fprintf(stderr, "c8_history_key: out of memory, key dropped from history\n");
+            return;
+        }
+        h->keys = keys;
+        h->keys_cap = cap;
+    }
+    c8_key_event* e = &h->keys[h->nkeys++];
+    e->cycle = cycle;
+    e->key = key;
+    e->down = down;
+}
+
+const c8_key_event* c8_history_keys(const c8_history* h, uint64_t cycle, uint32_t* count)
+{
+    /* first key with cycle >= cycle */
+    uint32_t lo = 0;
+    uint32_t hi = h->nkeys;
+    while (lo < hi)
+    {
+        const uint32_t mid = (lo + hi) / 2;
+        if (h->keys[mid].cycle < cycle)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *count = h->nkeys - lo;
+    return h->keys + lo;
+}
+
+uint64_t c8_history_end(const c8_history* h)
+{
+    uint64_t end = h->count ? c8_history_slot(h, h->count - 1)->cycles : 0;
+    if (h->nkeys && h->keys[h->nkeys - 1].cycle + 1 > end)
+        end = h->keys[h->nkeys - 1].cycle + 1;
+    return end;
+}
+
+void c8_history_truncate(c8_history* h, uint64_t cycle)
+{
+    while (h->count && c8_history_slot(h, h->count - 1)->cycles >= cycle)
+        --h->count;
+    while (h->nkeys && h->keys[h->nkeys - 1].cycle >= cycle)
+        --h->nkeys;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "c8.h"
+#include "c8_input.h"
+
+/* checkpoints for reverse execution. a copy of the machine state every interval
+cycles, oldest first. when the slots run out every other checkpoint is dropped and
+the interval doubles, so a long run keeps covering its whole history and the
+replay needed to reach any cycle stays bounded by the interval.
+
+slots are c8_state_size bytes, not a whole c8_state, so a 4k rom gets the full slot
+count and an xo-chip rom gets as many as fit in C8_HISTORY_BYTES */
+
+#define C8_HISTORY_SLOTS        (1024)
+#define C8_HISTORY_BYTES        (16 * 1024 * 1024)
+#define C8_HISTORY_INTERVAL     (4096)
+
+typedef struct c8_history c8_history;
+
+c8_history* c8_history_create(void);
+void c8_history_destroy(c8_history* h);
+void c8_history_reset(c8_history* h);
+
+/* cycle the next checkpoint is due at */
+uint64_t c8_history_due(const c8_history* h);
+void c8_history_save(c8_history* h, const c8_state* s);
+
+/* newest checkpoint at or before cycle, NULL if history starts after it. only
+c8_state_size of it is there, copy it out with c8_state_copy */
+const c8_state* c8_history_find(const c8_history* h, uint64_t cycle);
+const c8_state* c8_history_oldest(const c8_history* h);
+
+/* keys the machine took in and the cycle it took them at, so re-running from a
+checkpoint sees them at the same point */
+void c8_history_key(c8_history* h, uint64_t cycle, uint8_t key, bool down);
+/* first logged key at or after cycle, count gets how many there are from there on */
+const c8_key_event* c8_history_keys(const c8_history* h, uint64_t cycle, uint32_t* count);
+
+/* one past the last cycle history knows about. a machine running forward from before
+this has been rewound and is about to make a different future */
+uint64_t c8_history_end(const c8_history* h);
+
+/* drops checkpoints and keys at or after cycle - anything past a state the debugger edited
+is no longer what replaying would give */
+void c8_history_truncate(c8_history* h, uint64_t cycle);
@@ -0,0 +1,86 @@
+#pragma once
+#include "c8.h"
+#include "c8_ring.h"
+#include <SDL_mutex.h>
+
+/* keypad events from the host to a machine. the host (event pump) pushes, the machine
+pulls them between ops. lock free so the two can sit on different threads */
+
+#define C8_KEYQ_SIZE            (256)
+
+struct c8_key_event
+{
+    uint64_t cycle; /* machine cycle the host saw when the key changed */
+    uint8_t key; /* 0x0 - 0xf */
+    uint8_t down;
+};
+
+struct c8_keyq
+{
+    c8_ring ring;
+    c8_key_event events[C8_KEYQ_SIZE];
+    /* posted on every push if set, so a host without an event loop of its own can
+    sleep in c8_keyq_wait while the machine is parked */
+    SDL_sem* wake;
+};
+
+static inline void c8_keyq_reset(c8_keyq* q)
+{
+    c8_ring_reset(&q->ring);
+}
+
+/* only needed for c8_keyq_wait. a zeroed queue works fine without it */
+static inline bool c8_keyq_init(c8_keyq* q)
+{
+    c8_ring_reset(&q->ring);
+    q->wake = SDL_CreateSemaphore(0);
+    return q->wake != NULL;
+}
+
+static inline void c8_keyq_destroy(c8_keyq* q)
+{
+    if (q->wake)
+        SDL_DestroySemaphore(q->wake);
+    q->wake = NULL;
+}
+
+/* host side. false if the machine has fallen that far behind, the key is dropped */
+static inline bool c8_keyq_push(c8_keyq* q, uint64_t cycle, uint8_t key, bool down)
+{
+    if (!c8_ring_free(&q->ring, C8_KEYQ_SIZE))
+        return false;
+    c8_key_event* e = &q->events[c8_ring_head_slot(&q->ring, C8_KEYQ_SIZE)];
+    e->cycle = cycle;
+    e->key = key & 0xf;
+    e->down = down;
+    c8_ring_publish(&q->ring, 1);
+    if (q->wake)
+        SDL_SemPost(q->wake);
+    return true;
+}
+
+/* machine side */
+static inline bool c8_keyq_pending(const c8_keyq* q)
+{
+    return q->ring.head != q->ring.tail;
+}
+
+static inline bool c8_keyq_pop(c8_keyq* q, c8_key_event* out)
+{
+    if (!c8_ring_avail(&q->ring))
+        return false;
+    *out = q->events[c8_ring_tail_slot(&q->ring, C8_KEYQ_SIZE)];
+    c8_ring_release(&q->ring, 1);
+    return true;
+}
+
+/* machine side. sleeps until a key is pushed or timeout_ms is up */
+static inline bool c8_keyq_wait(c8_keyq* q, uint32_t timeout_ms)
+{
+    if (c8_keyq_pending(q))
+        return true;
+    if (!q->wake)
+        return false;
+    SDL_SemWaitTimeout(q->wake, timeout_ms);
+    return c8_keyq_pending(q);
+}
@@ -0,0 +1,722 @@
+#include "c8_lanes.h"
+#include "c8_simd.h"
+#include "c8_pool.h"
+#include <SDL_cpuinfo.h>
+
+struct c8_lanes
+{
+    /* hot columns, entry n is lane n */
+    uint8_t v[16][C8_LANES_MAX];
+    uint8_t delay[C8_LANES_MAX];
+    uint8_t snd[C8_LANES_MAX];
+    uint16_t i[C8_LANES_MAX];
+    uint16_t pc[C8_LANES_MAX];
+    uint32_t rng[C8_LANES_MAX];
+    uint8_t timer_div[C8_LANES_MAX];
+    /* cycles each lane has run since c8_lanes_start, it has to get to target */
+    uint32_t ran[C8_LANES_MAX];
+    uint32_t target;
+    uint64_t start_cycles;
+
+    uint8_t nlanes;
+    uint32_t live;
+    /* sat on FX0A. nothing ever sends lanes a key so they just idle out each run */
+    uint32_t parked;
+    bool simd;
+
+    /* bit per address any lane has stored to. code fetched from anywhere else is the
+    same in every lane so only the first lane of a group gets read */
+    uint8_t written[C8_MEM_SIZE / 8];
+
+    uint64_t grouped;
+    uint64_t single;
+
+    /* everything else about each lane, out of the pool */
+    c8_pool* pool;
+    c8_machine* m[C8_LANES_MAX];
+};
+
+static uint16_t c8_lanes_op(const c8_state* s, uint16_t pc)
+{
+    return (uint16_t)((s->mem[pc & s->mem_mask] << 8) | s->mem[(pc + 1) & s->mem_mask]);
+}
+
+static uint8_t c8_lanes_first(uint32_t lanes)
+{
+    uint8_t l = 0;
+    while (!(lanes & 1))
+    {
+        lanes >>= 1;
+        ++l;
+    }
+    return l;
+}
+
+static uint32_t c8_lanes_count(uint32_t lanes)
+{
+    lanes = lanes - ((lanes >> 1) & 0x55555555u);
+    lanes = (lanes & 0x33333333u) + ((lanes >> 2) & 0x33333333u);
+    return (((lanes + (lanes >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24;
+}
+
+static void c8_lanes_to_machine(c8_lanes* ln, uint8_t l)
+{
+    c8_state* s = &ln->m[l]->s;
+    for (uint8_t r = 0; r < 16; ++r)
+        s->v[r] = ln->v[r][l];
+    s->i = ln->i[l];
+    s->pc = ln->pc[l];
+    s->delay = ln->delay[l];
+    s->snd = ln->snd[l];
+    s->rng = ln->rng[l];
+    s->timer_div = ln->timer_div[l];
+    s->cycles = ln->start_cycles + ln->ran[l];
+}
+
+static void c8_lanes_from_machine(c8_lanes* ln, uint8_t l)
+{
+    const c8_state* s = &ln->m[l]->s;
+    for (uint8_t r = 0; r < 16; ++r)
+        ln->v[r][l] = s->v[r];
+    ln->i[l] = s->i;
+    ln->pc[l] = s->pc;
+    ln->delay[l] = s->delay;
+    ln->snd[l] = s->snd;
+    ln->rng[l] = s->rng;
+    ln->timer_div[l] = s->timer_div;
+}
+
+static bool c8_lanes_is_written(const c8_lanes* ln, uint16_t addr)
+{
+    return (ln->written[addr >> 3] >> (addr & 7)) & 1;
+}
+
+/* whatever the op at pc is about to store to */
+static void c8_lanes_mark_stores(c8_lanes* ln, const c8_state* s)
+{
+    const uint16_t op = c8_lanes_op(s, s->pc);
+    const uint8_t x = (op >> 8) & 0xf;
+    const uint8_t y = (op >> 4) & 0xf;
+    uint16_t len = 0;
+    if ((op & 0xf0ff) == 0xf033)
+        len = 3;
+    else if ((op & 0xf0ff) == 0xf055)
+        len = x + 1;
+    else if ((op & 0xf00f) == 0x5002)
+        len = (x <= y ? y - x : x - y) + 1;
+    for (uint16_t n = 0; n < len; ++n)
+    {
+        const uint16_t a = (s->i + n) & s->mem_mask;
+        ln->written[a >> 3] |= (uint8_t)(1 << (a & 7));
+    }
+}
+
+/* a parked lane has nothing to do but let its timers run down to the target */
+static void c8_lanes_idle(c8_lanes* ln, uint8_t l)
+{
+    c8_machine* m = ln->m[l];
+    c8_lanes_to_machine(ln, l);
+    c8_idle(m, ln->target - ln->ran[l]);
+    ln->ran[l] = ln->target;
+    c8_lanes_from_machine(ln, l);
+}
+
+/* one op on a lanes own machine */
+static void c8_lanes_single(c8_lanes* ln, uint8_t l)
+{
+    c8_machine* m = ln->m[l];
+    c8_lanes_to_machine(ln, l);
+    c8_lanes_mark_stores(ln, &m->s);
+    c8_cycle(m);
+    ++ln->ran[l];
+    c8_lanes_from_machine(ln, l);
+    ++ln->single;
+
+    if (m->faulted)
+    {
+        ln->live &= ~(1u << l);
+    }
+    else if (m->s.key_wait)
+    {
+        ln->parked |= 1u << l;
+        c8_lanes_idle(ln, l);
+    }
+}
+
+/* no avx2, every lane runs c8_cycle. the registers only go out and back once */
+static void c8_lanes_run_single(c8_lanes* ln)
+{
+    for (uint8_t l = 0; l < ln->nlanes; ++l)
+    {
+        if (!(ln->live & (1u << l)))
+            continue;
+        c8_machine* m = ln->m[l];
+        c8_lanes_to_machine(ln, l);
+        const uint32_t from = ln->ran[l];
+        while (ln->ran[l] < ln->target && !m->faulted)
+        {
+            c8_cycle(m);
+            ++ln->ran[l];
+        }
+        c8_lanes_from_machine(ln, l);
+        if (m->faulted)
+            ln->live &= ~(1u << l);
+        ln->single += ln->ran[l] - from;
+    }
+}
+
+#if C8_X86
+
+/* most cycles a lane can get ahead of the slowest */
+#define C8_LANES_SLACK          (64)
+
+#define C8_LD(p)                _mm256_loadu_si256((const __m256i*)(p))
+#define C8_ST(p, x)             _mm256_storeu_si256((__m256i*)(p), (x))
+
+/* a group as blend masks for each column width */
+typedef struct
+{
+    __m256i b;
+    __m256i w[2];
+    __m256i d[4];
+} c8_lane_masks;
+
+C8_TARGET_AVX2
+static void c8_lanes_masks(c8_lane_masks* mk, uint32_t lanes)
+{
+    /* byte n gets bit n of lanes: spread byte n / 8 of it over eight bytes and test */
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bits = _mm256_setr_epi32(0x08040201, (int)0x80402010u, 0x08040201, (int)0x80402010u,
+        0x08040201, (int)0x80402010u, 0x08040201, (int)0x80402010u);
+    const __m256i b = _mm256_shuffle_epi8(_mm256_set1_epi32((int)lanes), spread);
+    mk->b = _mm256_cmpeq_epi8(_mm256_and_si256(b, bits), bits);
+
+    const __m128i lo = _mm256_castsi256_si128(mk->b);
+    const __m128i hi = _mm256_extracti128_si256(mk->b, 1);
+    mk->w[0] = _mm256_cvtepi8_epi16(lo);
+    mk->w[1] = _mm256_cvtepi8_epi16(hi);
+    mk->d[0] = _mm256_cvtepi8_epi32(lo);
+    mk->d[1] = _mm256_cvtepi8_epi32(_mm_srli_si128(lo, 8));
+    mk->d[2] = _mm256_cvtepi8_epi32(hi);
+    mk->d[3] = _mm256_cvtepi8_epi32(_mm_srli_si128(hi, 8));
+}
+
+C8_TARGET_AVX2
+static void c8_lanes_put8(uint8_t* col, __m256i val, const c8_lane_masks* mk)
+{
+    C8_ST(col, _mm256_blendv_epi8(C8_LD(col), val, mk->b));
+}
+
+C8_TARGET_AVX2
+static void c8_lanes_put16(uint16_t* col, __m256i lo, __m256i hi, const c8_lane_masks* mk)
+{
+    C8_ST(col, _mm256_blendv_epi8(C8_LD(col), lo, mk->w[0]));
+    C8_ST(col + 16, _mm256_blendv_epi8(C8_LD(col + 16), hi, mk->w[1]));
+}
+
+/* byte column widened to 16 bits, lanes 0 - 15 then 16 - 31 */
+C8_TARGET_AVX2
+static __m256i c8_lanes_widen(__m256i b, int half)
+{
+    return _mm256_cvtepu8_epi16(half ? _mm256_extracti128_si256(b, 1) : _mm256_castsi256_si128(b));
+}
+
+/* lanes sitting at pc */
+C8_TARGET_AVX2
+static uint32_t c8_lanes_at(const c8_lanes* ln, uint16_t pc)
+{
+    const __m256i p = _mm256_set1_epi16((short)pc);
+    const __m256i lo = _mm256_cmpeq_epi16(C8_LD(&ln->pc[0]), p);
+    const __m256i hi = _mm256_cmpeq_epi16(C8_LD(&ln->pc[16]), p);
+    /* packing interleaves the 128 bit halves, the permute puts the lanes back in order */
+    return (uint32_t)_mm256_movemask_epi8(_mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xd8));
+}
+
+/* ops a group can do together: registers, jumps, the stack while it stays in range.
+draws, memory, keys and the rest are left to c8_cycle */
+static bool c8_lanes_groupable(const c8_lanes* ln, uint32_t group, uint16_t pc, uint16_t op, uint16_t mask)
+{
+    const uint8_t nn = op & 0xff;
+    switch (op >> 12)
+    {
+    case 0x0:
+        if (op != 0x00ee)
+            return false;
+        /* fall through */
+    case 0x2:
+        for (uint8_t l = 0; l < ln->nlanes; ++l)
+        {
+            const uint16_t sp = ln->m[l]->s.sp;
+            if ((group & (1u << l)) && (op == 0x00ee ? sp == 0 : sp >= 15))
+                return false;
+        }
+        return true;
+    case 0x5:
+        if ((op & 0xf) == 2 || (op & 0xf) == 3)
+            return false;
+        /* fall through */
+    case 0x3:
+    case 0x4:
+    case 0x9:
+        /* the skip length depends on the op after, which has to be the same everywhere */
+        return !c8_lanes_is_written(ln, (pc + 2) & mask) && !c8_lanes_is_written(ln, (pc + 3) & mask);
+    case 0x1:
+    case 0x6:
+    case 0x7:
+    case 0x8:
+    case 0xa:
+    case 0xb:
+    case 0xc:
+        return true;
+    case 0xf:
+        return nn == 0x07 || nn == 0x15 || nn == 0x18 || nn == 0x1e || nn == 0x29 || nn == 0x30;
+    }
+    return false;
+}
+
+/* 8XYN for a group. like c8_handle_8op VF is written before VX, and VX is worked out
+from the registers after that so X or Y being F comes out the same */
+C8_TARGET_AVX2
+static void c8_lanes_group_8op(c8_lanes* ln, const c8_lane_masks* mk, uint8_t x, uint8_t y, uint8_t n)
+{
+    /* not ops, c8_handle_8op leaves them alone too */
+    if (n > 7 && n != 0xe)
+        return;
+
+    const __m256i one = _mm256_set1_epi8(1);
+    __m256i a = C8_LD(ln->v[x]);
+    __m256i b = C8_LD(ln->v[y]);
+    if (n >= 4)
+    {
+        __m256i f;
+        switch (n)
+        {
+        case 0x4:
+            /* carry out if the sum wrapped below a */
+            f = _mm256_add_epi8(a, b);
+            f = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(f, a), f), one);
+            break;
+        case 0x5:
+            f = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(a, b), b), one);
+            break;
+        case 0x6:
+            f = _mm256_and_si256(a, one);
+            break;
+        case 0x7:
+            f = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a), one);
+            break;
+        default:
+            f = _mm256_and_si256(_mm256_srli_epi16(a, 7), one);
+            break;
+        }
+        c8_lanes_put8(ln->v[0xf], f, mk);
+        a = C8_LD(ln->v[x]);
+        b = C8_LD(ln->v[y]);
+    }
+
+    __m256i r;
+    switch (n)
+    {
+    case 0x0:
+        r = b;
+        break;
+    case 0x1:
+        r = _mm256_or_si256(a, b);
+        break;
+    case 0x2:
+        r = _mm256_and_si256(a, b);
+        break;
+    case 0x3:
+        r = _mm256_xor_si256(a, b);
+        break;
+    case 0x4:
+        r = _mm256_add_epi8(a, b);
+        break;
+    case 0x5:
+        r = _mm256_sub_epi8(a, b);
+        break;
+    case 0x6:
+        r = _mm256_and_si256(_mm256_srli_epi16(a, 1), _mm256_set1_epi8(0x7f));
+        break;
+    case 0x7:
+        r = _mm256_sub_epi8(b, a);
+        break;
+    case 0xe:
+        r = _mm256_add_epi8(a, a);
+        break;
+    default:
+        return;
+    }
+    c8_lanes_put8(ln->v[x], r, mk);
+}
+
+/* CXNN, xorshift32 on every lanes generator like c8_random */
+C8_TARGET_AVX2
+static void c8_lanes_group_random(c8_lanes* ln, const c8_lane_masks* mk, uint8_t x, uint8_t nn)
+{
+    __m256i top[4];
+    for (int k = 0; k < 4; ++k)
+    {
+        __m256i r = C8_LD(&ln->rng[k * 8]);
+        r = _mm256_xor_si256(r, _mm256_slli_epi32(r, 13));
+        r = _mm256_xor_si256(r, _mm256_srli_epi32(r, 17));
+        r = _mm256_xor_si256(r, _mm256_slli_epi32(r, 5));
+        C8_ST(&ln->rng[k * 8], _mm256_blendv_epi8(C8_LD(&ln->rng[k * 8]), r, mk->d[k]));
+        top[k] = _mm256_srli_epi32(r, 24);
+    }
+    /* down to bytes. the packs work within 128 bit halves, the permute sorts the
+    four byte groups back into lane order */
+    const __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(top[0], top[1]), _mm256_packus_epi32(top[2], top[3]));
+    const __m256i bytes = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    c8_lanes_put8(ln->v[x], _mm256_and_si256(bytes, _mm256_set1_epi8((char)nn)), mk);
+}
+
+/* one op for every lane in group, all at pc. c8_lanes_groupable said it can */
+C8_TARGET_AVX2
+static void c8_lanes_group_op(c8_lanes* ln, const c8_lane_masks* mk, uint32_t group, uint16_t pc, uint16_t op, const c8_state* lead)
+{
+    const uint8_t x = (op >> 8) & 0xf;
+    const uint8_t y = (op >> 4) & 0xf;
+    const uint8_t n = op & 0xf;
+    const uint8_t nn = op & 0xff;
+    const uint16_t nnn = op & 0xfff;
+
+    /* pc moves on first, same as c8_decode_op */
+    const __m256i next = _mm256_set1_epi16((short)(pc + 2));
+    c8_lanes_put16(ln->pc, next, next, mk);
+
+    switch (op >> 12)
+    {
+    case 0x0:
+        /* 00EE */
+        for (uint8_t l = 0; l < ln->nlanes; ++l)
+        {
+            if (!(group & (1u << l)))
+                continue;
+            c8_state* s = &ln->m[l]->s;
+            ln->pc[l] = s->stack[s->sp];
+            --s->sp;
+        }
+        break;
+    case 0x2:
+        for (uint8_t l = 0; l < ln->nlanes; ++l)
+        {
+            if (!(group & (1u << l)))
+                continue;
+            c8_state* s = &ln->m[l]->s;
+            s->stack[++s->sp] = (uint16_t)(pc + 2);
+        }
+        /* fall through */
+    case 0x1:
+    {
+        const __m256i to = _mm256_set1_epi16((short)nnn);
+        c8_lanes_put16(ln->pc, to, to, mk);
+        break;
+    }
+    case 0x3:
+    case 0x4:
+    case 0x5:
+    case 0x9:
+    {
+        const uint8_t kind = op >> 12;
+        const __m256i a = C8_LD(ln->v[x]);
+        const __m256i eq = _mm256_cmpeq_epi8(a, kind == 3 || kind == 4 ? _mm256_set1_epi8((char)nn) : C8_LD(ln->v[y]));
+        __m256i skip;
+        if (kind == 3 || (kind == 5 && n == 0))
+            skip = eq;
+        else if (kind == 4 || kind == 9)
+            skip = _mm256_xor_si256(eq, _mm256_set1_epi8(-1));
+        else
+            break;
+        /* c8_skip, the op after is the same in every lane */
+        const uint16_t after = (uint16_t)(pc + 2);
+        const bool long_op = lead->mem[after & lead->mem_mask] == 0xf0 && lead->mem[(after + 1) & lead->mem_mask] == 0x00;
+        const __m256i len = _mm256_set1_epi16(long_op ? 4 : 2);
+        const __m256i lo = _mm256_add_epi16(next, _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_castsi256_si128(skip)), len));
+        const __m256i hi = _mm256_add_epi16(next, _mm256_and_si256(_mm256_cvtepi8_epi16(_mm256_extracti128_si256(skip, 1)), len));
+        c8_lanes_put16(ln->pc, lo, hi, mk);
+        break;
+    }
+    case 0x6:
+        c8_lanes_put8(ln->v[x], _mm256_set1_epi8((char)nn), mk);
+        break;
+    case 0x7:
+        c8_lanes_put8(ln->v[x], _mm256_add_epi8(C8_LD(ln->v[x]), _mm256_set1_epi8((char)nn)), mk);
+        break;
+    case 0x8:
+        c8_lanes_group_8op(ln, mk, x, y, n);
+        break;
+    case 0xa:
+    {
+        const __m256i to = _mm256_set1_epi16((short)nnn);
+        c8_lanes_put16(ln->i, to, to, mk);
+        break;
+    }
+    case 0xb:
+    {
+        const __m256i v0 = C8_LD(ln->v[0]);
+        const __m256i base = _mm256_set1_epi16((short)nnn);
+        c8_lanes_put16(ln->pc, _mm256_add_epi16(base, c8_lanes_widen(v0, 0)), _mm256_add_epi16(base, c8_lanes_widen(v0, 1)), mk);
+        break;
+    }
+    case 0xc:
+        c8_lanes_group_random(ln, mk, x, nn);
+        break;
+    case 0xf:
+    {
+        const __m256i vx = C8_LD(ln->v[x]);
+        switch (nn)
+        {
+        case 0x07:
+            c8_lanes_put8(ln->v[x], C8_LD(ln->delay), mk);
+            break;
+        case 0x15:
+            c8_lanes_put8(ln->delay, vx, mk);
+            break;
+        case 0x18:
+            /* lanes have no audio to tell */
+            c8_lanes_put8(ln->snd, vx, mk);
+            break;
+        case 0x1e:
+            c8_lanes_put16(ln->i, _mm256_add_epi16(C8_LD(&ln->i[0]), c8_lanes_widen(vx, 0)),
+                _mm256_add_epi16(C8_LD(&ln->i[16]), c8_lanes_widen(vx, 1)), mk);
+            break;
+        case 0x29:
+        case 0x30:
+        {
+            const __m256i digit = _mm256_and_si256(vx, _mm256_set1_epi8(0x0f));
+            const __m256i size = _mm256_set1_epi16(nn == 0x29 ? 5 : 10);
+            const __m256i base = _mm256_set1_epi16(nn == 0x29 ? C8_FONT_ADDR : C8_BIG_FONT_ADDR);
+            c8_lanes_put16(ln->i, _mm256_add_epi16(base, _mm256_mullo_epi16(c8_lanes_widen(digit, 0), size)),
+                _mm256_add_epi16(base, _mm256_mullo_epi16(c8_lanes_widen(digit, 1), size)), mk);
+            break;
+        }
+        }
+        break;
+    }
+    }
+}
+
+/* unsigned a < b per 32 bit lane, as a lane mask */
+C8_TARGET_AVX2
+static uint32_t c8_lanes_below(const uint32_t* col, uint32_t b)
+{
+    /* a == min(a, b - 1), b is never 0 */
+    const __m256i last = _mm256_set1_epi32((int)(b - 1));
+    uint32_t lanes = 0;
+    for (int k = 0; k < 4; ++k)
+    {
+        const __m256i a = C8_LD(&col[k * 8]);
+        const __m256i below = _mm256_cmpeq_epi32(_mm256_min_epu32(a, last), a);
+        lanes |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(below)) << (k * 8);
+    }
+    return lanes;
+}
+
+/* lanes that can go next: short of the target and not too far ahead of the one
+furthest behind, so a group that keeps winning cant run off and leave the rest to
+trickle along on their own afterwards */
+C8_TARGET_AVX2
+static uint32_t c8_lanes_ready(const c8_lanes* ln)
+{
+    const uint32_t ready = ln->live & ~ln->parked & c8_lanes_below(ln->ran, ln->target);
+    if (!ready)
+        return 0;
+
+    c8_lane_masks mk;
+    c8_lanes_masks(&mk, ready);
+    /* lanes not in it count as all ones */
+    const __m256i ones = _mm256_set1_epi32(-1);
+    __m256i low = ones;
+    for (int k = 0; k < 4; ++k)
+        low = _mm256_min_epu32(low, _mm256_or_si256(C8_LD(&ln->ran[k * 8]), _mm256_andnot_si256(mk.d[k], ones)));
+    __m128i m = _mm_min_epu32(_mm256_castsi256_si128(low), _mm256_extracti128_si256(low, 1));
+    m = _mm_min_epu32(m, _mm_shuffle_epi32(m, 0x4e));
+    m = _mm_min_epu32(m, _mm_shuffle_epi32(m, 0xb1));
+    const uint32_t first = (uint32_t)_mm_cvtsi128_si32(m);
+    return ready & c8_lanes_below(ln->ran, first + C8_LANES_SLACK);
+}
+
+C8_TARGET_AVX2
+static void c8_lanes_step_avx2(c8_lanes* ln, uint32_t ready)
+{
+    /* the biggest group of lanes on one pc goes, the rest wait their turn. lanes that
+    drifted apart pile up behind the busiest pc and fall back into step with it */
+    uint32_t group = 0;
+    uint32_t size = 0;
+    for (uint32_t todo = ready; todo && c8_lanes_count(todo) > size;)
+    {
+        const uint32_t at = c8_lanes_at(ln, ln->pc[c8_lanes_first(todo)]) & todo;
+        const uint32_t n = c8_lanes_count(at);
+        if (n > size)
+        {
+            group = at;
+            size = n;
+        }
+        todo &= ~at;
+    }
+
+    const uint8_t lead = c8_lanes_first(group);
+    const uint16_t pc = ln->pc[lead];
+    const c8_state* s = &ln->m[lead]->s;
+    const uint16_t op = c8_lanes_op(s, pc);
+    if (c8_lanes_is_written(ln, pc & s->mem_mask) || c8_lanes_is_written(ln, (pc + 1) & s->mem_mask))
+    {
+        /* something stored over the code here, lanes with some other op wait */
+        for (uint8_t l = lead + 1; l < ln->nlanes; ++l)
+        {
+            if ((group & (1u << l)) && c8_lanes_op(&ln->m[l]->s, pc) != op)
+                group &= ~(1u << l);
+        }
+    }
+
+    /* one lane is quicker on its own */
+    if (!(group & (group - 1)) || !c8_lanes_groupable(ln, group, pc, op, s->mem_mask))
+    {
+        for (uint8_t l = lead; group; ++l)
+        {
+            if (group & (1u << l))
+            {
+                c8_lanes_single(ln, l);
+                group &= ~(1u << l);
+            }
+        }
+        return;
+    }
+
+    c8_lane_masks mk;
+    c8_lanes_masks(&mk, group);
+    c8_lanes_group_op(ln, &mk, group, pc, op, s);
+
+    /* then c8_timers, and the cycle is done */
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i div = _mm256_add_epi8(C8_LD(ln->timer_div), one);
+    const __m256i tick = _mm256_cmpeq_epi8(div, _mm256_set1_epi8(C8_CYCLES_PER_FRAME));
+    const __m256i dec = _mm256_and_si256(tick, one);
+    c8_lanes_put8(ln->timer_div, _mm256_andnot_si256(tick, div), &mk);
+    c8_lanes_put8(ln->delay, _mm256_subs_epu8(C8_LD(ln->delay), dec), &mk);
+    c8_lanes_put8(ln->snd, _mm256_subs_epu8(C8_LD(ln->snd), dec), &mk);
+    /* the mask is -1 in the group */
+    for (int k = 0; k < 4; ++k)
+        C8_ST(&ln->ran[k * 8], _mm256_sub_epi32(C8_LD(&ln->ran[k * 8]), mk.d[k]));
+    ln->grouped += c8_lanes_count(group);
+}
+
+#endif
+
+c8_lanes* c8_lanes_create(void)
+{
+    c8_lanes* ln = calloc(1, sizeof(c8_lanes));
+    if (!ln)
+        return NULL;
+    /* one block for all the lanes machines, they get walked one after another */
+    ln->pool = c8_pool_create(C8_LANES_MAX);
+    if (!ln->pool)
+    {
+        free(ln);
+        return NULL;
+    }
+    /* attached so a faulting lane stops quietly, the lanes report it */
+    for (uint8_t l = 0; l < C8_LANES_MAX; ++l)
+    {
+        ln->m[l] = c8_pool_acquire(ln->pool);
+        c8_debug_attach(ln->m[l], true);
+    }
+#if C8_X86
+    ln->simd = SDL_HasAVX2() == SDL_TRUE;
+#endif
+    return ln;
+}
+
+void c8_lanes_destroy(c8_lanes* ln)
+{
+    if (!ln)
+        return;
+    c8_pool_destroy(ln->pool);
+    free(ln);
+}
+
+void c8_lanes_start(c8_lanes* ln, const c8_machine* base, uint8_t nlanes, const uint32_t* seeds)
+{
+    if (nlanes > C8_LANES_MAX)
+        nlanes = C8_LANES_MAX;
+
+    /* columns past nlanes stay zero, never live so never looked at */
+    memset(ln->v, 0, sizeof(ln->v));
+    memset(ln->delay, 0, sizeof(ln->delay));
+    memset(ln->snd, 0, sizeof(ln->snd));
+    memset(ln->i, 0, sizeof(ln->i));
+    memset(ln->pc, 0, sizeof(ln->pc));
+    memset(ln->rng, 0, sizeof(ln->rng));
+    memset(ln->timer_div, 0, sizeof(ln->timer_div));
+    memset(ln->ran, 0, sizeof(ln->ran));
+    memset(ln->written, 0, sizeof(ln->written));
+    ln->target = 0;
+    ln->start_cycles = base->s.cycles;
+    ln->nlanes = nlanes;
+    ln->live = nlanes == 32 ? 0xffffffffu : (1u << nlanes) - 1;
+    ln->parked = 0;
+    ln->grouped = 0;
+    ln->single = 0;
+
+    for (uint8_t l = 0; l < nlanes; ++l)
+    {
+        c8_machine* m = ln->m[l];
+        c8_state_copy(&m->s, &base->s);
+        m->initd = base->initd;
+        m->rom_loaded = base->rom_loaded;
+        m->rom_size = base->rom_size;
+        m->gfx_dirty = false;
+        c8_debug_attach(m, true);
+        c8_seed(m, seeds[l]);
+        c8_lanes_from_machine(ln, l);
+        if (m->s.key_wait)
+            ln->parked |= 1u << l;
+    }
+}
+
+void c8_lanes_run(c8_lanes* ln, uint32_t ncycles)
+{
+    if (!ncycles)
+        return;
+    ln->target += ncycles;
+#if C8_X86
+    if (ln->simd)
+    {
+        for (uint8_t l = 0; l < ln->nlanes; ++l)
+        {
+            if (ln->live & ln->parked & (1u << l))
+                c8_lanes_idle(ln, l);
+        }
+        for (;;)
+        {
+            const uint32_t ready = c8_lanes_ready(ln);
+            if (!ready)
+                break;
+            c8_lanes_step_avx2(ln, ready);
+        }
+        return;
+    }
+#endif
+    c8_lanes_run_single(ln);
+}
+
+const c8_machine* c8_lanes_machine(c8_lanes* ln, uint8_t lane)
+{
+    /* a lane that stopped has its machine as it was when it did */
+    if (ln->live & (1u << lane))
+        c8_lanes_to_machine(ln, lane);
+    return ln->m[lane];
+}
+
+uint32_t c8_lanes_live(const c8_lanes* ln)
+{
+    return ln->live;
+}
+
+void c8_lanes_stats(const c8_lanes* ln, uint64_t* grouped, uint64_t* single)
+{
+    *grouped = ln->grouped;
+    *single = ln->single;
+}
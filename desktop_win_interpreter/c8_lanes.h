@@ -0,0 +1,36 @@
+#pragma once
+#include "c8.h"
+
+/* many copies of one rom run side by side, for seed sweeps. every lane is a whole
+c8_machine but the registers every op touches - V, I, PC, DT, ST and the CXNN
+generator - are pulled out into columns, one entry a lane, so one avx2 op does the
+same thing for up to 32 of them.
+
+each step the biggest group of lanes sitting on the same pc runs one op. if it only
+touches those registers the whole group does it at once, anything else - draws,
+memory, the stack past its ends, keys - goes through c8_cycle lane by lane. lanes
+that went different ways at a skip wait behind the busiest pc until they land on it
+again, but never get more than a little way ahead of the slowest lane. without avx2
+every lane just runs c8_cycle.
+
+lanes have their own cycle counts, a run gives each of them the same number of
+cycles. a lane that faults stops, the others carry on */
+
+#define C8_LANES_MAX            (32)
+
+typedef struct c8_lanes c8_lanes;
+
+c8_lanes* c8_lanes_create(void);
+void c8_lanes_destroy(c8_lanes* ln);
+
+/* nlanes copies of base (loaded and c8_init'd), lane n seeded with seeds[n] */
+void c8_lanes_start(c8_lanes* ln, const c8_machine* base, uint8_t nlanes, const uint32_t* seeds);
+void c8_lanes_run(c8_lanes* ln, uint32_t ncycles);
+
+/* the whole machine for a lane, registers brought back up to date */
+const c8_machine* c8_lanes_machine(c8_lanes* ln, uint8_t lane);
+/* bit per lane still going */
+uint32_t c8_lanes_live(const c8_lanes* ln);
+
+/* lane-ops run as a group and one lane at a time since start */
+void c8_lanes_stats(const c8_lanes* ln, uint64_t* grouped, uint64_t* single);
@@ -0,0 +1,185 @@
+#include "c8_net.h"
+
+#if defined _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+#define c8_net_would_block()    (WSAGetLastError() == WSAEWOULDBLOCK)
+#define c8_net_closesocket      closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+typedef int SOCKET;
+#define c8_net_would_block()    (errno == EAGAIN || errno == EWOULDBLOCK)
+#define c8_net_closesocket      close
+#endif
+
+/* a peer that hung up turns the next send into a SIGPIPE, which kills the whole
+emulator. linux says no per send, macos per socket (SO_NOSIGPIPE at accept) */
+#if defined MSG_NOSIGNAL
+#define C8_NET_SEND_FLAGS       (MSG_NOSIGNAL)
+#else
+#define C8_NET_SEND_FLAGS       (0)
+#endif
+
+/* a peer that stops reading gets this long to make room before it counts as gone */
+#define C8_NET_SEND_TIMEOUT_MS  (2000)
+
+static bool c8_net_set_nonblocking(SOCKET s)
+{
+#if defined _WIN32
+    u_long on = 1;
+    return ioctlsocket(s, FIONBIO, &on) == 0;
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+bool c8_net_init(void)
+{
+#if defined _WIN32
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+#else
+    return true;
+#endif
+}
+
+void c8_net_quit(void)
+{
+#if defined _WIN32
+    WSACleanup();
+#endif
+}
+
+c8_sock c8_net_tcp_listen(uint16_t port)
+{
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if ((c8_sock)s == C8_SOCK_INVALID)
+        return C8_SOCK_INVALID;
+
+    int on = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, 1) != 0 || !c8_net_set_nonblocking(s))
+    {
+        c8_net_closesocket(s);
+        return C8_SOCK_INVALID;
+    }
+    return (c8_sock)s;
+}
+
+c8_sock c8_net_tcp_accept(c8_sock listener)
+{
+    SOCKET s = accept((SOCKET)listener, NULL, NULL);
+    if ((c8_sock)s == C8_SOCK_INVALID)
+        return C8_SOCK_INVALID;
+
+    /* debugger packets are tiny and latency is everything */
+    int on = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+#if defined SO_NOSIGPIPE
+    setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&on, sizeof(on));
+#endif
+    c8_net_set_nonblocking(s);
+    return (c8_sock)s;
+}
+
+c8_sock c8_net_udp_open(uint16_t port)
+{
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if ((c8_sock)s == C8_SOCK_INVALID)
+        return C8_SOCK_INVALID;
+
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) != 0 || !c8_net_set_nonblocking(s))
+    {
+        c8_net_closesocket(s);
+        return C8_SOCK_INVALID;
+    }
+    return (c8_sock)s;
+}
+
+bool c8_net_udp_connect(c8_sock s, uint16_t port)
+{
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return connect((SOCKET)s, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+}
+
+uint16_t c8_net_port(c8_sock s)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t len = sizeof(addr);
+    if (getsockname((SOCKET)s, (struct sockaddr*)&addr, &len) != 0)
+        return 0;
+    return ntohs(addr.sin_port);
+}
+
+bool c8_net_wait(c8_sock s, int timeout_ms)
+{
+    fd_set rd;
+    FD_ZERO(&rd);
+    FD_SET((SOCKET)s, &rd);
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    return select((int)((SOCKET)s + 1), &rd, NULL, NULL, &tv) > 0;
+}
+
+int c8_net_recv(c8_sock s, void* buf, int len)
+{
+    int got = (int)recv((SOCKET)s, (char*)buf, len, 0);
+    if (got < 0)
+        return c8_net_would_block() ? -1 : 0;
+    return got;
+}
+
+bool c8_net_send(c8_sock s, const void* buf, int len)
+{
+    const char* p = buf;
+    while (len > 0)
+    {
+        int sent = (int)send((SOCKET)s, p, len, C8_NET_SEND_FLAGS);
+        if (sent < 0)
+        {
+            if (!c8_net_would_block())
+                return false;
+            /* socket is non blocking, wait for room. not forever, the frontend is
+            stuck in here until it comes */
+            fd_set wr;
+            FD_ZERO(&wr);
+            FD_SET((SOCKET)s, &wr);
+            struct timeval tv = { C8_NET_SEND_TIMEOUT_MS / 1000, (C8_NET_SEND_TIMEOUT_MS % 1000) * 1000 };
+            if (select((int)((SOCKET)s + 1), NULL, &wr, NULL, &tv) <= 0)
+                return false;
+            continue;
+        }
+        p += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+void c8_net_close(c8_sock s)
+{
+    if (s != C8_SOCK_INVALID)
+        c8_net_closesocket((SOCKET)s);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/* tiny socket wrapper so the debugger stub and netplay dont care about winsock vs bsd
+sockets. everything listens on loopback only */
+
+typedef uintptr_t c8_sock;
+#define C8_SOCK_INVALID         ((c8_sock)~(uintptr_t)0)
+
+bool c8_net_init(void);
+void c8_net_quit(void);
+
+/* non blocking listener on 127.0.0.1:port */
+c8_sock c8_net_tcp_listen(uint16_t port);
+/* C8_SOCK_INVALID if nobody is waiting */
+c8_sock c8_net_tcp_accept(c8_sock listener);
+
+/* non blocking udp on 127.0.0.1:port, 0 for whatever port is free */
+c8_sock c8_net_udp_open(uint16_t port);
+/* only to and from 127.0.0.1:port from now on, send and recv then work a datagram at a time */
+bool c8_net_udp_connect(c8_sock s, uint16_t port);
+/* the local port s ended up on */
+uint16_t c8_net_port(c8_sock s);
+
+/* wait up to timeout_ms for s to have something to read */
+bool c8_net_wait(c8_sock s, int timeout_ms);
+/* > 0 bytes read, 0 peer closed, -1 nothing there right now */
+int c8_net_recv(c8_sock s, void* buf, int len);
+/* sends all of it, false if the peer went away or hasnt read anything for a couple
+of seconds - drop it then */
+bool c8_net_send(c8_sock s, const void* buf, int len);
+void c8_net_close(c8_sock s);
@@ -0,0 +1,195 @@
+#if !defined _WIN32
+#define _DEFAULT_SOURCE
+#endif
+#include "c8_pool.h"
+
+#if defined _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define C8_POOL_HUGE_PAGE       (2 * 1024 * 1024)
+
+struct c8_pool
+{
+    uint8_t* block;
+    size_t block_size;
+    size_t stride;
+    uint32_t nmachines;
+    bool huge;
+    /* free slot numbers, top of the stack is handed out next */
+    uint32_t* free_slots;
+    uint32_t nfree;
+};
+
+#if defined _WIN32
+
+/* large pages need SeLockMemoryPrivilege held and switched on, most accounts only
+have it if someone went and granted it */
+static bool c8_pool_lock_privilege(void)
+{
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+        return false;
+    TOKEN_PRIVILEGES tp;
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    /* AdjustTokenPrivileges says yes even when it didnt, last error says otherwise */
+    const bool ok = LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &tp.Privileges[0].Luid) &&
+        AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL) && GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return ok;
+}
+
+static void* c8_pool_map(size_t* size, bool* huge)
+{
+    const size_t large = GetLargePageMinimum();
+    if (large && c8_pool_lock_privilege())
+    {
+        const size_t rounded = (*size + large - 1) & ~(large - 1);
+        void* p = VirtualAlloc(NULL, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (p)
+        {
+            *size = rounded;
+            *huge = true;
+            return p;
+        }
+    }
+    *huge = false;
+    return VirtualAlloc(NULL, *size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+static void c8_pool_unmap(void* p, size_t size)
+{
+    VirtualFree(p, 0, MEM_RELEASE);
+}
+
+#else
+
+static void* c8_pool_map(size_t* size, bool* huge)
+{
+    *size = (*size + C8_POOL_HUGE_PAGE - 1) & ~(size_t)(C8_POOL_HUGE_PAGE - 1);
+    void* p;
+#if defined MAP_HUGETLB
+    /* only works if hugetlbfs pages were set aside */
+    p = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+    {
+        *huge = true;
+        return p;
+    }
+#endif
+    /* transparent huge pages only go on 2mb aligned runs, so map a page extra and
+    trim to the boundary */
+    p = mmap(NULL, *size + C8_POOL_HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    const size_t head = (C8_POOL_HUGE_PAGE - (uintptr_t)p % C8_POOL_HUGE_PAGE) % C8_POOL_HUGE_PAGE;
+    if (head)
+        munmap(p, head);
+    munmap((uint8_t*)p + head + *size, C8_POOL_HUGE_PAGE - head);
+    p = (uint8_t*)p + head;
+    *huge = false;
+#if defined MADV_HUGEPAGE
+    /* otherwise ask for transparent ones, the kernel backs whatever 2mb runs it can */
+    *huge = madvise(p, *size, MADV_HUGEPAGE) == 0;
+#endif
+    return p;
+}
+
+static void c8_pool_unmap(void* p, size_t size)
+{
+    munmap(p, size);
+}
+
+#endif
+
+c8_pool* c8_pool_create(uint32_t nmachines)
+{
+    if (!nmachines)
+        return NULL;
+    c8_pool* p = calloc(1, sizeof(c8_pool));
+    if (!p)
+        return NULL;
+
+    p->nmachines = nmachines;
+    p->stride = (sizeof(c8_machine) + 63) & ~(size_t)63;
+    p->block_size = p->stride * nmachines;
+    p->free_slots = malloc(sizeof(uint32_t) * nmachines);
+    /* fresh pages are zero, so a slot never handed out is already a zeroed machine */
+    p->block = p->free_slots ? c8_pool_map(&p->block_size, &p->huge) : NULL;
+    if (!p->block)
+    {
+        fprintf(stderr, "c8_pool: out of memory for %u machines\n", nmachines);
+        free(p->free_slots);
+        free(p);
+        return NULL;
+    }
+
+    /* slot 0 on top so they go out in address order */
+    for (uint32_t n = 0; n < nmachines; ++n)
+        p->free_slots[n] = nmachines - 1 - n;
+    p->nfree = nmachines;
+    return p;
+}
+
+void c8_pool_destroy(c8_pool* p)
+{
+    if (!p)
+        return;
+    /* anyone still out might have history hanging off them */
+    for (uint32_t n = 0; n < p->nmachines; ++n)
+    {
+        c8_machine* m = (c8_machine*)(p->block + n * p->stride);
+        if (m->history)
+            c8_reverse_enable(m, false);
+    }
+    c8_pool_unmap(p->block, p->block_size);
+    free(p->free_slots);
+    free(p);
+}
+
+c8_machine* c8_pool_acquire(c8_pool* p)
+{
+    if (!p->nfree)
+        return NULL;
+    return (c8_machine*)(p->block + p->free_slots[--p->nfree] * p->stride);
+}
+
+void c8_pool_release(c8_pool* p, c8_machine* m)
+{
+    if (!m)
+        return;
+    const size_t off = (size_t)((uint8_t*)m - p->block);
+    if (off >= p->stride * p->nmachines || off % p->stride || p->nfree == p->nmachines)
+    {
+        fprintf(stderr, "c8_pool_release: machine isnt out of this pool\n");
+        return;
+    }
+
+    c8_reverse_enable(m, false);
+
+    /* back to zero, but only what was used. the debug flags only if some are set -
+    armed counts register watches too */
+    uint32_t flags_set = m->debug_armed;
+    for (uint16_t w = m->reg_watch; w; w &= w - 1)
+        --flags_set;
+    if (flags_set)
+        memset(m->debug_flags, 0, sizeof(m->debug_flags));
+    /* memory past the mask can still have an old xo-chip rom in it, but nothing can
+    reach it and c8_load_rom clears as much as the next rom can */
+    memset(m, 0, offsetof(c8_machine, s) + c8_state_size(&m->s));
+
+    p->free_slots[p->nfree++] = (uint32_t)(off / p->stride);
+}
+
+uint32_t c8_pool_free_count(const c8_pool* p)
+{
+    return p->nfree;
+}
+
+bool c8_pool_huge(const c8_pool* p)
+{
+    return p->huge;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "c8.h"
+
+/* lots of machines out of one big block, for batch runs that go through thousands of
+roms. the block comes in 2mb pages where the os will give them, so one tlb entry
+covers a dozen machines instead of every machine needing a few of its own, and
+there's no heap churn between jobs.
+
+machines sit back to back, each hot at the front and cold at the back (see
+c8_machine), so a 4k rom only touches the first few kb of its slot. acquire and
+release are a pop and push on a free list, the last machine released is the next
+one handed out while its cache lines are still warm */
+
+typedef struct c8_pool c8_pool;
+
+c8_pool* c8_pool_create(uint32_t nmachines);
+void c8_pool_destroy(c8_pool* p);
+
+/* a zeroed machine, NULL when they're all out */
+c8_machine* c8_pool_acquire(c8_pool* p);
+/* back in the pool. its history goes with it, keyq and audio belong to the host */
+void c8_pool_release(c8_pool* p, c8_machine* m);
+
+uint32_t c8_pool_free_count(const c8_pool* p);
+/* whether the os gave large pages, otherwise its plain 4k ones */
+bool c8_pool_huge(const c8_pool* p);
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL_atomic.h>
+
+/* single producer / single consumer ring indices. the slots themselves live wherever
+the user wants them, this only tracks head and tail. capacity must be a power of two.
+head is only ever written by the producer and tail only by the consumer so no locks,
+just barriers around publishing */
+typedef struct
+{
+    volatile uint32_t head;
+    uint8_t pad0[60]; /* keep producer and consumer off each others cache line */
+    volatile uint32_t tail;
+    uint8_t pad1[60];
+} c8_ring;
+
+static inline void c8_ring_reset(c8_ring* r)
+{
+    r->head = 0;
+    r->tail = 0;
+}
+
+/* producer side - how many slots can be written right now */
+static inline uint32_t c8_ring_free(const c8_ring* r, uint32_t cap)
+{
+    uint32_t tail = r->tail;
+    SDL_MemoryBarrierAcquire();
+    return cap - (r->head - tail);
+}
+
+/* producer side - slot index for the next write */
+static inline uint32_t c8_ring_head_slot(const c8_ring* r, uint32_t cap)
+{
+    return r->head & (cap - 1);
+}
+
+/* producer side - make n written slots visible to the consumer */
+static inline void c8_ring_publish(c8_ring* r, uint32_t n)
+{
+    SDL_MemoryBarrierRelease();
+    r->head = r->head + n;
+}
+
+/* consumer side - how many slots are ready to read */
+static inline uint32_t c8_ring_avail(const c8_ring* r)
+{
+    uint32_t head = r->head;
+    SDL_MemoryBarrierAcquire();
+    return head - r->tail;
+}
+
+/* consumer side - slot index for the next read */
+static inline uint32_t c8_ring_tail_slot(const c8_ring* r, uint32_t cap)
+{
+    return r->tail & (cap - 1);
+}
+
+/* consumer side - hand n read slots back to the producer */
+static inline void c8_ring_release(c8_ring* r, uint32_t n)
+{
+    SDL_MemoryBarrierRelease();
+    r->tail = r->tail + n;
+}
@@ -0,0 +1,343 @@
+#include "c8_rollback.h"
+
+#define C8_ROLLBACK_MAGIC       (0x42523843) /* "C8RB" */
+#define C8_ROLLBACK_MASK        (C8_ROLLBACK_WINDOW - 1)
+/* magic, first frame, count, ack, checked frame, hash, then the keys */
+#define C8_ROLLBACK_HEADER      (4 + 4 + 1 + 4 + 4 + 8)
+#define C8_ROLLBACK_PACKET_MAX  (C8_ROLLBACK_HEADER + 2 * C8_ROLLBACK_WINDOW)
+/* packets held back by send_delay_ms, a power of two */
+#define C8_ROLLBACK_DELAYQ      (256)
+
+typedef struct
+{
+    uint64_t due;
+    uint16_t len;
+    uint8_t data[C8_ROLLBACK_PACKET_MAX];
+} c8_rollback_delayed;
+
+struct c8_rollback
+{
+    c8_rollback_opts o;
+    c8_machine* m;
+    c8_sock sock;
+    bool connected;
+
+    /* everything below is a ring indexed by frame & C8_ROLLBACK_MASK */
+    uint8_t* snaps;         /* state at the start of each frame */
+    size_t snap_size;
+    uint64_t hash[C8_ROLLBACK_WINDOW];  /* c8_state_hash at the start of each frame */
+    uint16_t local[C8_ROLLBACK_WINDOW];
+    /* real keys below remote_have, the guess that was used above it */
+    uint16_t remote[C8_ROLLBACK_WINDOW];
+
+    uint32_t frame;         /* the next one to run */
+    uint32_t remote_have;   /* the other side's keys are known for every frame before this */
+    uint32_t acked;         /* the other side has ours for every frame before this */
+    uint32_t rewind;        /* first frame that ran on a wrong guess, frame when none did */
+    /* the other side's hash to compare once we've got that far for real */
+    uint32_t check_frame;
+    uint64_t check_hash;
+    bool check_pending;
+
+    uint64_t last_send_ms;
+
+    c8_rollback_delayed* delayq;
+    uint32_t delay_head;
+    uint32_t delay_tail;
+
+    c8_rollback_stats stats;
+};
+
+static void c8_rollback_put32(uint8_t* p, uint32_t v)
+{
+    for (uint8_t b = 0; b < 4; ++b)
+        p[b] = (uint8_t)(v >> (b * 8));
+}
+
+static uint32_t c8_rollback_get32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static c8_state* c8_rollback_snap(const c8_rollback* r, uint32_t frame)
+{
+    return (c8_state*)(r->snaps + (frame & C8_ROLLBACK_MASK) * r->snap_size);
+}
+
+static uint64_t c8_rollback_now(void)
+{
+    return SDL_GetPerformanceCounter() / (SDL_GetPerformanceFrequency() / 1000);
+}
+
+/* snapshot, both sides' keys, one frame */
+static void c8_rollback_run_frame(c8_rollback* r, uint32_t frame)
+{
+    c8_machine* m = r->m;
+    const uint32_t at = frame & C8_ROLLBACK_MASK;
+    c8_state_copy(c8_rollback_snap(r, frame), &m->s);
+    c8_set_keys(m, (uint16_t)((r->local[at] & r->o.local_mask) | (r->remote[at] & r->o.remote_mask)));
+    c8_run(m, C8_CYCLES_PER_FRAME);
+    r->hash[(frame + 1) & C8_ROLLBACK_MASK] = c8_state_hash(&m->s);
+}
+
+/* they're still holding whatever they last held */
+static uint16_t c8_rollback_guess(const c8_rollback* r)
+{
+    return r->remote_have ? r->remote[(r->remote_have - 1) & C8_ROLLBACK_MASK] : 0;
+}
+
+static void c8_rollback_rewind(c8_rollback* r)
+{
+    if (r->rewind >= r->frame)
+        return;
+    const uint64_t t0 = SDL_GetPerformanceCounter();
+    const uint32_t depth = r->frame - r->rewind;
+
+    c8_state_copy(&r->m->s, c8_rollback_snap(r, r->rewind));
+    /* a fault on a wrong guess never happened. a real one is still in the snapshot's
+       pc and comes straight back */
+    c8_fault_clear(r->m);
+    const uint16_t guess = c8_rollback_guess(r);
+    for (uint32_t f = r->rewind; f < r->frame; ++f)
+    {
+        /* frames still ahead of what we know get the newest guess */
+        if (f >= r->remote_have)
+            r->remote[f & C8_ROLLBACK_MASK] = guess;
+        c8_rollback_run_frame(r, f);
+    }
+    r->m->gfx_dirty = true;
+
+    ++r->stats.rollbacks;
+    r->stats.resimulated += depth;
+    if (depth > r->stats.max_depth)
+        r->stats.max_depth = depth;
+    r->stats.rollback_secs += (double)(SDL_GetPerformanceCounter() - t0) / (double)SDL_GetPerformanceFrequency();
+    r->rewind = r->frame;
+}
+
+static void c8_rollback_receive(c8_rollback* r, const uint8_t* p, int len)
+{
+    if (len < C8_ROLLBACK_HEADER || c8_rollback_get32(p) != C8_ROLLBACK_MAGIC)
+        return;
+    const uint32_t first = c8_rollback_get32(p + 4);
+    const uint8_t count = p[8];
+    if (len < C8_ROLLBACK_HEADER + 2 * count)
+        return;
+    ++r->stats.packets_in;
+
+    const uint32_t ack = c8_rollback_get32(p + 9);
+    if (ack > r->acked && ack <= r->frame)
+        r->acked = ack;
+
+    for (uint32_t n = 0; n < count; ++n)
+    {
+        const uint32_t f = first + n;
+        /* only the next one we're missing, anything after a gap comes again */
+        if (f != r->remote_have)
+            continue;
+        /* it'd land on a slot thats still in use */
+        if (f >= r->frame + C8_ROLLBACK_WINDOW / 2)
+            break;
+        const uint16_t keys = (uint16_t)(p[C8_ROLLBACK_HEADER + n * 2] | p[C8_ROLLBACK_HEADER + n * 2 + 1] << 8);
+        const uint32_t at = f & C8_ROLLBACK_MASK;
+        /* a frame already run on a guess, only worth going back for if the guess
+        changed something the machine can see */
+        if (f < r->frame && ((r->remote[at] ^ keys) & r->o.remote_mask) && f < r->rewind)
+            r->rewind = f;
+        r->remote[at] = keys;
+        ++r->remote_have;
+    }
+
+    r->check_frame = c8_rollback_get32(p + 13);
+    r->check_hash = 0;
+    for (uint8_t b = 0; b < 8; ++b)
+        r->check_hash |= (uint64_t)p[17 + b] << (b * 8);
+    r->check_pending = true;
+}
+
+/* the other side's hash is for a frame start they had all the keys for. once ours is
+too, and not so long ago it's left the ring, they have to agree */
+static void c8_rollback_check(c8_rollback* r)
+{
+    if (!r->check_pending || r->check_frame > r->frame || r->check_frame > r->remote_have)
+        return;
+    r->check_pending = false;
+    if (r->check_frame + C8_ROLLBACK_WINDOW <= r->frame)
+        return;
+    ++r->stats.hashes_checked;
+    if (r->hash[r->check_frame & C8_ROLLBACK_MASK] != r->check_hash)
+    {
+        if (!r->stats.desyncs)
+            fprintf(stderr, "c8_rollback: out of sync with the other side at frame %u\n", r->check_frame);
+        ++r->stats.desyncs;
+    }
+}
+
+static void c8_rollback_flush(c8_rollback* r)
+{
+    const uint64_t now = c8_rollback_now();
+    while (r->delay_tail != r->delay_head)
+    {
+        const c8_rollback_delayed* d = &r->delayq[r->delay_tail & (C8_ROLLBACK_DELAYQ - 1)];
+        if (d->due > now)
+            break;
+        c8_net_send(r->sock, d->data, d->len);
+        ++r->delay_tail;
+    }
+}
+
+/* every key of ours they havent acknowledged, and our hash for the last frame start
+we have everything before */
+static void c8_rollback_send(c8_rollback* r)
+{
+    if (!r->connected)
+        return;
+    uint32_t first = r->acked;
+    if (r->frame - first > C8_ROLLBACK_WINDOW)
+        first = r->frame - C8_ROLLBACK_WINDOW;
+    const uint32_t count = r->frame - first;
+    const uint32_t checked = r->frame < r->remote_have ? r->frame : r->remote_have;
+
+    uint8_t p[C8_ROLLBACK_PACKET_MAX];
+    c8_rollback_put32(p, C8_ROLLBACK_MAGIC);
+    c8_rollback_put32(p + 4, first);
+    p[8] = (uint8_t)count;
+    c8_rollback_put32(p + 9, r->remote_have);
+    c8_rollback_put32(p + 13, checked);
+    const uint64_t hash = r->hash[checked & C8_ROLLBACK_MASK];
+    for (uint8_t b = 0; b < 8; ++b)
+        p[17 + b] = (uint8_t)(hash >> (b * 8));
+    for (uint32_t n = 0; n < count; ++n)
+    {
+        const uint16_t keys = r->local[(first + n) & C8_ROLLBACK_MASK];
+        p[C8_ROLLBACK_HEADER + n * 2] = (uint8_t)keys;
+        p[C8_ROLLBACK_HEADER + n * 2 + 1] = (uint8_t)(keys >> 8);
+    }
+    const uint16_t len = (uint16_t)(C8_ROLLBACK_HEADER + count * 2);
+    ++r->stats.packets_out;
+    r->last_send_ms = c8_rollback_now();
+
+    if (!r->o.send_delay_ms)
+    {
+        c8_net_send(r->sock, p, len);
+        return;
+    }
+    /* a full queue drops it, same as a congested link would */
+    if (r->delay_head - r->delay_tail >= C8_ROLLBACK_DELAYQ)
+        return;
+    c8_rollback_delayed* d = &r->delayq[r->delay_head++ & (C8_ROLLBACK_DELAYQ - 1)];
+    d->due = c8_rollback_now() + r->o.send_delay_ms;
+    d->len = len;
+    memcpy(d->data, p, len);
+}
+
+void c8_rollback_poll(c8_rollback* r)
+{
+    uint8_t p[C8_ROLLBACK_PACKET_MAX];
+    int len;
+    while ((len = c8_net_recv(r->sock, p, (int)sizeof(p))) > 0)
+        c8_rollback_receive(r, p, len);
+    c8_rollback_rewind(r);
+    c8_rollback_check(r);
+    c8_rollback_flush(r);
+}
+
+bool c8_rollback_advance(c8_rollback* r, uint16_t local_keys)
+{
+    c8_rollback_poll(r);
+    /* they can be ahead of us, then there's nothing to wait for */
+    if (r->frame > r->remote_have && r->frame - r->remote_have >= r->o.max_rollback)
+    {
+        /* they keep hearing from us or they'd stall too, but no more than a frame's
+        worth however often this gets called */
+        ++r->stats.stalls;
+        if (c8_rollback_now() - r->last_send_ms >= C8_FRAME_DELAY_MS)
+            c8_rollback_send(r);
+        c8_rollback_flush(r);
+        return false;
+    }
+
+    const uint32_t at = r->frame & C8_ROLLBACK_MASK;
+    r->local[at] = local_keys;
+    if (r->frame >= r->remote_have)
+        r->remote[at] = c8_rollback_guess(r);
+    c8_rollback_run_frame(r, r->frame);
+    ++r->frame;
+    r->rewind = r->frame;
+
+    c8_rollback_send(r);
+    c8_rollback_flush(r);
+    return true;
+}
+
+void c8_rollback_defaults(c8_rollback_opts* o)
+{
+    memset(o, 0, sizeof(*o));
+    o->local_mask = 0xffff;
+    o->remote_mask = 0xffff;
+    o->max_rollback = 16;
+}
+
+c8_rollback* c8_rollback_create(const c8_rollback_opts* o, c8_machine* m)
+{
+    if (!c8_net_init())
+        return NULL;
+    c8_rollback* r = calloc(1, sizeof(c8_rollback));
+    if (!r)
+        return NULL;
+    r->o = *o;
+    if (!r->o.max_rollback)
+        r->o.max_rollback = 1;
+    if (r->o.max_rollback > C8_ROLLBACK_WINDOW / 2)
+        r->o.max_rollback = C8_ROLLBACK_WINDOW / 2;
+    r->m = m;
+    r->snap_size = (c8_state_size(&m->s) + 63) & ~(size_t)63;
+    r->snaps = malloc(r->snap_size * C8_ROLLBACK_WINDOW);
+    r->delayq = o->send_delay_ms ? malloc(sizeof(c8_rollback_delayed) * C8_ROLLBACK_DELAYQ) : NULL;
+    r->sock = c8_net_udp_open(o->port);
+    if (!r->snaps || (o->send_delay_ms && !r->delayq) || r->sock == C8_SOCK_INVALID)
+    {
+        fprintf(stderr, "c8_rollback: couldnt set up on port %u\n", o->port);
+        c8_rollback_destroy(r);
+        return NULL;
+    }
+    r->hash[0] = c8_state_hash(&m->s);
+    if (o->peer_port && !c8_rollback_connect(r, o->peer_port))
+    {
+        c8_rollback_destroy(r);
+        return NULL;
+    }
+    return r;
+}
+
+void c8_rollback_destroy(c8_rollback* r)
+{
+    if (!r)
+        return;
+    if (r->sock != C8_SOCK_INVALID)
+        c8_net_close(r->sock);
+    free(r->snaps);
+    free(r->delayq);
+    free(r);
+    c8_net_quit();
+}
+
+uint16_t c8_rollback_port(const c8_rollback* r)
+{
+    return c8_net_port(r->sock);
+}
+
+bool c8_rollback_connect(c8_rollback* r, uint16_t peer_port)
+{
+    r->connected = c8_net_udp_connect(r->sock, peer_port);
+    if (!r->connected)
+        fprintf(stderr, "c8_rollback: couldnt connect to port %u\n", peer_port);
+    return r->connected;
+}
+
+void c8_rollback_get_stats(const c8_rollback* r, c8_rollback_stats* st)
+{
+    *st = r->stats;
+    st->frame = r->frame;
+    st->confirmed = r->remote_have < r->frame ? r->remote_have : r->frame;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "c8.h"
+#include "c8_net.h"
+
+/* two players on one rom over udp. both sides run the whole machine from the same rom
+and seed, and only keypad states go over the wire, one a frame. a frame never waits
+for the other side's keys - until they turn up it guesses they're still holding
+whatever they held last. when the real keys arrive and the guess was wrong, the
+machine goes back to its snapshot from the start of the first frame that was wrong
+and runs forward again to now with what really happened.
+
+a snapshot is a c8_state_copy at the start of every frame into a ring of them, a
+frame is C8_CYCLES_PER_FRAME ops, so rolling back a dozen frames is microseconds.
+
+each packet carries every local keypad state the other side hasnt acknowledged, so
+a lost one is covered by the next, plus the state hash from the last frame both
+sides have the real keys for. those are compared to catch the two machines drifting
+apart.
+
+the machine should have no audio, trace or reverse history on it - re-run frames
+would play and record twice */
+
+/* frames of snapshots and keys kept, a power of two */
+#define C8_ROLLBACK_WINDOW      (64)
+
+typedef struct
+{
+    uint16_t port;          /* local udp port, 0 for any */
+    uint16_t peer_port;     /* the other side, on loopback. can be set later */
+    /* keys each side controls. what the machine sees is both sides' keys, each
+    masked by its own */
+    uint16_t local_mask;
+    uint16_t remote_mask;
+    /* frames the local side may run past the last one it has the other side's keys
+    for. past that c8_rollback_advance waits. at most C8_ROLLBACK_WINDOW / 2, the
+    other side can be as far ahead of us as we can be of it */
+    uint32_t max_rollback;
+    /* for testing, packets go out this long after they're sent */
+    uint32_t send_delay_ms;
+} c8_rollback_opts;
+
+typedef struct
+{
+    uint32_t frame;         /* frames run */
+    uint32_t confirmed;     /* frames run with the other side's real keys */
+    uint64_t rollbacks;     /* times a guess was wrong */
+    uint64_t resimulated;   /* frames run again because of it */
+    uint32_t max_depth;     /* most frames gone back at once */
+    uint64_t stalls;        /* advances that had to wait for the other side */
+    uint64_t packets_in;
+    uint64_t packets_out;
+    uint64_t desyncs;       /* state hashes that didnt match */
+    uint64_t hashes_checked;
+    double rollback_secs;   /* spent restoring and running frames again */
+} c8_rollback_stats;
+
+typedef struct c8_rollback c8_rollback;
+
+void c8_rollback_defaults(c8_rollback_opts* o);
+/* m is loaded, c8_init'd and seeded the same as the other side's */
+c8_rollback* c8_rollback_create(const c8_rollback_opts* o, c8_machine* m);
+void c8_rollback_destroy(c8_rollback* r);
+uint16_t c8_rollback_port(const c8_rollback* r);
+bool c8_rollback_connect(c8_rollback* r, uint16_t peer_port);
+
+/* once a display frame. picks up the other side's keys, rolls back if it has to, then
+runs the next frame with local_keys. false if it's too far ahead of the other side
+and ran nothing, call again next frame */
+bool c8_rollback_advance(c8_rollback* r, uint16_t local_keys);
+/* packets in and out, and any rollback they call for, without running a new frame */
+void c8_rollback_poll(c8_rollback* r);
+
+void c8_rollback_get_stats(const c8_rollback* r, c8_rollback_stats* st);
@@ -0,0 +1,18 @@
+#pragma once
+
+/* what the hand vectorised paths need to build. they all check the cpu at runtime
+before taking the fast path, so the rest of the program doesnt need /arch:AVX2 */
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define C8_X86                  (1)
+#include <immintrin.h>
+#else
+#define C8_X86                  (0)
+#endif
+
+/* msvc lets any function use any intrinsic, gcc and clang want to be told */
+#if defined(__GNUC__)
+#define C8_TARGET_AVX2          __attribute__((target("avx2")))
+#else
+#define C8_TARGET_AVX2
+#endif
@@ -0,0 +1,450 @@
+#include "c8_trace.h"
+#include "c8_ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+
+/* file format: 8 byte header ("C8TR" + version) then one variable length record per op.
+each record starts with a tag byte:
+    bits 0-4  number of deltas
+    bit 5     op is the same as the last one seen at this pc (not stored)
+    bit 6     pc is the predicted one (not stored) - whatever followed the previous
+              pc last time, or previous pc + 2 the first time through
+    bit 7     cycle is previous cycle + 1 (not stored)
+then whatever wasnt implied - varint cycle delta, varint pc, 2 byte big endian op -
+then each delta as kind byte, varint addr (memory only), varint value.
+most ops end up as 1-4 bytes instead of ~40 chars of printf */
+
+#define C8_TRACE_MAGIC          ("C8TR")
+#define C8_TRACE_VERSION        (1)
+
+#define C8_TAG_NDELTAS_MASK     (0x1f)
+#define C8_TAG_OP_CACHED        (0x20)
+#define C8_TAG_PC_SEQ           (0x40)
+#define C8_TAG_CYCLE_NEXT       (0x80)
+
+/* biggest a single encoded record can get */
+#define C8_TRACE_MAX_ENCODED    (1 + 10 + 3 + 2 + C8_TRACE_MAX_DELTAS * (1 + 3 + 3))
+#define C8_TRACE_IOBUF_SIZE     (1 << 16)
+
+/* state shared by encoder and decoder so they predict the same way */
+typedef struct
+{
+    uint64_t prev_cycle;
+    uint16_t prev_pc;
+    /* last op seen at each address, bit 16 set when valid */
+    uint32_t opcache[0x10000];
+    /* pc that followed each address last time, bit 16 set when valid */
+    uint32_t succ[0x10000];
+} c8_trace_codec;
+
+static void c8_trace_codec_reset(c8_trace_codec* c)
+{
+    c->prev_cycle = UINT64_MAX; /* so cycle 0 encodes as 'next' */
+    c->prev_pc = 0x200 - 2;
+    memset(c->opcache, 0, sizeof(c->opcache));
+    memset(c->succ, 0, sizeof(c->succ));
+}
+
+static uint16_t c8_trace_predict_pc(const c8_trace_codec* c)
+{
+    if (c->succ[c->prev_pc] & 0x10000u)
+        return (uint16_t)c->succ[c->prev_pc];
+    return (uint16_t)(c->prev_pc + 2);
+}
+
+static uint8_t* c8_put_varint(uint8_t* p, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static const uint8_t* c8_get_varint(const uint8_t* p, const uint8_t* end, uint64_t* v)
+{
+    uint64_t r = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t b = *p++;
+        r |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+        {
+            *v = r;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static uint8_t* c8_trace_encode(c8_trace_codec* c, const c8_trace_rec* rec, uint8_t* p)
+{
+    uint8_t* tag = p++;
+    *tag = rec->ndeltas & C8_TAG_NDELTAS_MASK;
+
+    if (rec->cycle == c->prev_cycle + 1)
+        *tag |= C8_TAG_CYCLE_NEXT;
+    else
+        p = c8_put_varint(p, rec->cycle - c->prev_cycle);
+
+    if (rec->pc == c8_trace_predict_pc(c))
+        *tag |= C8_TAG_PC_SEQ;
+    else
+        p = c8_put_varint(p, rec->pc);
+
+    if (c->opcache[rec->pc] == (0x10000u | rec->op))
+    {
+        *tag |= C8_TAG_OP_CACHED;
+    }
+    else
+    {
+        *p++ = rec->op >> 8;
+        *p++ = rec->op & 0xff;
+        c->opcache[rec->pc] = 0x10000u | rec->op;
+    }
+
+    for (uint8_t d = 0; d < rec->ndeltas; ++d)
+    {
+        *p++ = rec->deltas[d].kind;
+        if (rec->deltas[d].kind == C8_TRACE_MEM)
+            p = c8_put_varint(p, rec->deltas[d].addr);
+        p = c8_put_varint(p, rec->deltas[d].val);
+    }
+
+    c->succ[c->prev_pc] = 0x10000u | rec->pc;
+    c->prev_cycle = rec->cycle;
+    c->prev_pc = rec->pc;
+    return p;
+}
+
+/* returns NULL if the record is truncated or garbage */
+static const uint8_t* c8_trace_decode(c8_trace_codec* c, const uint8_t* p, const uint8_t* end, c8_trace_rec* rec)
+{
+    uint64_t v;
+    if (p >= end)
+        return NULL;
+
+    uint8_t tag = *p++;
+    rec->ndeltas = tag & C8_TAG_NDELTAS_MASK;
+    if (rec->ndeltas > C8_TRACE_MAX_DELTAS)
+        return NULL;
+
+    if (tag & C8_TAG_CYCLE_NEXT)
+    {
+        rec->cycle = c->prev_cycle + 1;
+    }
+    else
+    {
+        if (!(p = c8_get_varint(p, end, &v)))
+            return NULL;
+        rec->cycle = c->prev_cycle + v;
+    }
+
+    if (tag & C8_TAG_PC_SEQ)
+    {
+        rec->pc = c8_trace_predict_pc(c);
+    }
+    else
+    {
+        if (!(p = c8_get_varint(p, end, &v)))
+            return NULL;
+        rec->pc = (uint16_t)v;
+    }
+
+    if (tag & C8_TAG_OP_CACHED)
+    {
+        rec->op = (uint16_t)c->opcache[rec->pc];
+    }
+    else
+    {
+        if (end - p < 2)
+            return NULL;
+        rec->op = (uint16_t)((p[0] << 8) | p[1]);
+        p += 2;
+        c->opcache[rec->pc] = 0x10000u | rec->op;
+    }
+
+    for (uint8_t d = 0; d < rec->ndeltas; ++d)
+    {
+        if (p >= end)
+            return NULL;
+        rec->deltas[d].kind = *p++;
+        rec->deltas[d].addr = 0;
+        if (rec->deltas[d].kind >= C8_TRACE_KIND_COUNT)
+            return NULL;
+        if (rec->deltas[d].kind == C8_TRACE_MEM)
+        {
+            if (!(p = c8_get_varint(p, end, &v)))
+                return NULL;
+            rec->deltas[d].addr = (uint16_t)v;
+        }
+        if (!(p = c8_get_varint(p, end, &v)))
+            return NULL;
+        rec->deltas[d].val = (uint16_t)v;
+    }
+
+    c->succ[c->prev_pc] = 0x10000u | rec->pc;
+    c->prev_cycle = rec->cycle;
+    c->prev_pc = rec->pc;
+    return p;
+}
+
+void c8_trace_delta_name(const c8_trace_delta* d, char* buf, size_t len)
+{
+    switch (d->kind)
+    {
+    case C8_TRACE_I:
+        snprintf(buf, len, "I");
+        break;
+    case C8_TRACE_SP:
+        snprintf(buf, len, "SP");
+        break;
+    case C8_TRACE_DT:
+        snprintf(buf, len, "DT");
+        break;
+    case C8_TRACE_ST:
+        snprintf(buf, len, "ST");
+        break;
+    case C8_TRACE_MEM:
+        snprintf(buf, len, "[0x%03x]", d->addr);
+        break;
+    default:
+        snprintf(buf, len, "V%X", d->kind);
+        break;
+    }
+}
+
+/* ---- writer ---- */
+
+static FILE* trace_file;
+static c8_trace_rec* trace_recs;
+static c8_ring trace_ring;
+static SDL_Thread* trace_thread;
+static SDL_atomic_t trace_stop;
+static c8_trace_codec* trace_codec;
+/* the flush thread's, allocated up front so it cant fail in there */
+static uint8_t* trace_iobuf;
+static uint64_t trace_nrecs;
+static uint64_t trace_nbytes;
+static uint64_t trace_stalls;
+
+static int SDLCALL c8_trace_flush_thread(void* data)
+{
+    (void)data;
+    uint8_t* out = trace_iobuf;
+    uint8_t* p = out;
+
+    for (;;)
+    {
+        /* read the stop flag before the ring so nothing committed before close is lost */
+        bool stopping = SDL_AtomicGet(&trace_stop) != 0;
+        uint32_t n = c8_ring_avail(&trace_ring);
+        if (n == 0)
+        {
+            if (stopping)
+                break;
+            SDL_Delay(1);
+            continue;
+        }
+
+        for (uint32_t r = 0; r < n; ++r)
+        {
+            uint32_t slot = (trace_ring.tail + r) & (C8_TRACE_RING_SIZE - 1);
+            p = c8_trace_encode(trace_codec, &trace_recs[slot], p);
+            if (p - out > C8_TRACE_IOBUF_SIZE - C8_TRACE_MAX_ENCODED)
+            {
+                fwrite(out, 1, p - out, trace_file);
+                trace_nbytes += p - out;
+                p = out;
+            }
+        }
+        /* hand the whole batch back at once, keeps the producer from bouncing our line */
+        c8_ring_release(&trace_ring, n);
+        trace_nrecs += n;
+    }
+
+    fwrite(out, 1, p - out, trace_file);
+    trace_nbytes += p - out;
+    return 0;
+}
+
+static void c8_trace_free(void)
+{
+    if (trace_file)
+        fclose(trace_file);
+    trace_file = NULL;
+    free(trace_recs);
+    free(trace_codec);
+    free(trace_iobuf);
+    trace_recs = NULL;
+    trace_codec = NULL;
+    trace_iobuf = NULL;
+}
+
+bool c8_trace_open(const char* filename)
+{
+    if (trace_file)
+        c8_trace_close();
+
+    trace_file = fopen(filename, "wb");
+    if (!trace_file)
+    {
+        fprintf(stderr, "c8_trace_open: failed to open file '%s'!\n", filename);
+        return false;
+    }
+
+    /* an index next to it is for whatever was recorded here before */
+    const size_t len = strlen(filename);
+    char* idx = malloc(len + 5);
+    if (idx)
+    {
+        memcpy(idx, filename, len);
+        memcpy(idx + len, ".idx", 5);
+        remove(idx);
+        free(idx);
+    }
+
+    trace_recs = malloc(sizeof(c8_trace_rec) * C8_TRACE_RING_SIZE);
+    trace_codec = malloc(sizeof(c8_trace_codec));
+    trace_iobuf = malloc(C8_TRACE_IOBUF_SIZE);
+    if (!trace_recs || !trace_codec || !trace_iobuf)
+    {
+        fprintf(stderr, "c8_trace_open: out of memory\n");
+        c8_trace_free();
+        return false;
+    }
+
+    fwrite(C8_TRACE_MAGIC, 1, 4, trace_file);
+    const uint8_t ver[4] = { C8_TRACE_VERSION, 0, 0, 0 };
+    fwrite(ver, 1, sizeof(ver), trace_file);
+
+    c8_trace_codec_reset(trace_codec);
+    c8_ring_reset(&trace_ring);
+    trace_nrecs = trace_nbytes = trace_stalls = 0;
+    SDL_AtomicSet(&trace_stop, 0);
+    trace_thread = SDL_CreateThread(c8_trace_flush_thread, "c8trace", NULL);
+    if (!trace_thread)
+    {
+        /* nothing would ever drain the ring, c8_trace_begin would wait forever */
+        fprintf(stderr, "c8_trace_open: cant start the flush thread: %s\n", SDL_GetError());
+        c8_trace_free();
+        return false;
+    }
+    return true;
+}
+
+void c8_trace_close(void)
+{
+    if (!trace_file)
+        return;
+
+    SDL_AtomicSet(&trace_stop, 1);
+    SDL_WaitThread(trace_thread, NULL);
+    trace_thread = NULL;
+    c8_trace_free();
+
+    fprintf(stderr, "c8_trace_close: %llu ops, %llu bytes, producer stalled %llu times\n",
+        (unsigned long long)trace_nrecs, (unsigned long long)trace_nbytes, (unsigned long long)trace_stalls);
+}
+
+bool c8_trace_active(void)
+{
+    return trace_file != NULL;
+}
+
+c8_trace_rec* c8_trace_begin(void)
+{
+    while (c8_ring_free(&trace_ring, C8_TRACE_RING_SIZE) == 0)
+    {
+        /* bounded memory - wait on the flush thread rather than drop records */
+        ++trace_stalls;
+        SDL_Delay(0);
+    }
+    return &trace_recs[c8_ring_head_slot(&trace_ring, C8_TRACE_RING_SIZE)];
+}
+
+void c8_trace_commit(void)
+{
+    c8_ring_publish(&trace_ring, 1);
+}
+
+/* ---- reader ---- */
+
+struct c8_trace_reader
+{
+    FILE* f;
+    c8_trace_codec codec;
+    uint8_t buf[C8_TRACE_IOBUF_SIZE];
+    size_t pos;
+    size_t len;
+    bool eof;
+};
+
+c8_trace_reader* c8_trace_reader_open(const char* filename)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "c8_trace_reader_open: failed to open file '%s'!\n", filename);
+        return NULL;
+    }
+
+    uint8_t hdr[8];
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || memcmp(hdr, C8_TRACE_MAGIC, 4) != 0
+        || hdr[4] != C8_TRACE_VERSION)
+    {
+        fprintf(stderr, "c8_trace_reader_open: '%s' is not a c8 trace\n", filename);
+        fclose(f);
+        return NULL;
+    }
+
+    c8_trace_reader* rd = malloc(sizeof(c8_trace_reader));
+    if (!rd)
+    {
+        fclose(f);
+        return NULL;
+    }
+    rd->f = f;
+    rd->pos = rd->len = 0;
+    rd->eof = false;
+    c8_trace_codec_reset(&rd->codec);
+    return rd;
+}
+
+bool c8_trace_reader_next(c8_trace_reader* rd, c8_trace_rec* rec)
+{
+    /* keep at least one whole record buffered unless we are at the end */
+    if (!rd->eof && rd->len - rd->pos < C8_TRACE_MAX_ENCODED)
+    {
+        memmove(rd->buf, rd->buf + rd->pos, rd->len - rd->pos);
+        rd->len -= rd->pos;
+        rd->pos = 0;
+        size_t got = fread(rd->buf + rd->len, 1, sizeof(rd->buf) - rd->len, rd->f);
+        rd->len += got;
+        rd->eof = got == 0;
+    }
+
+    if (rd->pos >= rd->len)
+        return false;
+
+    const uint8_t* p = c8_trace_decode(&rd->codec, rd->buf + rd->pos, rd->buf + rd->len, rec);
+    if (!p)
+    {
+        fprintf(stderr, "c8_trace_reader_next: truncated or corrupt record\n");
+        rd->pos = rd->len;
+        return false;
+    }
+    rd->pos = p - rd->buf;
+    return true;
+}
+
+void c8_trace_reader_close(c8_trace_reader* rd)
+{
+    if (!rd)
+        return;
+    fclose(rd->f);
+    free(rd);
+}
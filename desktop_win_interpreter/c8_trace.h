@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* binary instruction trace. the interpreter fills one record per executed op into a
+lock free ring, a background thread drains the ring and writes a delta encoded file.
+an FX0A gets a second record when its key comes, with the VX it set.
+tools/c8trace.c turns the file back into text */
+
+#define C8_TRACE_MAX_DELTAS     (20)
+#define C8_TRACE_RING_SIZE      (1 << 14)
+
+/* what a delta changed. V0 - VF are just their index */
+enum
+{
+    C8_TRACE_V0 = 0,
+    C8_TRACE_VF = 15,
+    C8_TRACE_I = 16,
+    C8_TRACE_SP = 17,
+    C8_TRACE_DT = 18,
+    C8_TRACE_ST = 19,
+    C8_TRACE_MEM = 20,
+    C8_TRACE_KIND_COUNT
+};
+
+typedef struct
+{
+    uint16_t addr; /* only used for C8_TRACE_MEM */
+    uint16_t val;
+    uint8_t kind;
+} c8_trace_delta;
+
+typedef struct
+{
+    uint64_t cycle;
+    uint16_t pc;
+    uint16_t op;
+    uint8_t ndeltas;
+    c8_trace_delta deltas[C8_TRACE_MAX_DELTAS];
+} c8_trace_rec;
+
+/* writer - one trace per process */
+bool c8_trace_open(const char* filename);
+void c8_trace_close(void);
+bool c8_trace_active(void);
+/* grab the next free record in the ring, waits if the flush thread fell behind */
+c8_trace_rec* c8_trace_begin(void);
+void c8_trace_commit(void);
+
+/* reader */
+typedef struct c8_trace_reader c8_trace_reader;
+
+c8_trace_reader* c8_trace_reader_open(const char* filename);
+bool c8_trace_reader_next(c8_trace_reader* rd, c8_trace_rec* rec);
+void c8_trace_reader_close(c8_trace_reader* rd);
+
+/* "V3", "I", "[0x3a0]" etc. buf should be at least 16 chars */
+void c8_trace_delta_name(const c8_trace_delta* d, char* buf, size_t len);
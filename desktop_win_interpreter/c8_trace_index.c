@@ -0,0 +1,423 @@
+#if !defined _WIN32
+#define _FILE_OFFSET_BITS 64
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "c8_trace_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined _WIN32
+#define c8_fseek _fseeki64
+#define c8_ftell _ftelli64
+#else
+#define c8_fseek fseeko
+#define c8_ftell ftello
+#endif
+
+/* file layout (little endian, written straight from the structs):
+    header
+    data blocks - C8_IX_BLOCK_ENTRIES c8_ix_entry each, last block of a key may be short
+    block directory - c8_ix_block per block, grouped by key
+    key table - c8_ix_keyent per key */
+
+#define C8_IX_MAGIC     ("C8IX")
+#define C8_IX_VERSION   (2)
+/* how much of each end of the trace goes into its checksum */
+#define C8_IX_SUM_BYTES (4096)
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t nkeys;
+    uint32_t block_entries;
+    uint64_t keytab_offset;
+    uint64_t total_entries;
+    /* the trace it was built from. a trace recorded again under the same name wont
+    match, and the index gets built again instead of answering for the old one */
+    uint64_t trace_size;
+    uint64_t trace_sum;
+} c8_ix_header;
+
+typedef struct
+{
+    uint64_t offset;
+    uint64_t first_cycle;
+    uint64_t last_cycle;
+    uint32_t count;
+    uint32_t pad;
+} c8_ix_block;
+
+typedef struct
+{
+    uint64_t dir_offset;
+    uint64_t count;
+    uint32_t nblocks;
+    uint32_t pad;
+} c8_ix_keyent;
+
+struct c8_ix
+{
+    FILE* f;
+    c8_ix_header hdr;
+    c8_ix_entry buf[C8_IX_BLOCK_ENTRIES];
+};
+
+static char* c8_ix_filename(const char* trace_filename)
+{
+    size_t len = strlen(trace_filename);
+    char* name = malloc(len + 5);
+    if (name)
+    {
+        memcpy(name, trace_filename, len);
+        memcpy(name + len, ".idx", 5);
+    }
+    return name;
+}
+
+/* length of the trace and fnv-1a over its first and last few k. cheap enough to do
+on every open, and a re-recorded trace changes at least one of them */
+static bool c8_ix_fingerprint(const char* trace_filename, uint64_t* size, uint64_t* sum)
+{
+    FILE* f = fopen(trace_filename, "rb");
+    if (!f)
+        return false;
+    static uint8_t buf[C8_IX_SUM_BYTES];
+    uint64_t h = 0xcbf29ce484222325ull;
+    bool ok = c8_fseek(f, 0, SEEK_END) == 0;
+    const int64_t len = ok ? (int64_t)c8_ftell(f) : -1;
+    ok = len >= 0;
+    for (int end = 0; ok && end < 2; ++end)
+    {
+        const int64_t from = end && len > C8_IX_SUM_BYTES ? len - C8_IX_SUM_BYTES : 0;
+        const size_t want = (size_t)(len - from < C8_IX_SUM_BYTES ? len - from : C8_IX_SUM_BYTES);
+        ok = c8_fseek(f, from, SEEK_SET) == 0 && fread(buf, 1, want, f) == want;
+        for (size_t b = 0; ok && b < want; ++b)
+            h = (h ^ buf[b]) * 0x100000001b3ull;
+    }
+    fclose(f);
+    *size = (uint64_t)len;
+    *sum = h;
+    return ok;
+}
+
+/* ---- build ---- */
+
+typedef struct
+{
+    c8_ix_entry* pending; /* only allocated once a key is touched */
+    uint32_t npending;
+    uint32_t nblocks;
+    uint32_t cap;
+    c8_ix_block* blocks;
+} c8_ix_keybuild;
+
+typedef struct
+{
+    FILE* f;
+    uint64_t pos;
+    uint64_t total;
+    bool failed;
+    c8_ix_keybuild* keys;
+} c8_ix_builder;
+
+static void c8_ix_flush_key(c8_ix_builder* b, c8_ix_keybuild* k)
+{
+    if (!k->npending)
+        return;
+
+    if (k->nblocks == k->cap)
+    {
+        uint32_t cap = k->cap ? k->cap * 2 : 4;
+        c8_ix_block* nb = realloc(k->blocks, cap * sizeof(c8_ix_block));
+        if (!nb)
+        {
+            b->failed = true;
+            return;
+        }
+        k->blocks = nb;
+        k->cap = cap;
+    }
+
+    c8_ix_block* blk = &k->blocks[k->nblocks++];
+    blk->offset = b->pos;
+    blk->first_cycle = k->pending[0].cycle;
+    blk->last_cycle = k->pending[k->npending - 1].cycle;
+    blk->count = k->npending;
+    blk->pad = 0;
+
+    if (fwrite(k->pending, sizeof(c8_ix_entry), k->npending, b->f) != k->npending)
+        b->failed = true;
+    b->pos += (uint64_t)k->npending * sizeof(c8_ix_entry);
+    k->npending = 0;
+}
+
+static void c8_ix_add(c8_ix_builder* b, uint32_t key, uint64_t cycle, uint16_t pc, uint16_t op, uint16_t val)
+{
+    c8_ix_keybuild* k = &b->keys[key];
+    if (!k->pending)
+    {
+        k->pending = malloc(sizeof(c8_ix_entry) * C8_IX_BLOCK_ENTRIES);
+        if (!k->pending)
+        {
+            b->failed = true;
+            return;
+        }
+    }
+
+    c8_ix_entry* e = &k->pending[k->npending++];
+    e->cycle = cycle;
+    e->pc = pc;
+    e->op = op;
+    e->val = val;
+    e->pad = 0;
+    ++b->total;
+
+    if (k->npending == C8_IX_BLOCK_ENTRIES)
+        c8_ix_flush_key(b, k);
+}
+
+bool c8_ix_build(const char* trace_filename)
+{
+    c8_trace_reader* rd = c8_trace_reader_open(trace_filename);
+    if (!rd)
+        return false;
+
+    char* name = c8_ix_filename(trace_filename);
+    c8_ix_builder b = { 0 };
+    b.keys = calloc(C8_IX_NKEYS, sizeof(c8_ix_keybuild));
+    b.f = name ? fopen(name, "wb") : NULL;
+    if (!b.f || !b.keys)
+    {
+        fprintf(stderr, "c8_ix_build: failed to create index for '%s'\n", trace_filename);
+        if (b.f)
+            fclose(b.f);
+        free(b.keys);
+        free(name);
+        c8_trace_reader_close(rd);
+        return false;
+    }
+
+    /* header gets rewritten at the end once we know where the key table is */
+    c8_ix_header hdr = { { 'C', '8', 'I', 'X' }, C8_IX_VERSION, C8_IX_NKEYS, C8_IX_BLOCK_ENTRIES, 0, 0, 0, 0 };
+    if (!c8_ix_fingerprint(trace_filename, &hdr.trace_size, &hdr.trace_sum))
+        b.failed = true;
+    fwrite(&hdr, sizeof(hdr), 1, b.f);
+    b.pos = sizeof(hdr);
+
+    c8_trace_rec rec;
+    while (!b.failed && c8_trace_reader_next(rd, &rec))
+    {
+        c8_ix_add(&b, C8_IX_KEY_PC(rec.pc), rec.cycle, rec.pc, rec.op, 0);
+        for (uint8_t d = 0; d < rec.ndeltas; ++d)
+        {
+            const c8_trace_delta* dl = &rec.deltas[d];
+            if (dl->kind == C8_TRACE_MEM)
+            {
+                c8_ix_add(&b, C8_IX_KEY_MEM(dl->addr), rec.cycle, rec.pc, rec.op, dl->val);
+                continue;
+            }
+            c8_ix_add(&b, C8_IX_KEY_REG(dl->kind), rec.cycle, rec.pc, rec.op, dl->val);
+            if (dl->kind <= C8_TRACE_VF)
+                c8_ix_add(&b, C8_IX_KEY_REGVAL(dl->kind, dl->val & 0xff), rec.cycle, rec.pc, rec.op, dl->val);
+        }
+    }
+    c8_trace_reader_close(rd);
+
+    /* partial blocks, then the directory */
+    for (uint32_t k = 0; k < C8_IX_NKEYS; ++k)
+        c8_ix_flush_key(&b, &b.keys[k]);
+
+    c8_ix_keyent* keytab = calloc(C8_IX_NKEYS, sizeof(c8_ix_keyent));
+    if (!keytab)
+        b.failed = true;
+    for (uint32_t k = 0; k < C8_IX_NKEYS && !b.failed; ++k)
+    {
+        c8_ix_keybuild* kb = &b.keys[k];
+        keytab[k].dir_offset = b.pos;
+        keytab[k].nblocks = kb->nblocks;
+        for (uint32_t n = 0; n < kb->nblocks; ++n)
+            keytab[k].count += kb->blocks[n].count;
+        if (kb->nblocks && fwrite(kb->blocks, sizeof(c8_ix_block), kb->nblocks, b.f) != kb->nblocks)
+            b.failed = true;
+        b.pos += (uint64_t)kb->nblocks * sizeof(c8_ix_block);
+    }
+
+    hdr.keytab_offset = b.pos;
+    hdr.total_entries = b.total;
+    if (keytab && fwrite(keytab, sizeof(c8_ix_keyent), C8_IX_NKEYS, b.f) != C8_IX_NKEYS)
+        b.failed = true;
+    if (c8_fseek(b.f, 0, SEEK_SET) != 0 || fwrite(&hdr, sizeof(hdr), 1, b.f) != 1)
+        b.failed = true;
+    if (fclose(b.f) != 0)
+        b.failed = true;
+
+    for (uint32_t k = 0; k < C8_IX_NKEYS; ++k)
+    {
+        free(b.keys[k].pending);
+        free(b.keys[k].blocks);
+    }
+    free(b.keys);
+    free(keytab);
+
+    if (b.failed)
+    {
+        fprintf(stderr, "c8_ix_build: failed writing '%s'\n", name);
+        remove(name);
+    }
+    free(name);
+    return !b.failed;
+}
+
+/* ---- query ---- */
+
+c8_ix* c8_ix_open(const char* trace_filename)
+{
+    char* name = c8_ix_filename(trace_filename);
+    FILE* f = name ? fopen(name, "rb") : NULL;
+    free(name);
+    if (!f)
+        return NULL;
+
+    c8_ix* ix = malloc(sizeof(c8_ix));
+    if (!ix || fread(&ix->hdr, sizeof(ix->hdr), 1, f) != 1 || memcmp(ix->hdr.magic, C8_IX_MAGIC, 4) != 0
+        || ix->hdr.version != C8_IX_VERSION || ix->hdr.nkeys != C8_IX_NKEYS
+        || ix->hdr.block_entries != C8_IX_BLOCK_ENTRIES)
+    {
+        fprintf(stderr, "c8_ix_open: index for '%s' is old or corrupt, rebuild it\n", trace_filename);
+        free(ix);
+        fclose(f);
+        return NULL;
+    }
+    uint64_t size, sum;
+    if (!c8_ix_fingerprint(trace_filename, &size, &sum) || size != ix->hdr.trace_size || sum != ix->hdr.trace_sum)
+    {
+        fprintf(stderr, "c8_ix_open: index for '%s' is stale, the trace changed since, rebuild it\n",
+            trace_filename);
+        free(ix);
+        fclose(f);
+        return NULL;
+    }
+    ix->f = f;
+    return ix;
+}
+
+void c8_ix_close(c8_ix* ix)
+{
+    if (!ix)
+        return;
+    fclose(ix->f);
+    free(ix);
+}
+
+static bool c8_ix_read_key(c8_ix* ix, uint32_t key, c8_ix_keyent* ke)
+{
+    if (key >= C8_IX_NKEYS)
+        return false;
+    if (c8_fseek(ix->f, (int64_t)(ix->hdr.keytab_offset + (uint64_t)key * sizeof(c8_ix_keyent)), SEEK_SET) != 0)
+        return false;
+    return fread(ke, sizeof(*ke), 1, ix->f) == 1;
+}
+
+/* one entry of a key's block directory. the directory is sorted fixed size records
+on disk, so searching it is a seek and a read per step and a hot key with millions of
+blocks costs no more than a quiet one */
+static bool c8_ix_read_dirent(c8_ix* ix, const c8_ix_keyent* ke, uint32_t n, c8_ix_block* blk)
+{
+    if (c8_fseek(ix->f, (int64_t)(ke->dir_offset + (uint64_t)n * sizeof(c8_ix_block)), SEEK_SET) != 0)
+        return false;
+    return fread(blk, sizeof(*blk), 1, ix->f) == 1;
+}
+
+static bool c8_ix_read_block(c8_ix* ix, const c8_ix_block* blk)
+{
+    if (c8_fseek(ix->f, (int64_t)blk->offset, SEEK_SET) != 0)
+        return false;
+    return fread(ix->buf, sizeof(c8_ix_entry), blk->count, ix->f) == blk->count;
+}
+
+uint64_t c8_ix_count(c8_ix* ix, uint32_t key)
+{
+    c8_ix_keyent ke;
+    return c8_ix_read_key(ix, key, &ke) ? ke.count : 0;
+}
+
+uint64_t c8_ix_query(c8_ix* ix, uint32_t key, uint64_t lo, uint64_t hi, c8_ix_visit_fn fn, void* ctx)
+{
+    c8_ix_keyent ke;
+    if (!c8_ix_read_key(ix, key, &ke) || !ke.nblocks)
+        return 0;
+
+    /* first block that can hold anything >= lo */
+    c8_ix_block blk;
+    uint32_t l = 0;
+    uint32_t h = ke.nblocks;
+    while (l < h)
+    {
+        uint32_t mid = l + (h - l) / 2;
+        if (!c8_ix_read_dirent(ix, &ke, mid, &blk))
+            return 0;
+        if (blk.last_cycle < lo)
+            l = mid + 1;
+        else
+            h = mid;
+    }
+
+    uint64_t visited = 0;
+    bool more = true;
+    for (uint32_t b = l; more && b < ke.nblocks; ++b)
+    {
+        if (!c8_ix_read_dirent(ix, &ke, b, &blk) || blk.first_cycle >= hi || !c8_ix_read_block(ix, &blk))
+            break;
+        for (uint32_t e = 0; more && e < blk.count; ++e)
+        {
+            if (ix->buf[e].cycle < lo)
+                continue;
+            if (ix->buf[e].cycle >= hi)
+            {
+                more = false;
+                break;
+            }
+            ++visited;
+            more = fn(&ix->buf[e], ctx);
+        }
+    }
+    return visited;
+}
+
+bool c8_ix_last_before(c8_ix* ix, uint32_t key, uint64_t before, c8_ix_entry* out)
+{
+    c8_ix_keyent ke;
+    if (!c8_ix_read_key(ix, key, &ke) || !ke.nblocks)
+        return false;
+
+    /* number of blocks starting before 'before', the answer lives in the last of them */
+    c8_ix_block blk;
+    uint32_t l = 0;
+    uint32_t h = ke.nblocks;
+    while (l < h)
+    {
+        uint32_t mid = l + (h - l) / 2;
+        if (!c8_ix_read_dirent(ix, &ke, mid, &blk))
+            return false;
+        if (blk.first_cycle < before)
+            l = mid + 1;
+        else
+            h = mid;
+    }
+
+    bool found = false;
+    if (l > 0 && c8_ix_read_dirent(ix, &ke, l - 1, &blk) && c8_ix_read_block(ix, &blk))
+    {
+        for (uint32_t e = blk.count; e-- > 0;)
+        {
+            if (ix->buf[e].cycle < before)
+            {
+                *out = ix->buf[e];
+                found = true;
+                break;
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "c8_trace.h"
+
+/* on disk index over a trace (file.c8t -> file.c8t.idx) so questions like "who wrote
+0x3a0" or "when did VF last become 1" dont need a scan over the whole trace.
+
+every key gets a list of entries in cycle order, chopped into fixed size blocks.
+the directory keeps first/last cycle of each block so a query binary searches the
+directory and only reads the blocks it needs. keys are:
+    reg        - every change to V0-VF, I, SP, DT, ST
+    reg = val  - every time V0-VF became a particular value
+    mem        - every write to an address
+    pc         - every op executed at an address */
+
+#define C8_IX_BLOCK_ENTRIES     (256)
+
+#define C8_IX_NREGS             (C8_TRACE_MEM)
+#define C8_IX_KEY_REG(kind)     (kind)
+#define C8_IX_KEY_REGVAL(r, v)  (C8_IX_NREGS + (r) * 256 + (v))
+#define C8_IX_KEY_MEM(addr)     (C8_IX_NREGS + 16 * 256 + (addr))
+#define C8_IX_KEY_PC(pc)        (C8_IX_NREGS + 16 * 256 + 0x10000 + (pc))
+#define C8_IX_NKEYS             (C8_IX_NREGS + 16 * 256 + 0x10000 * 2)
+
+typedef struct
+{
+    uint64_t cycle;
+    uint16_t pc;
+    uint16_t op;
+    uint16_t val; /* new value for reg / mem keys */
+    uint16_t pad;
+} c8_ix_entry;
+
+typedef struct c8_ix c8_ix;
+
+/* builds filename.idx from the trace. returns false on io errors */
+bool c8_ix_build(const char* trace_filename);
+
+/* opens trace_filename.idx */
+c8_ix* c8_ix_open(const char* trace_filename);
+void c8_ix_close(c8_ix* ix);
+
+/* calls fn for each entry with lo <= cycle < hi in cycle order, stops early if fn
+returns false. returns number of entries visited */
+typedef bool (*c8_ix_visit_fn)(const c8_ix_entry* e, void* ctx);
+uint64_t c8_ix_query(c8_ix* ix, uint32_t key, uint64_t lo, uint64_t hi, c8_ix_visit_fn fn, void* ctx);
+
+/* last entry with cycle < before. false if there isnt one */
+bool c8_ix_last_before(c8_ix* ix, uint32_t key, uint64_t before, c8_ix_entry* out);
+
+/* total entries for a key without reading any blocks */
+uint64_t c8_ix_count(c8_ix* ix, uint32_t key);
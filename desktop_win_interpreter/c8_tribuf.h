@@ -0,0 +1,54 @@
+#pragma once
+#include "c8.h"
+#include <SDL_atomic.h>
+
+/* triple buffered frames from the emulation thread to the render thread. the
+emulator always has a back buffer to draw into, the renderer always has a front
+buffer to read from, and finished frames are swapped through the middle one with a
+single atomic exchange. the renderer only ever sees whole frames and neither side
+waits on the other */
+
+typedef struct
+{
+    uint64_t cycle; /* machine cycle when the frame was taken */
+    c8_display screen;
+} c8_frame;
+
+#define C8_TRIBUF_FRESH         (4) /* set in mid when it holds a frame nobody has shown */
+
+typedef struct
+{
+    c8_frame frames[3];
+    SDL_atomic_t mid; /* slot index, | C8_TRIBUF_FRESH */
+    int back; /* emulator only */
+    int front; /* renderer only */
+} c8_tribuf;
+
+static inline void c8_tribuf_init(c8_tribuf* tb)
+{
+    memset(tb->frames, 0, sizeof(tb->frames));
+    tb->back = 0;
+    SDL_AtomicSet(&tb->mid, 1);
+    tb->front = 2;
+}
+
+/* emulator side - frame to fill in */
+static inline c8_frame* c8_tribuf_back(c8_tribuf* tb)
+{
+    return &tb->frames[tb->back];
+}
+
+/* emulator side - hand the back buffer over, get the old middle one to draw into */
+static inline void c8_tribuf_publish(c8_tribuf* tb)
+{
+    tb->back = SDL_AtomicSet(&tb->mid, tb->back | C8_TRIBUF_FRESH) & 3;
+}
+
+/* renderer side - newest finished frame, NULL if nothing new since last time */
+static inline const c8_frame* c8_tribuf_acquire(c8_tribuf* tb)
+{
+    if (!(SDL_AtomicGet(&tb->mid) & C8_TRIBUF_FRESH))
+        return NULL;
+    tb->front = SDL_AtomicSet(&tb->mid, tb->front) & 3;
+    return &tb->frames[tb->front];
+}
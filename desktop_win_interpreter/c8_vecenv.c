@@ -0,0 +1,470 @@
+#include "c8_vecenv.h"
+#include "c8_pool.h"
+
+#define C8_VECENV_MAX_THREADS   (64)
+
+typedef enum
+{
+    C8_VECENV_JOB_STEP = 0,
+    C8_VECENV_JOB_RESET,
+} c8_vecenv_job;
+
+typedef struct
+{
+    c8_machine* m;
+    uint32_t frames;
+    uint32_t episodes;
+    /* the reward memory as it was after the last step */
+    uint32_t last[C8_VECENV_MAX_REWARDS];
+    /* done last step, starts over before the next one */
+    bool over;
+} c8_vecenv_slot;
+
+typedef struct
+{
+    c8_vecenv* v;
+    SDL_Thread* thread;
+    uint32_t first;
+    uint32_t count;
+} c8_vecenv_worker;
+
+struct c8_vecenv
+{
+    c8_vecenv_opts o;
+    c8_pool* pool;
+    c8_vecenv_slot* envs;
+    c8_state* base;
+    size_t obs_size;
+
+    uint8_t* obs;
+    float* rewards;
+    uint8_t* dones;
+    /* ours, for when nothing is bound */
+    uint8_t* own_obs;
+    float* own_rewards;
+    uint8_t* own_dones;
+
+    c8_vecenv_worker workers[C8_VECENV_MAX_THREADS];
+    uint32_t nworkers;
+
+    /* the step going on, under lock. workers start when gen moves on and the last
+    one to finish wakes the caller */
+    SDL_mutex* lock;
+    SDL_cond* go;
+    SDL_cond* finished;
+    uint32_t gen;
+    uint32_t pending;
+    bool quit;
+    uint8_t job;
+    const uint16_t* keys;
+};
+
+/* bit 7 of the index to the first byte in memory, bit 0 to the last. filled in on
+first create */
+static uint64_t c8_vecenv_spread[256];
+
+static void c8_vecenv_spread_init(void)
+{
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint8_t bytes[8];
+        for (uint8_t b = 0; b < 8; ++b)
+            bytes[b] = (uint8_t)(i >> (7 - b) & 1);
+        memcpy(&c8_vecenv_spread[i], bytes, 8);
+    }
+}
+
+/* each pixel twice, the left 32 of a row to a whole 64 */
+static uint64_t c8_vecenv_widen(uint32_t w)
+{
+    uint64_t x = w;
+    x = (x | x << 16) & 0x0000ffff0000ffffull;
+    x = (x | x << 8) & 0x00ff00ff00ff00ffull;
+    x = (x | x << 4) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | x << 2) & 0x3333333333333333ull;
+    x = (x | x << 1) & 0x5555555555555555ull;
+    return x | x << 1;
+}
+
+/* the other way, each pair of pixels ored into one */
+static uint32_t c8_vecenv_narrow(uint64_t w)
+{
+    uint64_t x = (w | w >> 1) & 0x5555555555555555ull;
+    x = (x | x >> 1) & 0x3333333333333333ull;
+    x = (x | x >> 2) & 0x0f0f0f0f0f0f0f0full;
+    x = (x | x >> 4) & 0x00ff00ff00ff00ffull;
+    x = (x | x >> 8) & 0x0000ffff0000ffffull;
+    return (uint32_t)(x | x >> 16);
+}
+
+/* row y of the observation for plane p, scaled from whatever resolution the screen is in */
+static void c8_vecenv_row(const c8_display* d, uint8_t p, uint32_t y, bool hires, uint64_t out[C8_ROW_WORDS])
+{
+    if (d->hires == hires)
+    {
+        out[0] = d->rows[p][y][0];
+        out[1] = d->rows[p][y][1];
+    }
+    else if (hires)
+    {
+        const uint64_t w = d->rows[p][y / 2][0];
+        out[0] = c8_vecenv_widen((uint32_t)(w >> 32));
+        out[1] = c8_vecenv_widen((uint32_t)w);
+    }
+    else
+    {
+        const uint64_t w0 = d->rows[p][y * 2][0] | d->rows[p][y * 2 + 1][0];
+        const uint64_t w1 = d->rows[p][y * 2][1] | d->rows[p][y * 2 + 1][1];
+        out[0] = (uint64_t)c8_vecenv_narrow(w0) << 32 | c8_vecenv_narrow(w1);
+        out[1] = 0;
+    }
+}
+
+static void c8_vecenv_observe(const c8_vecenv* v, const c8_display* d, uint8_t* out)
+{
+    const bool hires = v->o.obs_hires;
+    const uint32_t h = hires ? C8_HIRES_HEIGHT : C8_HEIGHT;
+    const uint32_t words = hires ? C8_ROW_WORDS : 1;
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        uint64_t p0[C8_ROW_WORDS], p1[C8_ROW_WORDS];
+        c8_vecenv_row(d, 0, y, hires, p0);
+        c8_vecenv_row(d, 1, y, hires, p1);
+        for (uint32_t w = 0; w < words; ++w)
+        {
+            if (v->o.obs_format == C8_OBS_BITS)
+            {
+                /* big endian so the leftmost pixel is the first byte's top bit */
+                const uint64_t lit = p0[w] | p1[w];
+                for (uint8_t b = 0; b < 8; ++b)
+                    *out++ = (uint8_t)(lit >> (56 - b * 8));
+            }
+            else
+            {
+                /* 8 pixels at a time, each plane's byte spread out a bit a byte */
+                for (int8_t b = 56; b >= 0; b -= 8)
+                {
+                    const uint64_t px = c8_vecenv_spread[(uint8_t)(p0[w] >> b)] |
+                        c8_vecenv_spread[(uint8_t)(p1[w] >> b)] << 1;
+                    memcpy(out, &px, 8);
+                    out += 8;
+                }
+            }
+        }
+    }
+}
+
+static uint32_t c8_vecenv_value(const c8_state* s, const c8_reward_src* r)
+{
+    uint32_t val = 0;
+    for (uint8_t b = 0; b < r->bytes; ++b)
+    {
+        const uint8_t byte = s->mem[(r->addr + b) & s->mem_mask];
+        val = r->bcd ? val * 10 + byte : val << 8 | byte;
+    }
+    return val;
+}
+
+static void c8_vecenv_restart(c8_vecenv* v, uint32_t n)
+{
+    c8_vecenv_slot* e = &v->envs[n];
+    c8_machine* m = e->m;
+    c8_state_copy(&m->s, v->base);
+    m->faulted = false;
+    /* a different CXNN sequence every env and every episode */
+    c8_seed(m, (v->o.seed + n) * 0x9e3779b9u ^ e->episodes * 0x85ebca6bu);
+    e->frames = 0;
+    e->over = false;
+    ++e->episodes;
+    for (uint8_t r = 0; r < v->o.nrewards; ++r)
+        e->last[r] = c8_vecenv_value(&m->s, &v->o.rewards[r]);
+}
+
+static bool c8_vecenv_halted(const c8_state* s)
+{
+    const uint16_t op = (uint16_t)(s->mem[s->pc & s->mem_mask] << 8 | s->mem[(s->pc + 1) & s->mem_mask]);
+    return op == 0x00fd || ((op & 0xf000) == 0x1000 && (op & 0x0fff) == s->pc);
+}
+
+static void c8_vecenv_step_env(c8_vecenv* v, uint32_t n, uint16_t keys)
+{
+    c8_vecenv_slot* e = &v->envs[n];
+    c8_machine* m = e->m;
+    if (e->over)
+        c8_vecenv_restart(v, n);
+
+    c8_set_keys(m, keys);
+    for (uint32_t c = 0; c < v->o.frame_cycles && !m->faulted; ++c)
+        c8_cycle(m);
+    ++e->frames;
+
+    float reward = 0.0f;
+    for (uint8_t r = 0; r < v->o.nrewards; ++r)
+    {
+        const uint32_t val = c8_vecenv_value(&m->s, &v->o.rewards[r]);
+        reward += v->o.rewards[r].scale * (float)((int64_t)val - e->last[r]);
+        e->last[r] = val;
+    }
+
+    uint8_t done = 0;
+    if (m->faulted || c8_vecenv_halted(&m->s) ||
+        (v->o.done_on_mem && m->s.mem[v->o.done_addr & m->s.mem_mask] == v->o.done_value))
+        done |= C8_VECENV_DONE;
+    if (v->o.max_frames && e->frames >= v->o.max_frames)
+        done |= C8_VECENV_CUT;
+    e->over = done != 0;
+
+    v->rewards[n] = reward;
+    v->dones[n] = done;
+    c8_vecenv_observe(v, &m->s.screen, v->obs + n * v->obs_size);
+}
+
+static void c8_vecenv_work(c8_vecenv_worker* w)
+{
+    c8_vecenv* v = w->v;
+    for (uint32_t n = w->first; n < w->first + w->count; ++n)
+    {
+        if (v->job == C8_VECENV_JOB_STEP)
+        {
+            c8_vecenv_step_env(v, n, v->keys[n]);
+            continue;
+        }
+        c8_vecenv_restart(v, n);
+        v->rewards[n] = 0.0f;
+        v->dones[n] = 0;
+        c8_vecenv_observe(v, &v->envs[n].m->s.screen, v->obs + n * v->obs_size);
+    }
+}
+
+static int c8_vecenv_worker_main(void* data)
+{
+    c8_vecenv_worker* w = data;
+    c8_vecenv* v = w->v;
+    uint32_t seen = 0;
+    for (;;)
+    {
+        SDL_LockMutex(v->lock);
+        while (v->gen == seen && !v->quit)
+            SDL_CondWait(v->go, v->lock);
+        seen = v->gen;
+        const bool quit = v->quit;
+        SDL_UnlockMutex(v->lock);
+        if (quit)
+            break;
+
+        c8_vecenv_work(w);
+
+        SDL_LockMutex(v->lock);
+        if (!--v->pending)
+            SDL_CondSignal(v->finished);
+        SDL_UnlockMutex(v->lock);
+    }
+    return 0;
+}
+
+/* every worker does its envs, the calling thread being the first of them */
+static void c8_vecenv_dispatch(c8_vecenv* v, c8_vecenv_job job)
+{
+    v->job = (uint8_t)job;
+    if (v->nworkers > 1)
+    {
+        SDL_LockMutex(v->lock);
+        ++v->gen;
+        v->pending = v->nworkers - 1;
+        SDL_CondBroadcast(v->go);
+        SDL_UnlockMutex(v->lock);
+    }
+    c8_vecenv_work(&v->workers[0]);
+    if (v->nworkers > 1)
+    {
+        SDL_LockMutex(v->lock);
+        while (v->pending)
+            SDL_CondWait(v->finished, v->lock);
+        SDL_UnlockMutex(v->lock);
+    }
+}
+
+void c8_vecenv_defaults(c8_vecenv_opts* o)
+{
+    memset(o, 0, sizeof(*o));
+    o->nenvs = 64;
+    o->frame_cycles = C8_CYCLES_PER_FRAME;
+    o->obs_format = C8_OBS_BITS;
+    o->seed = 1;
+}
+
+c8_vecenv* c8_vecenv_create(const c8_vecenv_opts* o, const c8_machine* base)
+{
+    if (!o->nenvs || o->nrewards > C8_VECENV_MAX_REWARDS)
+        return NULL;
+    for (uint8_t r = 0; r < o->nrewards; ++r)
+    {
+        if (o->rewards[r].bytes < 1 || o->rewards[r].bytes > 4)
+            return NULL;
+    }
+    c8_vecenv* v = calloc(1, sizeof(c8_vecenv));
+    if (!v)
+        return NULL;
+    v->o = *o;
+    /* the same every time, so two envs made at once both writing it is harmless */
+    if (!c8_vecenv_spread[255])
+        c8_vecenv_spread_init();
+    if (!v->o.frame_cycles)
+        v->o.frame_cycles = C8_CYCLES_PER_FRAME;
+
+    const size_t pixels = v->o.obs_hires ? C8_HIRES_WIDTH * C8_HIRES_HEIGHT : C8_WIDTH * C8_HEIGHT;
+    v->obs_size = v->o.obs_format == C8_OBS_BITS ? pixels / 8 : pixels;
+
+    v->nworkers = o->threads ? o->threads : (uint32_t)SDL_GetCPUCount();
+    if (v->nworkers < 1)
+        v->nworkers = 1;
+    if (v->nworkers > C8_VECENV_MAX_THREADS)
+        v->nworkers = C8_VECENV_MAX_THREADS;
+    if (v->nworkers > o->nenvs)
+        v->nworkers = o->nenvs;
+
+    v->pool = c8_pool_create(o->nenvs);
+    v->envs = calloc(o->nenvs, sizeof(c8_vecenv_slot));
+    v->base = malloc(c8_state_size(&base->s));
+    v->own_obs = malloc(v->obs_size * o->nenvs);
+    v->own_rewards = malloc(sizeof(float) * o->nenvs);
+    v->own_dones = malloc(o->nenvs);
+    v->lock = SDL_CreateMutex();
+    v->go = SDL_CreateCond();
+    v->finished = SDL_CreateCond();
+    if (!v->pool || !v->envs || !v->base || !v->own_obs || !v->own_rewards || !v->own_dones ||
+        !v->lock || !v->go || !v->finished)
+    {
+        fprintf(stderr, "c8_vecenv: out of memory for %u envs\n", o->nenvs);
+        c8_vecenv_destroy(v);
+        return NULL;
+    }
+    v->obs = v->own_obs;
+    v->rewards = v->own_rewards;
+    v->dones = v->own_dones;
+    c8_state_copy(v->base, &base->s);
+
+    for (uint32_t n = 0; n < o->nenvs; ++n)
+    {
+        c8_machine* m = c8_pool_acquire(v->pool);
+        m->initd = base->initd;
+        m->rom_loaded = base->rom_loaded;
+        m->rom_size = base->rom_size;
+        /* so a bad op ends the episode instead of the process */
+        c8_debug_attach(m, true);
+        v->envs[n].m = m;
+    }
+
+    /* the first few get one env more when they dont split evenly */
+    uint32_t first = 0;
+    for (uint32_t t = 0; t < v->nworkers; ++t)
+    {
+        c8_vecenv_worker* w = &v->workers[t];
+        w->v = v;
+        w->first = first;
+        w->count = o->nenvs / v->nworkers + (t < o->nenvs % v->nworkers ? 1 : 0);
+        first += w->count;
+    }
+    for (uint32_t t = 1; t < v->nworkers; ++t)
+    {
+        v->workers[t].thread = SDL_CreateThread(c8_vecenv_worker_main, "c8vecenv", &v->workers[t]);
+        if (!v->workers[t].thread)
+        {
+            /* the threads so far wait on a gen that never comes */
+            fprintf(stderr, "c8_vecenv: no thread, %s\n", SDL_GetError());
+            c8_vecenv_destroy(v);
+            return NULL;
+        }
+    }
+
+    c8_vecenv_reset(v);
+    return v;
+}
+
+void c8_vecenv_destroy(c8_vecenv* v)
+{
+    if (!v)
+        return;
+    if (v->lock)
+    {
+        SDL_LockMutex(v->lock);
+        v->quit = true;
+        SDL_CondBroadcast(v->go);
+        SDL_UnlockMutex(v->lock);
+    }
+    for (uint32_t t = 1; t < v->nworkers; ++t)
+    {
+        if (v->workers[t].thread)
+            SDL_WaitThread(v->workers[t].thread, NULL);
+    }
+    c8_pool_destroy(v->pool);
+    free(v->envs);
+    free(v->base);
+    free(v->own_obs);
+    free(v->own_rewards);
+    free(v->own_dones);
+    if (v->finished)
+        SDL_DestroyCond(v->finished);
+    if (v->go)
+        SDL_DestroyCond(v->go);
+    if (v->lock)
+        SDL_DestroyMutex(v->lock);
+    free(v);
+}
+
+size_t c8_vecenv_obs_size(const c8_vecenv* v)
+{
+    return v->obs_size;
+}
+
+void c8_vecenv_bind(c8_vecenv* v, uint8_t* obs, float* rewards, uint8_t* dones)
+{
+    if (obs)
+    {
+        memcpy(obs, v->obs, v->obs_size * v->o.nenvs);
+        v->obs = obs;
+    }
+    if (rewards)
+    {
+        memcpy(rewards, v->rewards, sizeof(float) * v->o.nenvs);
+        v->rewards = rewards;
+    }
+    if (dones)
+    {
+        memcpy(dones, v->dones, v->o.nenvs);
+        v->dones = dones;
+    }
+}
+
+uint8_t* c8_vecenv_obs(const c8_vecenv* v)
+{
+    return v->obs;
+}
+
+float* c8_vecenv_rewards(const c8_vecenv* v)
+{
+    return v->rewards;
+}
+
+uint8_t* c8_vecenv_dones(const c8_vecenv* v)
+{
+    return v->dones;
+}
+
+void c8_vecenv_reset(c8_vecenv* v)
+{
+    for (uint32_t n = 0; n < v->o.nenvs; ++n)
+        v->envs[n].episodes = 0;
+    c8_vecenv_dispatch(v, C8_VECENV_JOB_RESET);
+}
+
+void c8_vecenv_step(c8_vecenv* v, const uint16_t* keys)
+{
+    v->keys = keys;
+    c8_vecenv_dispatch(v, C8_VECENV_JOB_STEP);
+}
+
+const c8_machine* c8_vecenv_machine(const c8_vecenv* v, uint32_t env)
+{
+    return env < v->o.nenvs ? v->envs[env].m : NULL;
+}
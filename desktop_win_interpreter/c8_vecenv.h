@@ -0,0 +1,79 @@
+#pragma once
+#include "c8.h"
+
+/* many copies of one rom stepped a frame at a time, for training agents on it.
+c8_vecenv_step takes a keypad state for every env, runs each of them one frame
+and leaves the screens, rewards and dones in flat arrays, env after env. those can
+be the caller's own (a numpy array, a tensor) so nothing gets copied out after.
+
+envs are split into one run of them a thread, the calling thread does the first.
+machines come out of one c8_pool so a thread's envs sit next to each other, and
+nothing is allocated once the env is made.
+
+rewards are what some memory the rom keeps (usually its score) went up by. an env
+is done when it faults, halts (00FD), a byte of memory says so or it has run
+max_frames. it goes back to the start at the beginning of the next step, so the
+action given for it then is the first of a new episode */
+
+#define C8_VECENV_MAX_REWARDS   (8)
+
+typedef enum
+{
+    C8_OBS_BITS = 0,        /* a bit a pixel, lit on any plane. rows of width / 8 bytes, msb on the left */
+    C8_OBS_BYTES,           /* a byte a pixel, the planes its lit on (plain chip-8 only has 1) */
+} c8_obs_format;
+
+/* what an env's entry in the dones array says */
+#define C8_VECENV_DONE          (0x01) /* faulted, halted or the done byte said so */
+#define C8_VECENV_CUT           (0x02) /* ran out of max_frames */
+
+typedef struct
+{
+    uint16_t addr;
+    uint8_t bytes;          /* 1 - 4, big endian */
+    bool bcd;               /* a digit a byte, the way FX33 leaves it */
+    float scale;            /* reward per unit it goes up by, negative for lives */
+} c8_reward_src;
+
+typedef struct
+{
+    uint32_t nenvs;
+    uint32_t threads;       /* 0 for one a core */
+    uint32_t frame_cycles;  /* ops a step, 0 for C8_CYCLES_PER_FRAME */
+    uint32_t max_frames;    /* steps before an episode is cut short, 0 for never */
+    uint32_t seed;          /* CXNN seeds for each env and episode come from this */
+    uint8_t obs_format;     /* c8_obs_format */
+    /* 128x64 observations rather than 64x32. the other resolution is scaled to fit,
+    halving ors 2x2 pixels together */
+    bool obs_hires;
+    c8_reward_src rewards[C8_VECENV_MAX_REWARDS];
+    uint8_t nrewards;
+    /* done once mem[done_addr] == done_value */
+    bool done_on_mem;
+    uint16_t done_addr;
+    uint8_t done_value;
+} c8_vecenv_opts;
+
+typedef struct c8_vecenv c8_vecenv;
+
+void c8_vecenv_defaults(c8_vecenv_opts* o);
+/* base is loaded and c8_init'd, every episode starts from it as it stands */
+c8_vecenv* c8_vecenv_create(const c8_vecenv_opts* o, const c8_machine* base);
+void c8_vecenv_destroy(c8_vecenv* v);
+
+/* bytes of observation an env, a multiple of 64 */
+size_t c8_vecenv_obs_size(const c8_vecenv* v);
+/* write into these from now on instead of the env's own. obs is nenvs * obs_size
+bytes, rewards and dones nenvs long. NULL leaves that one where it is */
+void c8_vecenv_bind(c8_vecenv* v, uint8_t* obs, float* rewards, uint8_t* dones);
+uint8_t* c8_vecenv_obs(const c8_vecenv* v);
+float* c8_vecenv_rewards(const c8_vecenv* v);
+uint8_t* c8_vecenv_dones(const c8_vecenv* v);
+
+/* every env back to the start, observations filled in, rewards and dones cleared */
+void c8_vecenv_reset(c8_vecenv* v);
+/* keys[n] is the keypad env n holds down for the frame, bit per key */
+void c8_vecenv_step(c8_vecenv* v, const uint16_t* keys);
+
+/* for looking at, not for stepping */
+const c8_machine* c8_vecenv_machine(const c8_vecenv* v, uint32_t env);
@@ -3,25 +3,366 @@
 */
 
 #include "c8.h"
+#include "c8_trace.h"
+#include "c8_gdb.h"
+#include "c8_net.h"
+#include "c8_input.h"
+#include "c8_ring.h"
+#include "c8_tribuf.h"
+#include "c8_audio.h"
 
+/* the machine runs on its own thread so a slow present or a vsync wait never holds
+it up. main thread pumps events and renders. they talk through lock free queues
+only: keys and commands one way, finished frames the other */
 
-static void init(SDL_Renderer* renderer)
+static c8_machine machine;
+static c8_keyq keyq;
+static c8_tribuf frames;
+static c8_audio audio;
+
+enum
 {
-    SDL_SetRenderDrawColor(renderer, 0x1f, 0x1f, 0x1f, 0xff);
-	SDL_RenderClear(renderer);
-    SDL_SetRenderDrawColor(renderer, 0x00, 0xc2, 0x00, 0xff);
-    SDL_RenderSetScale(renderer, (float)C8_PIXEL_SCALE, (float)C8_PIXEL_SCALE);
-    srand((unsigned int)time(NULL));
-    c8_init();
+    CMD_LOAD,               /* arg is an SDL_malloc'd path, the emu thread frees it */
+    CMD_CONTINUE,
+    CMD_STEP,
+    CMD_REVERSE_STEP,
+    CMD_REVERSE_CONTINUE,
+};
+
+typedef struct
+{
+    int type;
+    char* arg;
+} emu_cmd;
+
+#define EMU_CMD_SIZE            (64)
+
+static c8_ring cmd_ring;
+static emu_cmd cmds[EMU_CMD_SIZE];
+static SDL_atomic_t emu_quit;
+/* pushed by the emu thread whenever it publishes a frame, so the main thread can
+block in SDL_WaitEvent instead of polling */
+static Uint32 frame_event;
+
+/* --runahead N. what's shown comes from a copy of the machine run N frames on with the
+keys held now, so a rom that takes a few frames to react to a key shows it straight
+away. the copy is thrown away every frame, the machine itself still goes one frame at
+a time, so nothing it does (trace, history, sound) ever sees the frames run ahead */
+#define RUNAHEAD_MAX            (8)
+static uint32_t runahead;
+static c8_machine ahead;
+/* screen hash of the last run ahead frame sent, unless the machine's own went since */
+static uint64_t ahead_shown;
+static bool ahead_shown_valid;
+
+/* a gdb listener has to be polled to accept, so idle waits are capped while its up */
+#define GDB_ACCEPT_POLL_MS      (100)
+
+/* COSMAC VIP keypad on the left hand side of the keyboard, by position so it works
+whatever the layout
+    1 2 3 C        1 2 3 4
+    4 5 6 D   <-   Q W E R
+    7 8 9 E        A S D F
+    A 0 B F        Z X C V */
+static int keypad_key(SDL_Scancode sc)
+{
+    static const SDL_Scancode map[16] = {
+        SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
+        SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,
+        SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,
+        SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V,
+    };
+    for (int k = 0; k < 16; ++k)
+    {
+        if (map[k] == sc)
+            return k;
+    }
+    return -1;
+}
+
+/* main thread side. the keyq semaphore doubles as the emu threads wake up call */
+static void emu_post(int type, char* arg)
+{
+    if (!c8_ring_free(&cmd_ring, EMU_CMD_SIZE))
+    {
+        SDL_free(arg);
+        return;
+    }
+    emu_cmd* c = &cmds[c8_ring_head_slot(&cmd_ring, EMU_CMD_SIZE)];
+    c->type = type;
+    c->arg = arg;
+    c8_ring_publish(&cmd_ring, 1);
+    SDL_SemPost(keyq.wake);
+}
+
+static void emu_publish_frame(void)
+{
+    c8_frame* f = c8_tribuf_back(&frames);
+    if (c8_grab_frame(&machine, &f->screen))
+    {
+        ahead_shown_valid = false;
+        f->cycle = machine.s.cycles;
+        c8_tribuf_publish(&frames);
+
+        SDL_Event e;
+        SDL_zero(e);
+        e.type = frame_event;
+        SDL_PushEvent(&e);
+    }
+}
+
+/* after each frame while running. a copy is a few kb for anything but xo-chip and a
+frame is C8_CYCLES_PER_FRAME ops, so the whole thing is a few microseconds */
+static void emu_run_ahead(void)
+{
+    c8_state_copy(&ahead.s, &machine.s);
+    ahead.faulted = false;
+    for (uint32_t n = 0; n < runahead * C8_CYCLES_PER_FRAME && !ahead.faulted; ++n)
+        c8_cycle(&ahead);
+
+    /* shown instead of the machine's own. only sent when it changed */
+    machine.gfx_dirty = false;
+    const uint64_t hash = c8_state_screen_hash(&ahead.s);
+    if (ahead_shown_valid && hash == ahead_shown)
+        return;
+    ahead_shown = hash;
+    ahead_shown_valid = true;
+
+    c8_frame* f = c8_tribuf_back(&frames);
+    f->screen = ahead.s.screen;
+    /* keys pressed while looking at it still go to the machine as it is now */
+    f->cycle = machine.s.cycles;
+    c8_tribuf_publish(&frames);
+
+    SDL_Event e;
+    SDL_zero(e);
+    e.type = frame_event;
+    SDL_PushEvent(&e);
+}
+
+/* tells the audio thread how far the machine has got, it plays a little behind that */
+static void emu_audio_clock(void)
+{
+    if (audio.dev)
+        c8_audio_post(&audio, machine.s.cycles, C8_AUDIO_CLOCK, 0);
+}
+
+static void emu_stopped(c8_stop stop, bool* paused)
+{
+    if (c8_gdb_attached())
+    {
+        c8_gdb_stopped(stop);
+        return;
+    }
+    /* the real screen while paused, not one from the future */
+    machine.gfx_dirty = true;
+    fprintf(stderr, "stopped: %s at 0x%03x (F5 continue, F10 step)\n", c8_stop_name(stop),
+        c8_stop_addr(&machine));
+    c8_fault fault;
+    if (c8_get_fault(&machine, &fault))
+    {
+        fprintf(stderr, "%s, op %04x on cycle %llu. drop a rom to start again\n", c8_fault_name(fault.reason),
+            fault.op, (unsigned long long)fault.cycle);
+    }
+    c8_print_state(&machine, stderr);
+    *paused = true;
+}
+
+static void emu_commands(bool* paused)
+{
+    uint32_t n = c8_ring_avail(&cmd_ring);
+    for (uint32_t c = 0; c < n; ++c)
+    {
+        emu_cmd* cmd = &cmds[(cmd_ring.tail + c) & (EMU_CMD_SIZE - 1)];
+        bool loaded = c8_running(&machine);
+        switch (cmd->type)
+        {
+        case CMD_LOAD:
+            if (c8_load_rom(&machine, cmd->arg))
+            {
+                /* call full init. we want to clear anything left over */
+                c8_seed(&machine, (uint32_t)time(NULL));
+                c8_init(&machine);
+                machine.gfx_dirty = true;
+                /* a new rom runs, whatever the last one was stopped on */
+                *paused = false;
+            }
+            SDL_free(cmd->arg);
+            break;
+        case CMD_CONTINUE:
+            *paused = false;
+            break;
+        case CMD_STEP:
+            if (*paused && loaded)
+            {
+                c8_run(&machine, 1);
+                c8_print_state(&machine, stderr);
+            }
+            break;
+        case CMD_REVERSE_STEP:
+            if (*paused && loaded)
+            {
+                if (c8_reverse_step(&machine) == C8_STOP_HISTORY_START)
+                    fprintf(stderr, "at the start of history\n");
+                c8_print_state(&machine, stderr);
+            }
+            break;
+        case CMD_REVERSE_CONTINUE:
+            if (*paused && loaded)
+            {
+                c8_stop stop = c8_reverse_continue(&machine);
+                fprintf(stderr, "reversed to: %s at 0x%03x\n", c8_stop_name(stop), c8_stop_addr(&machine));
+                c8_print_state(&machine, stderr);
+            }
+            break;
+        }
+    }
+    c8_ring_release(&cmd_ring, n);
+}
+
+/* how long to sleep when nothing is due on our side. forever unless gdb needs polling */
+static uint32_t emu_idle_wait(void)
+{
+    return c8_gdb_listening() ? GDB_ACCEPT_POLL_MS : SDL_MUTEX_MAXWAIT;
+}
+
+static int SDLCALL emu_thread(void* data)
+{
+    (void)data;
+    const uint64_t period = SDL_GetPerformanceFrequency() / 60;
+    uint64_t next = SDL_GetPerformanceCounter();
+    bool paused = false;
+
+    while (!SDL_AtomicGet(&emu_quit))
+    {
+        emu_commands(&paused);
+
+        /* while gdb has the machine stopped it does the waiting, so steps come back
+        without a frame of lag */
+        bool gdb_go = c8_gdb_poll(c8_gdb_attached() ? C8_FRAME_DELAY_MS : 0);
+        emu_publish_frame();
+        emu_audio_clock();
+
+        if (!c8_running(&machine) || paused || !gdb_go)
+        {
+            /* nothing to run, sleep until poked. gdb gets polled either way */
+            if (!c8_gdb_attached())
+                c8_keyq_wait(&keyq, emu_idle_wait());
+            next = SDL_GetPerformanceCounter();
+            continue;
+        }
+
+        uint64_t now = SDL_GetPerformanceCounter();
+        if (c8_waiting(&machine))
+        {
+            /* parked on FX0A - sleep until a key comes in. the time asleep goes to the
+            timers before the key is looked at */
+            c8_keyq_wait(&keyq, emu_idle_wait());
+            now = SDL_GetPerformanceCounter();
+            if (now > next)
+            {
+                const uint64_t slept = (now - next) / period;
+                c8_idle(&machine, (uint32_t)(slept * C8_CYCLES_PER_FRAME));
+                next += slept * period;
+            }
+        }
+        else if (now < next)
+        {
+            /* sleep right up to the next frame. round up, waking a hair late costs
+            nothing on an absolute schedule but waking early means spinning */
+            const uint64_t freq = SDL_GetPerformanceFrequency();
+            c8_keyq_wait(&keyq, (uint32_t)(((next - now) * 1000 + freq - 1) / freq));
+            continue;
+        }
+
+        /* fell behind (debugger, machine asleep) - dont try to catch up with a burst */
+        if (SDL_GetPerformanceCounter() - next > period * 4)
+            next = SDL_GetPerformanceCounter();
+        next += period;
+
+        c8_stop stop = c8_run(&machine, C8_CYCLES_PER_FRAME);
+        if (stop != C8_STOP_NONE)
+            emu_stopped(stop, &paused);
+        else if (runahead)
+            emu_run_ahead();
+        emu_publish_frame();
+        emu_audio_clock();
+    }
+
+    c8_gdb_close();
+    return 0;
+}
+
+/* unpack the bit rows to display format. the texture is hi-res sized, lo-res only
+fills the top left and only that part gets drawn. returns the part to draw */
+static SDL_Rect upload_frame(SDL_Texture* texture, const c8_frame* f)
+{
+    const c8_display* d = &f->screen;
+    const SDL_Rect used = { 0, 0, d->hires ? C8_HIRES_WIDTH : C8_WIDTH, d->hires ? C8_HIRES_HEIGHT : C8_HEIGHT };
+    /* indexed by plane bits, plain chip-8 only ever uses the first two */
+    static const uint32_t palette[4] = { 0xff1f1f1f, 0xff00c200, 0xff0070c2, 0xffe0e0e0 };
+    static uint32_t argb[C8_HIRES_WIDTH * C8_HIRES_HEIGHT];
+    for (int y = 0; y < used.h; ++y)
+    {
+        for (int x = 0; x < used.w; ++x)
+        {
+            const int shift = 63 - (x & 63);
+            const int c = (int)((d->rows[0][y][x >> 6] >> shift) & 1) | (int)(((d->rows[1][y][x >> 6] >> shift) & 1) << 1);
+            argb[y * C8_HIRES_WIDTH + x] = palette[c];
+        }
+    }
+    SDL_UpdateTexture(texture, &used, argb, C8_HIRES_WIDTH * sizeof(uint32_t));
+    return used;
 }
 
 int main(int argc, char** argv)
 {
-    (void*)argc;
-    (void*)argv;
+    for (int a = 1; a < argc; ++a)
+    {
+        /* --trace file.c8t - binary trace of every op, read it back with tools/c8trace */
+        if (strcmp(argv[a], "--trace") == 0 && a + 1 < argc)
+        {
+            c8_trace_open(argv[++a]);
+        }
+        /* --reverse - keep checkpoints so a paused machine can go backwards, F9 steps back
+        and shift+F5 runs back to the last breakpoint / watch hit */
+        else if (strcmp(argv[a], "--reverse") == 0)
+        {
+            c8_reverse_enable(&machine, true);
+        }
+        /* --break 0x20c / --watch 0x3a0 - pause there, F5 continues, F10 steps */
+        else if (strcmp(argv[a], "--break") == 0 && a + 1 < argc)
+        {
+            c8_break_set(&machine, (uint16_t)strtoul(argv[++a], NULL, 0));
+        }
+        else if (strcmp(argv[a], "--watch") == 0 && a + 1 < argc)
+        {
+            c8_watch_set(&machine, (uint16_t)strtoul(argv[++a], NULL, 0), C8_WATCH_READ | C8_WATCH_WRITE);
+        }
+        /* --watch-reg VF - pause when an op changes the register */
+        else if (strcmp(argv[a], "--watch-reg") == 0 && a + 1 < argc)
+        {
+            const char* reg = argv[++a];
+            if (reg[0] == 'V' || reg[0] == 'v')
+                ++reg;
+            c8_watch_reg(&machine, (uint8_t)strtoul(reg, NULL, 16), true);
+        }
+        /* --runahead 2 - show frames from 2 frames ahead, hides a roms own input lag */
+        else if (strcmp(argv[a], "--runahead") == 0 && a + 1 < argc)
+        {
+            runahead = (uint32_t)strtoul(argv[++a], NULL, 0);
+            if (runahead > RUNAHEAD_MAX)
+                runahead = RUNAHEAD_MAX;
+        }
+        /* --gdb 1234 - gdb remote stub on 127.0.0.1:1234, "target remote :1234" */
+        else if (strcmp(argv[a], "--gdb") == 0 && a + 1 < argc)
+        {
+            c8_gdb_listen(&machine, (uint16_t)strtoul(argv[++a], NULL, 0));
+        }
+    }
 
     SDL_Window* window = NULL;
-    SDL_Renderer* renderer;
+    SDL_Renderer* renderer = NULL;
 
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
     {
@@ -29,9 +370,12 @@ int main(int argc, char** argv)
         return -1;
     }
 
-    /* create the window at scale */
-    SDL_CreateWindowAndRenderer((int)(C8_WIDTH * C8_PIXEL_SCALE), 
-        (int)(C8_HEIGHT * (C8_PIXEL_SCALE)), SDL_WINDOW_SHOWN, &window, &renderer);
+    /* create the window at scale. vsync just keeps presents tear free, this thread is
+    paced by frames arriving from the emulator */
+    window = SDL_CreateWindow("CHIP8 Interp - Drag a ROM onto me!", SDL_WINDOWPOS_UNDEFINED,
+        SDL_WINDOWPOS_UNDEFINED, C8_WIDTH * C8_PIXEL_SCALE, C8_HEIGHT * C8_PIXEL_SCALE, SDL_WINDOW_SHOWN);
+    if (window)
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
 
     if (!window || !renderer)
     {
@@ -39,14 +383,45 @@ int main(int argc, char** argv)
         return -1;
     }
 
-    SDL_SetWindowTitle(window, "CHIP8 Interp - Drag a ROM onto me!");
+    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+        C8_HIRES_WIDTH, C8_HIRES_HEIGHT);
+    SDL_SetRenderDrawColor(renderer, 0x1f, 0x1f, 0x1f, 0xff);
     SDL_EventState(SDL_DROPFILE, SDL_ENABLE);
 
+    /* a bad op ahead just stops the copy there, the machine gets to it for real later.
+never traced */
+    c8_debug_attach(&ahead, true);
+    ahead.trace_next = UINT64_MAX;
+
+    c8_tribuf_init(&frames);
+    c8_ring_reset(&cmd_ring);
+    c8_keyq_init(&keyq);
+    c8_set_keyq(&machine, &keyq);
+    if (c8_audio_open(&audio))
+        c8_set_audio(&machine, &audio);
+    SDL_AtomicSet(&emu_quit, 0);
+    frame_event = SDL_RegisterEvents(1);
+    SDL_Thread* emu = SDL_CreateThread(emu_thread, "c8 emu", NULL);
+    if (!emu)
+    {
+        fprintf(stderr, "failed to start emulation thread\n");
+        return -1;
+    }
+
+    /* cycle of the frame on screen, key events are stamped with it */
+    uint64_t shown_cycle = 0;
+    SDL_Rect shown = { 0, 0, C8_WIDTH, C8_HEIGHT };
+
     SDL_Event sevt;
     bool done = false;
+    bool repaint = true;
     while (!done)
     {
-        while (SDL_PollEvent(&sevt) != 0)
+        /* nothing here runs on a timer. new frames from the emu thread come in as events
+        so this sleeps until theres input, a frame, or the window needs repainting */
+        if (!SDL_WaitEvent(&sevt))
+            break;
+        do
         {
             switch (sevt.type)
             {
@@ -54,48 +429,66 @@ int main(int argc, char** argv)
                 done = true;
                 break;
             case SDL_DROPFILE:
-            {
-                bool loaded_ok = c8_load_rom(sevt.drop.file);
-                if (loaded_ok)
-                {
-                    /* call full init. we want to clear anything left over */
-	                init(renderer);
-                }
-                SDL_free(sevt.drop.file);
+                emu_post(CMD_LOAD, sevt.drop.file);
                 break;
-            }
             case SDL_KEYUP:
-                //printf("key up %u\n", sevt.key.keysym.sym);
-                break;
             case SDL_KEYDOWN:
-                //printf("key down %u\n", sevt.key.keysym.sym);
+            {
+                /* machine picks these up at the next op */
+                int key = keypad_key(sevt.key.keysym.scancode);
+                if (key >= 0 && !sevt.key.repeat)
+                    c8_keyq_push(&keyq, shown_cycle, (uint8_t)key, sevt.type == SDL_KEYDOWN);
+                if (sevt.type == SDL_KEYUP)
+                    break;
+                /* debugger keys, only do anything while paused */
+                if (sevt.key.keysym.sym == SDLK_F5 && (sevt.key.keysym.mod & KMOD_SHIFT))
+                    emu_post(CMD_REVERSE_CONTINUE, NULL);
+                else if (sevt.key.keysym.sym == SDLK_F5)
+                    emu_post(CMD_CONTINUE, NULL);
+                else if (sevt.key.keysym.sym == SDLK_F10)
+                    emu_post(CMD_STEP, NULL);
+                else if (sevt.key.keysym.sym == SDLK_F9)
+                    emu_post(CMD_REVERSE_STEP, NULL);
                 break;
             }
-        }
-
-        bool running = c8_running();
-        if (!running)
-        {
-            SDL_Delay(100);
-            continue;
-        }
+            case SDL_WINDOWEVENT:
+                if (sevt.window.event == SDL_WINDOWEVENT_EXPOSED
+                    || sevt.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                    repaint = true;
+                break;
+            }
+        } while (SDL_PollEvent(&sevt) != 0);
 
-        for (int x = 0; x < C8_CYCLES_PER_FRAME; ++x)
+        /* several frame events may have piled up behind a vsync, only the newest
+        frame matters */
+        const c8_frame* f = c8_tribuf_acquire(&frames);
+        if (f)
         {
-            c8_cycle();
+            shown_cycle = f->cycle;
+            shown = upload_frame(texture, f);
+            repaint = true;
         }
 
-        if (c8_gfx_dirty())
+        if (repaint)
         {
-            c8_draw_frame(renderer);
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, texture, &shown, NULL);
             SDL_RenderPresent(renderer);
+            repaint = false;
         }
-
-		SDL_Delay(C8_FRAME_DELAY_MS);
     }
 
-    SDL_DestroyWindow(window);
+    SDL_AtomicSet(&emu_quit, 1);
+    SDL_SemPost(keyq.wake);
+    SDL_WaitThread(emu, NULL);
+    c8_audio_close(&audio);
+
+    c8_net_quit();
+    c8_trace_close();
+    c8_keyq_destroy(&keyq);
+    SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
     SDL_Quit();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,219 @@
+/* c8blit_bench - time the sprite blitters against each other
+
+    c8blit_bench [--iters N] [--seed S]
+
+first checks every blitter this cpu has gives the same screen and collision flag as
+the scalar one for random sprites, then times 8xN lo-res, 16x16 hi-res and 16x16
+two plane draws with each of them. "bytes" is the old byte-a-pixel screen with the
+bit-by-bit loop the interpreter used to draw with, for comparison.
+*/
+
+/* plain console main, no SDL2main */
+#define SDL_MAIN_HANDLED
+#include "../c8_blit.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_SPRITES           (4096)
+#define BENCH_CHECKS            (100000)
+
+typedef struct
+{
+    uint8_t x, y, nrows;
+    uint64_t bits[C8_BLIT_MAX_ROWS];
+} bench_sprite;
+
+typedef struct
+{
+    const char* name;
+    bool hires;
+    uint8_t planes;
+    bool big;
+} bench_case;
+
+static uint32_t rng_state = 1;
+
+static uint32_t bench_rand(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void bench_make_sprite(bench_sprite* sp, bool big)
+{
+    sp->x = (uint8_t)bench_rand();
+    sp->y = (uint8_t)bench_rand();
+    sp->nrows = big ? 16 : 1 + bench_rand() % 15;
+    for (uint8_t l = 0; l < sp->nrows; ++l)
+        sp->bits[l] = big ? (uint64_t)(bench_rand() & 0xffff) << 48 : (uint64_t)(bench_rand() & 0xff) << 56;
+}
+
+/* the same draw the interpreter does - split at the bottom edge */
+static bool bench_draw(c8_blit_fn blit, c8_display* d, uint8_t planes, const bench_sprite* sp)
+{
+    const uint8_t h = d->hires ? C8_HIRES_HEIGHT : C8_HEIGHT;
+    const uint8_t y0 = sp->y % h;
+    const uint8_t first = sp->nrows < h - y0 ? sp->nrows : h - y0;
+    bool hit = false;
+    for (uint8_t p = 0; p < planes; ++p)
+    {
+        hit |= blit(&d->rows[p][y0], sp->bits, first, sp->x, d->hires);
+        if (first < sp->nrows)
+            hit |= blit(&d->rows[p][0], sp->bits + first, sp->nrows - first, sp->x, d->hires);
+    }
+    return hit;
+}
+
+/* what drawing was before the screen got packed */
+static uint8_t byte_screen[C8_PLANES][C8_HIRES_HEIGHT * C8_HIRES_WIDTH];
+
+static bool bench_draw_bytes(bool hires, uint8_t planes, const bench_sprite* sp)
+{
+    const uint32_t w = hires ? C8_HIRES_WIDTH : C8_WIDTH;
+    const uint32_t h = hires ? C8_HIRES_HEIGHT : C8_HEIGHT;
+    bool hit = false;
+    for (uint8_t p = 0; p < planes; ++p)
+    {
+        for (uint8_t l = 0; l < sp->nrows; ++l)
+        {
+            for (uint8_t b = 0; b < 16; ++b)
+            {
+                if (!((sp->bits[l] >> (63 - b)) & 1))
+                    continue;
+                const uint32_t target = ((sp->x + b) % w) + ((sp->y + l) % h) * w;
+                if (byte_screen[p][target])
+                {
+                    byte_screen[p][target] = 0;
+                    hit = true;
+                }
+                else
+                {
+                    byte_screen[p][target] = 0xff;
+                }
+            }
+        }
+    }
+    return hit;
+}
+
+static bool bench_check(const char* name, c8_blit_fn blit)
+{
+    static c8_display want, got;
+    memset(&want, 0, sizeof(want));
+    memset(&got, 0, sizeof(got));
+    for (int n = 0; n < BENCH_CHECKS; ++n)
+    {
+        /* flip resolution now and then so both kinds see a dirty screen */
+        if (!(n & 1023))
+        {
+            want.hires = got.hires = !want.hires;
+        }
+        bench_sprite sp;
+        bench_make_sprite(&sp, want.hires && (bench_rand() & 1));
+        const bool a = bench_draw(c8_blit_scalar, &want, C8_PLANES, &sp);
+        const bool b = bench_draw(blit, &got, C8_PLANES, &sp);
+        if (a != b || memcmp(want.rows, got.rows, sizeof(want.rows)))
+        {
+            fprintf(stderr, "c8blit_bench: %s differs from scalar at sprite %d (x %u y %u rows %u %s)\n", name, n,
+                sp.x, sp.y, sp.nrows, want.hires ? "hi-res" : "lo-res");
+            return false;
+        }
+    }
+    printf("%-8s matches scalar over %d sprites\n", name, BENCH_CHECKS);
+    return true;
+}
+
+static double bench_secs(uint64_t ticks)
+{
+    return (double)ticks / (double)SDL_GetPerformanceFrequency();
+}
+
+int main(int argc, char** argv)
+{
+    int iters = 200;
+    for (int a = 1; a < argc; ++a)
+    {
+        if (!strcmp(argv[a], "--iters") && a + 1 < argc)
+            iters = atoi(argv[++a]);
+        else if (!strcmp(argv[a], "--seed") && a + 1 < argc)
+            rng_state = (uint32_t)strtoul(argv[++a], NULL, 0) | 1;
+        else
+        {
+            fprintf(stderr, "usage: c8blit_bench [--iters N] [--seed S]\n");
+            return 1;
+        }
+    }
+
+    struct
+    {
+        const char* name;
+        c8_blit_fn fn;
+    } blits[3];
+    int nblits = 0;
+    blits[nblits].name = "scalar";
+    blits[nblits++].fn = c8_blit_scalar;
+#if C8_X86
+    if (SDL_HasSSE2())
+    {
+        blits[nblits].name = "sse2";
+        blits[nblits++].fn = c8_blit_sse2;
+    }
+    if (SDL_HasAVX2())
+    {
+        blits[nblits].name = "avx2";
+        blits[nblits++].fn = c8_blit_avx2;
+    }
+#endif
+
+    for (int b = 1; b < nblits; ++b)
+    {
+        if (!bench_check(blits[b].name, blits[b].fn))
+            return 1;
+    }
+
+    static const bench_case cases[] = {
+        { "8xN lo-res", false, 1, false },
+        { "16x16 hi-res", true, 1, true },
+        { "16x16 2 planes", true, 2, true },
+    };
+    static bench_sprite sprites[BENCH_SPRITES];
+    static c8_display d;
+    const double draws = (double)iters * BENCH_SPRITES;
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c)
+    {
+        const bench_case* bc = &cases[c];
+        for (int n = 0; n < BENCH_SPRITES; ++n)
+            bench_make_sprite(&sprites[n], bc->big);
+        printf("\n%s\n", bc->name);
+
+        /* the collision count keeps the compiler from dropping the draws */
+        uint32_t hits = 0;
+        uint64_t t0 = SDL_GetPerformanceCounter();
+        for (int it = 0; it < iters; ++it)
+        {
+            for (int n = 0; n < BENCH_SPRITES; ++n)
+                hits += bench_draw_bytes(bc->hires, bc->planes, &sprites[n]);
+        }
+        const double base = bench_secs(SDL_GetPerformanceCounter() - t0);
+        printf("  %-8s %8.1f ns/sprite  (%u hits)\n", "bytes", base * 1e9 / draws, hits);
+
+        for (int b = 0; b < nblits; ++b)
+        {
+            memset(&d, 0, sizeof(d));
+            d.hires = bc->hires;
+            hits = 0;
+            t0 = SDL_GetPerformanceCounter();
+            for (int it = 0; it < iters; ++it)
+            {
+                for (int n = 0; n < BENCH_SPRITES; ++n)
+                    hits += bench_draw(blits[b].fn, &d, bc->planes, &sprites[n]);
+            }
+            const double secs = bench_secs(SDL_GetPerformanceCounter() - t0);
+            printf("  %-8s %8.1f ns/sprite  %5.1fx  (%u hits)\n", blits[b].name, secs * 1e9 / draws, base / secs, hits);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+/* c8dis - disassemble a rom following control flow from 0x200
+
+    c8dis rom.ch8 [--cache DIR] [--no-cache]
+
+the code/data map is cached in DIR (current directory by default) as <rom hash>.c8map
+so repeat runs and other tools can skip the analysis.
+*/
+
+#include "../c8_disasm.h"
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char** argv)
+{
+    const char* rom_file = NULL;
+    const char* cache_dir = ".";
+    bool use_cache = true;
+
+    for (int a = 1; a < argc; ++a)
+    {
+        if (!strcmp(argv[a], "--cache") && a + 1 < argc)
+            cache_dir = argv[++a];
+        else if (!strcmp(argv[a], "--no-cache"))
+            use_cache = false;
+        else
+            rom_file = argv[a];
+    }
+
+    if (!rom_file)
+    {
+        fprintf(stderr, "usage: c8dis rom.ch8 [--cache DIR] [--no-cache]\n");
+        return 1;
+    }
+
+    FILE* f = fopen(rom_file, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "c8dis: failed to open file '%s'!\n", rom_file);
+        return 1;
+    }
+
+    static uint8_t rom[C8_DIS_MEM_SIZE - C8_DIS_ORIGIN];
+    size_t size = fread(rom, 1, sizeof(rom), f);
+    if (fgetc(f) != EOF)
+        fprintf(stderr, "c8dis: '%s' is bigger than memory, only the first %zu bytes are used\n", rom_file, size);
+    fclose(f);
+
+    static c8_codemap map;
+    uint64_t hash = c8_disasm_hash(rom, size);
+    bool cached = use_cache && c8_codemap_load(cache_dir, hash, &map);
+    if (cached && map.end != C8_DIS_ORIGIN + size)
+    {
+        /* a corrupt file or another rom with the same hash, cant trust it */
+        c8_codemap_free(&map);
+        cached = false;
+    }
+    if (!cached)
+    {
+        if (!c8_disasm_analyze(rom, size, &map))
+        {
+            fprintf(stderr, "c8dis: out of memory\n");
+            return 1;
+        }
+        if (use_cache)
+            c8_codemap_save(cache_dir, &map);
+    }
+
+    c8_disasm_print(stdout, rom, &map);
+    c8_codemap_free(&map);
+    return 0;
+}
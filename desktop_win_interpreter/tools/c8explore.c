@@ -0,0 +1,159 @@
+/* c8explore - every way a rom can go, from every key and random number it reads
+
+    c8explore rom.ch8 [--threads N] [--states N] [--depth N] [--run C]
+                      [--frontier MB] [--best] [--screens DIR] [--paths N]
+
+forks at each EX9E / EXA1 / FX0A / CXNN for every outcome, drops states seen before
+and keeps going until there are no new ones or --states (default 1000000) have been
+found. prints how many distinct states and screens turned up and the choices that
+lead to the first --paths (default 5) faults. --screens writes every distinct
+screen to DIR as a .pbm, named by the order they were found in.
+*/
+
+/* plain console main, no SDL2main */
+#define SDL_MAIN_HANDLED
+#include "../c8_explore.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPLORE_PATH_MAX        (64)
+
+static void explore_print_path(const c8_explore* x, uint32_t node)
+{
+    /* walked from the end, printed from the start */
+    uint32_t path[EXPLORE_PATH_MAX];
+    uint32_t len = 0;
+    uint32_t skipped = 0;
+    for (const c8_explore_step* st = c8_explore_step_at(x, node); st; st = c8_explore_step_at(x, st->parent))
+    {
+        if (st->kind == C8_DECIDE_NONE)
+            break;
+        if (len < EXPLORE_PATH_MAX)
+            path[len++] = node;
+        else
+            ++skipped;
+        node = st->parent;
+    }
+    if (skipped)
+        printf("    ... %u earlier choices\n", skipped);
+    while (len)
+    {
+        const c8_explore_step* st = c8_explore_step_at(x, path[--len]);
+        printf("    cycle %8u  %04x  ", st->cycle, st->pc);
+        if (st->kind == C8_DECIDE_KEY)
+            printf("key %x %s\n", st->choice & 0xf, st->choice & 0x10 ? "down" : "up");
+        else if (st->kind == C8_DECIDE_WAIT)
+            printf("press key %x\n", st->choice);
+        else
+            printf("random %02x\n", st->choice);
+    }
+}
+
+static bool explore_write_pbm(const char* dir, uint32_t n, const c8_display* d)
+{
+    char name[1024];
+    snprintf(name, sizeof(name), "%s/screen%05u.pbm", dir, n);
+    FILE* f = fopen(name, "w");
+    if (!f)
+    {
+        fprintf(stderr, "c8explore: cant write '%s'\n", name);
+        return false;
+    }
+    const uint32_t w = d->hires ? C8_HIRES_WIDTH : C8_WIDTH;
+    const uint32_t h = d->hires ? C8_HIRES_HEIGHT : C8_HEIGHT;
+    fprintf(f, "P1\n%u %u\n", w, h);
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        for (uint32_t x = 0; x < w; ++x)
+        {
+            /* lit on any plane */
+            const uint64_t bit = 1ull << (63 - (x & 63));
+            fputc((d->rows[0][y][x >> 6] | d->rows[1][y][x >> 6]) & bit ? '1' : '0', f);
+        }
+        fputc('\n', f);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const char* rom_file = NULL;
+    const char* screen_dir = NULL;
+    uint32_t npaths = 5;
+    c8_explore_opts o;
+    c8_explore_defaults(&o);
+
+    for (int a = 1; a < argc; ++a)
+    {
+        if (!strcmp(argv[a], "--threads") && a + 1 < argc)
+            o.threads = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--states") && a + 1 < argc)
+            o.max_states = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--depth") && a + 1 < argc)
+            o.max_depth = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--run") && a + 1 < argc)
+            o.max_run = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--frontier") && a + 1 < argc)
+            o.frontier_bytes = (size_t)strtoul(argv[++a], NULL, 0) * 1024 * 1024;
+        else if (!strcmp(argv[a], "--best"))
+            o.best_first = true;
+        else if (!strcmp(argv[a], "--screens") && a + 1 < argc)
+            screen_dir = argv[++a];
+        else if (!strcmp(argv[a], "--paths") && a + 1 < argc)
+            npaths = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else
+            rom_file = argv[a];
+    }
+
+    if (!rom_file)
+    {
+        fprintf(stderr, "usage: c8explore rom.ch8 [--threads N] [--states N] [--depth N] [--run C] "
+            "[--frontier MB] [--best] [--screens DIR] [--paths N]\n");
+        return 1;
+    }
+
+    static c8_machine base;
+    if (!c8_load_rom(&base, rom_file))
+        return 1;
+    c8_init(&base);
+
+    c8_explore* x = c8_explore_create(&o);
+    if (!x || !c8_explore_run(x, &base))
+        return 1;
+
+    c8_explore_stats st;
+    c8_explore_get_stats(x, &st);
+    printf("%u states, %u screens, %u faults in %.2f s (%.2f M forks/s)\n", st.states, st.screens, st.faults,
+        st.secs, st.secs > 0 ? (double)st.expanded / st.secs / 1e6 : 0.0);
+    printf("  %llu forks, %llu back to a known state, %llu ended, %llu dropped, deepest path %u\n",
+        (unsigned long long)st.expanded, (unsigned long long)st.dupes, (unsigned long long)st.ends,
+        (unsigned long long)st.dropped, st.depth);
+    if (st.states >= o.max_states)
+        printf("  stopped at --states, there's more\n");
+    if (st.dropped)
+        printf("  frontier was full, raise --frontier to keep everything\n");
+
+    const c8_explore_fault* faults;
+    const uint32_t nfaults = c8_explore_faults(x, &faults);
+    for (uint32_t f = 0; f < nfaults && f < npaths; ++f)
+    {
+        printf("\nfault at %04x, op %04x:\n", faults[f].pc, faults[f].op);
+        explore_print_path(x, faults[f].node);
+    }
+
+    if (screen_dir)
+    {
+        const c8_explore_screen* screens;
+        const uint32_t nscreens = c8_explore_screens(x, &screens);
+        for (uint32_t n = 0; n < nscreens; ++n)
+        {
+            if (!explore_write_pbm(screen_dir, n, &screens[n].screen))
+                break;
+        }
+        printf("\n%u screens written to %s\n", nscreens, screen_dir);
+    }
+
+    c8_explore_destroy(x);
+    return 0;
+}
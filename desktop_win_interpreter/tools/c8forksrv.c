@@ -0,0 +1,272 @@
+/* c8forksrv - a fork server for harnesses that want every rom job in its own process
+
+    c8forksrv [rom.ch8] [--timeout MS] [--cycles N]
+
+gets a machine ready once - no SDL, rom loaded and c8_init'd if one is given - then
+reads jobs from stdin a line at a time and forks a copy of the ready machine for each,
+so a job costs a fork instead of an exec, a dynamic link and an init. results come
+back on stdout, a line a job, in the order the jobs came in.
+
+a job is
+
+    ROM|- [cycles=N] [seed=N] [keys=HEX]
+
+- is the rom given at startup. cycles defaults to --cycles (100000), keys is the
+keypad held for the whole run, bit per key. the run stops early if the rom halts
+(00FD or a jump to itself) or hits a bad op. a result is
+
+    ok|halt|fault|crash|timeout|error cycles=N pc=0xNNN op=0xNNNN state=HASH screen=HASH
+
+crash is the child dying on a signal, timeout is it running past --timeout (default
+1000 ms, at least 1) and error a rom that wouldnt load or a job that didnt parse. a
+job that crashes or hangs takes nothing else down with it.
+
+windows has no fork, there every job runs on a copy of the ready machine in this
+process instead. same results but a crash takes the server with it.
+*/
+
+/* plain console main, no SDL2main */
+#define SDL_MAIN_HANDLED
+#include "../c8.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined _WIN32
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#endif
+
+#define FORKSRV_LINE_MAX        (4096)
+
+typedef struct
+{
+    char rom[FORKSRV_LINE_MAX];
+    uint32_t cycles;
+    uint32_t seed;
+    bool seeded;
+    uint16_t keys;
+} forksrv_job;
+
+static bool forksrv_parse(const char* line, uint32_t default_cycles, forksrv_job* job)
+{
+    memset(job, 0, sizeof(*job));
+    job->cycles = default_cycles;
+    char buf[FORKSRV_LINE_MAX];
+    strncpy(buf, line, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    bool have_rom = false;
+    for (char* tok = strtok(buf, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n"))
+    {
+        if (!strncmp(tok, "cycles=", 7))
+            job->cycles = (uint32_t)strtoul(tok + 7, NULL, 0);
+        else if (!strncmp(tok, "seed=", 5))
+        {
+            job->seed = (uint32_t)strtoul(tok + 5, NULL, 0);
+            job->seeded = true;
+        }
+        else if (!strncmp(tok, "keys=", 5))
+            job->keys = (uint16_t)strtoul(tok + 5, NULL, 16);
+        else if (!have_rom)
+        {
+            strcpy(job->rom, tok);
+            have_rom = true;
+        }
+        else
+            return false;
+    }
+    return have_rom;
+}
+
+static bool forksrv_halted(const c8_state* s)
+{
+    const uint16_t op = (uint16_t)(s->mem[s->pc & s->mem_mask] << 8 | s->mem[(s->pc + 1) & s->mem_mask]);
+    return op == 0x00fd || ((op & 0xf000) == 0x1000 && (op & 0x0fff) == s->pc);
+}
+
+/* the job on m, which is the ready machine or a copy of it. the result line goes in out */
+static int forksrv_job_run(c8_machine* m, const forksrv_job* job, char* out, size_t out_len)
+{
+    if (strcmp(job->rom, "-"))
+    {
+        if (!c8_load_rom(m, job->rom))
+            return snprintf(out, out_len, "error cant load '%s'\n", job->rom);
+        c8_init(m);
+    }
+    else if (!m->rom_loaded)
+    {
+        return snprintf(out, out_len, "error no rom given at startup\n");
+    }
+    if (job->seeded)
+        c8_seed(m, job->seed);
+    c8_set_keys(m, job->keys);
+
+    /* attached so a bad op is a result rather than a line on stderr */
+    c8_debug_attach(m, true);
+    const uint64_t start = m->s.cycles;
+    const char* how = "ok";
+    for (uint32_t n = 0; n < job->cycles; ++n)
+    {
+        if (forksrv_halted(&m->s))
+        {
+            how = "halt";
+            break;
+        }
+        c8_cycle(m);
+        if (m->faulted)
+        {
+            how = "fault";
+            break;
+        }
+    }
+
+    const c8_state* s = &m->s;
+    return snprintf(out, out_len, "%s cycles=%llu pc=0x%03x op=0x%02x%02x state=%016llx screen=%016llx\n", how,
+        (unsigned long long)(s->cycles - start), s->pc, s->mem[s->pc & s->mem_mask],
+        s->mem[(s->pc + 1) & s->mem_mask], (unsigned long long)c8_state_hash(s),
+        (unsigned long long)c8_state_screen_hash(s));
+}
+
+#if !defined _WIN32
+
+/* stdout is a pipe the child writes its line to straight away, one write so it never
+gets split up. nothing goes through stdio buffers a fork would copy */
+static void forksrv_write(const char* line, int len)
+{
+    while (len > 0)
+    {
+        const ssize_t n = write(STDOUT_FILENO, line, (size_t)len);
+        if (n <= 0)
+            return;
+        line += n;
+        len -= (int)n;
+    }
+}
+
+static void forksrv_serve(c8_machine* ready, const forksrv_job* job, uint32_t timeout_ms)
+{
+    char out[256];
+    const pid_t pid = fork();
+    if (pid < 0)
+    {
+        forksrv_write(out, snprintf(out, sizeof(out), "error fork failed\n"));
+        return;
+    }
+    if (pid == 0)
+    {
+        /* the timer kills the child, the parent sees SIGALRM */
+        struct itimerval t = { { 0, 0 }, { timeout_ms / 1000, (timeout_ms % 1000) * 1000 } };
+        signal(SIGALRM, SIG_DFL);
+        setitimer(ITIMER_REAL, &t, NULL);
+        forksrv_write(out, forksrv_job_run(ready, job, out, sizeof(out)));
+        _exit(0);
+    }
+
+    int status = 0;
+    pid_t got;
+    while ((got = waitpid(pid, &status, 0)) < 0 && errno == EINTR)
+        ;
+    if (got < 0)
+    {
+        forksrv_write(out, snprintf(out, sizeof(out), "error waitpid failed\n"));
+        return;
+    }
+    if (WIFSIGNALED(status))
+    {
+        const int sig = WTERMSIG(status);
+        if (sig == SIGALRM)
+            forksrv_write(out, snprintf(out, sizeof(out), "timeout\n"));
+        else
+            forksrv_write(out, snprintf(out, sizeof(out), "crash signal=%d\n", sig));
+    }
+}
+
+#else
+
+static void forksrv_serve(c8_machine* ready, const forksrv_job* job, uint32_t timeout_ms)
+{
+    /* the ready machine stays as it is for the next job */
+    static c8_machine m;
+    c8_state_copy(&m.s, &ready->s);
+    m.initd = ready->initd;
+    m.rom_loaded = ready->rom_loaded;
+    m.rom_size = ready->rom_size;
+    /* the last job may have faulted, this one starts from the ready machine */
+    c8_fault_clear(&m);
+    char out[256];
+    forksrv_job_run(&m, job, out, sizeof(out));
+    fputs(out, stdout);
+    fflush(stdout);
+}
+
+#endif
+
+int main(int argc, char** argv)
+{
+    const char* rom_file = NULL;
+    uint32_t timeout_ms = 1000;
+    uint32_t default_cycles = 100000;
+
+    for (int a = 1; a < argc; ++a)
+    {
+        if (!strcmp(argv[a], "--timeout") && a + 1 < argc)
+            timeout_ms = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--cycles") && a + 1 < argc)
+            default_cycles = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (argv[a][0] == '-')
+        {
+            fprintf(stderr, "usage: c8forksrv [rom.ch8] [--timeout MS] [--cycles N]\n");
+            return 1;
+        }
+        else
+            rom_file = argv[a];
+    }
+    if (!timeout_ms)
+    {
+        /* setitimer takes 0 as no timer at all, and a job that hangs would hang us */
+        fprintf(stderr, "c8forksrv: --timeout has to be at least 1 ms\n");
+        return 1;
+    }
+
+    /* everything a job shares is done here, once */
+    static c8_machine ready;
+    if (rom_file)
+    {
+        if (!c8_load_rom(&ready, rom_file))
+            return 1;
+        c8_init(&ready);
+    }
+#if !defined _WIN32
+    /* a harness that goes away shouldnt kill us mid write, the write just fails */
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    char line[FORKSRV_LINE_MAX];
+    uint64_t jobs = 0;
+    const uint64_t t0 = SDL_GetPerformanceCounter();
+    while (fgets(line, sizeof(line), stdin))
+    {
+        forksrv_job job;
+        if (line[0] == '\n' || line[0] == '\r')
+            continue;
+        if (!forksrv_parse(line, default_cycles, &job))
+        {
+            /* stdout is only ever written a whole line at a time, see forksrv_write */
+            static const char bad[] = "error cant parse job\n";
+            fwrite(bad, 1, sizeof(bad) - 1, stdout);
+            fflush(stdout);
+            continue;
+        }
+        forksrv_serve(&ready, &job, timeout_ms);
+        ++jobs;
+    }
+
+    const double secs = (double)(SDL_GetPerformanceCounter() - t0) / (double)SDL_GetPerformanceFrequency();
+    fprintf(stderr, "c8forksrv: %llu jobs, %.1f us a job\n", (unsigned long long)jobs,
+        jobs ? secs * 1e6 / (double)jobs : 0.0);
+    return 0;
+}
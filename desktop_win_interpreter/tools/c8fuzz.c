@@ -0,0 +1,162 @@
+/* c8fuzz - libFuzzer target for the decoder
+
+    clang -g -O1 -fsanitize=fuzzer,address -DC8_FUZZ_LIBFUZZER tools/c8fuzz.c c8.c
+        c8_trace.c c8_history.c c8_blit.c -lSDL2 -o c8fuzz
+    c8fuzz corpus/
+
+every input is a rom. it goes into a machine put back from a snapshot of one that
+was c8_init'd at startup - registers, screen, font and memory all come back with one
+c8_state_copy, nothing is re-initialised - and runs C8_FUZZ_CYCLES ops (default 1000,
+or set it in the environment) or until it hits a bad op. a bad op is just the end of
+that run, a crash or a sanitizer report is a bug in the interpreter. the last two
+bytes of the input double as the keys held, so skips on keys go both ways. inputs
+too big for 4k get the xo-chip 64k.
+
+built without C8_FUZZ_LIBFUZZER it is a plain program, for replaying what libFuzzer
+found or for throwing random roms at a sanitizer build where there is no clang:
+
+    c8fuzz crash-1234 ...               each file once
+    c8fuzz --random N [--seed S]        N random roms
+*/
+
+/* plain console main, no SDL2main */
+#define SDL_MAIN_HANDLED
+#include "../c8.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FUZZ_CYCLES_DEFAULT     (1000)
+
+static c8_machine fuzz_m;
+/* the machine just after c8_init, for 4k and 64k roms */
+static c8_state fuzz_ready[2];
+static int fuzz_cycles = FUZZ_CYCLES_DEFAULT;
+static uint64_t fuzz_faults;
+
+static void fuzz_setup(void)
+{
+    const char* env = getenv("C8_FUZZ_CYCLES");
+    if (env && atoi(env) > 0)
+        fuzz_cycles = atoi(env);
+
+    for (uint8_t xo = 0; xo < 2; ++xo)
+    {
+        fuzz_m.s.mem_mask = xo ? C8_MEM_SIZE - 1 : C8_MEM_SIZE_CLASSIC - 1;
+        c8_init(&fuzz_m);
+        c8_state_copy(&fuzz_ready[xo], &fuzz_m.s);
+    }
+    c8_seed(&fuzz_m, 1);
+    /* faults are expected and counted, not printed */
+    c8_debug_attach(&fuzz_m, true);
+}
+
+int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+    (void)argc;
+    (void)argv;
+    fuzz_setup();
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size > C8_MEM_SIZE - 512)
+        return 0;
+
+    c8_machine* m = &fuzz_m;
+    c8_state_copy(&m->s, &fuzz_ready[size > C8_MEM_SIZE_CLASSIC - 512]);
+    if (!c8_load_rom_mem(m, data, size, false))
+        return 0;
+    m->gfx_dirty = false;
+    if (size >= 2)
+        c8_set_keys(m, (uint16_t)(data[size - 2] << 8 | data[size - 1]));
+
+    if (c8_run(m, fuzz_cycles) == C8_STOP_FAULT)
+        ++fuzz_faults;
+    return 0;
+}
+
+#if !defined C8_FUZZ_LIBFUZZER
+
+static uint32_t fuzz_rand(uint32_t* x)
+{
+    *x ^= *x << 13;
+    *x ^= *x >> 17;
+    *x ^= *x << 5;
+    return *x;
+}
+
+static int fuzz_replay(int nfiles, char** files)
+{
+    static uint8_t buf[C8_MEM_SIZE];
+    for (int f = 0; f < nfiles; ++f)
+    {
+        FILE* in = fopen(files[f], "rb");
+        if (!in)
+        {
+            fprintf(stderr, "c8fuzz: cant open '%s'\n", files[f]);
+            return 1;
+        }
+        const size_t size = fread(buf, 1, sizeof(buf), in);
+        fclose(in);
+
+        const uint64_t faults = fuzz_faults;
+        LLVMFuzzerTestOneInput(buf, size);
+        printf("%s: %zu bytes, %s at 0x%03x\n", files[f], size, fuzz_faults != faults ? "fault" : "ran",
+            fuzz_m.s.pc);
+    }
+    return 0;
+}
+
+/* mostly 4k roms, some of them right up against the end of memory, and the odd 64k one */
+static void fuzz_random(uint64_t nroms, uint32_t seed)
+{
+    static uint8_t buf[C8_MEM_SIZE - 512];
+    uint32_t x = seed ? seed : 0x2545f491;
+    const uint64_t t0 = SDL_GetPerformanceCounter();
+    for (uint64_t n = 0; n < nroms; ++n)
+    {
+        const uint32_t r = fuzz_rand(&x);
+        size_t size;
+        if (r % 64 == 0)
+            size = C8_MEM_SIZE_CLASSIC - 512 + fuzz_rand(&x) % (sizeof(buf) - (C8_MEM_SIZE_CLASSIC - 512) + 1);
+        else if (r % 8 == 0)
+            size = C8_MEM_SIZE_CLASSIC - 512;
+        else
+            size = fuzz_rand(&x) % 512;
+        for (size_t b = 0; b < size; ++b)
+            buf[b] = (uint8_t)fuzz_rand(&x);
+        LLVMFuzzerTestOneInput(buf, size);
+    }
+    const double secs = (double)(SDL_GetPerformanceCounter() - t0) / (double)SDL_GetPerformanceFrequency();
+    printf("%llu roms x %d cycles, %llu faulted, %.0f roms a second\n", (unsigned long long)nroms, fuzz_cycles,
+        (unsigned long long)fuzz_faults, secs > 0 ? (double)nroms / secs : 0.0);
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t nroms = 0;
+    uint32_t seed = 1;
+    int a = 1;
+    for (; a < argc && argv[a][0] == '-'; ++a)
+    {
+        if (!strcmp(argv[a], "--random") && a + 1 < argc)
+            nroms = strtoull(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--seed") && a + 1 < argc)
+            seed = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else
+            break;
+    }
+    if (!nroms && a >= argc)
+    {
+        fprintf(stderr, "usage: c8fuzz file... | c8fuzz --random N [--seed S]\n");
+        return 1;
+    }
+
+    fuzz_setup();
+    if (nroms)
+        fuzz_random(nroms, seed);
+    return fuzz_replay(argc - a, argv + a);
+}
+
+#endif
@@ -0,0 +1,264 @@
+/* c8rollback - two rollback peers on loopback, to see netplay hold up under lag
+
+    c8rollback rom.ch8 [--frames N] [--delay MS] [--rollback N] [--hold N] [--lead N]
+                       [--fast] [--all]
+
+both players run in this process, each with its own machine and udp port, and
+every packet between them is held back --delay ms (default 100). each holds a random
+key from its half of the keypad (player 1 0-7, player 2 8-F) for about --hold frames
+(default 6), so guesses keep going wrong. runs --frames (default 600) at 60 a
+second, or flat out with --fast, then lets the last packets land and checks both
+machines ended up in exactly the same state. prints how often and how far they
+rolled back and what it cost.
+
+--lead has player 1 run that many frames before player 2 starts, so one side is
+ahead of the other from the off. --all runs the options given, then again with no
+delay, again with a lead of 5, and once more on a little rom of its own that faults
+if key 8 is held for three frames while player 2 only ever taps it for two. the
+player guessing it is still held runs into the fault and has to roll back out of
+it. that last one always runs at 60 a second. passes only if all four do.
+*/
+
+/* plain console main, no SDL2main */
+#define SDL_MAIN_HANDLED
+#include "../c8_rollback.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ROLLBACK_PLAYERS        (2)
+#define ROLLBACK_TAP_EVERY      (20)
+
+/* V0 counts loops with key 8 down, 9 of them is more than two frames and returns
+with nothing on the stack */
+static const uint8_t rollback_tap_rom[] =
+{
+    0x60, 0x00,     /* 200: LD V0, 0 */
+    0x61, 0x08,     /* 202: LD V1, 8 */
+    0xe1, 0x9e,     /* 204: SKP V1 */
+    0x12, 0x00,     /* 206: JP 200 */
+    0x70, 0x01,     /* 208: ADD V0, 1 */
+    0x30, 0x09,     /* 20A: SE V0, 9 */
+    0x12, 0x04,     /* 20C: JP 204 */
+    0x00, 0xee,     /* 20E: RET */
+};
+
+typedef struct
+{
+    c8_machine m;
+    c8_rollback* r;
+    uint16_t mask;
+    uint16_t keys;
+    uint32_t rng;
+    uint64_t worst_ticks;   /* longest single advance */
+} rollback_player;
+
+static uint16_t rollback_random_keys(rollback_player* p, uint32_t hold)
+{
+    uint32_t x = p->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    p->rng = x;
+    if ((x >> 8) % (hold ? hold : 1))
+        return p->keys;
+    /* a key from this player's half, or nothing one time in nine */
+    const uint32_t k = (x >> 16) % 9;
+    if (k == 8)
+        return 0;
+    for (uint8_t key = 0, n = 0; key < 16; ++key)
+    {
+        if ((p->mask & (1 << key)) && n++ == k)
+            return (uint16_t)(1 << key);
+    }
+    return 0;
+}
+
+typedef struct
+{
+    const char* rom_file;
+    uint32_t nframes;
+    uint32_t hold;
+    uint32_t lead;
+    bool fast;
+    bool taps;      /* the tap rom instead of rom_file */
+    c8_rollback_opts o;
+} rollback_run_opts;
+
+static bool rollback_run(const rollback_run_opts* ro)
+{
+    const c8_rollback_opts o = ro->o;
+    const uint32_t nframes = ro->nframes;
+    printf("-- %u frames, %u ms delay, lead %u%s%s\n", nframes, o.send_delay_ms, ro->lead, ro->fast ? ", fast" : "",
+        ro->taps ? ", tapping key 8" : "");
+
+    static rollback_player players[ROLLBACK_PLAYERS];
+    memset(players, 0, sizeof(players));
+    for (uint8_t p = 0; p < ROLLBACK_PLAYERS; ++p)
+    {
+        rollback_player* pl = &players[p];
+        if (ro->taps ? !c8_load_rom_mem(&pl->m, rollback_tap_rom, sizeof(rollback_tap_rom), false) :
+            !c8_load_rom(&pl->m, ro->rom_file))
+            return false;
+        c8_seed(&pl->m, 1234);
+        c8_init(&pl->m);
+        pl->mask = p ? 0xff00 : 0x00ff;
+        pl->rng = p ? 0x9e3779b9 : 0x2545f491;
+
+        c8_rollback_opts po = o;
+        po.local_mask = pl->mask;
+        po.remote_mask = (uint16_t)~pl->mask;
+        pl->r = c8_rollback_create(&po, &pl->m);
+        if (!pl->r)
+            return false;
+    }
+    if (!c8_rollback_connect(players[0].r, c8_rollback_port(players[1].r)) ||
+        !c8_rollback_connect(players[1].r, c8_rollback_port(players[0].r)))
+        return false;
+
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    const uint64_t t0 = SDL_GetPerformanceCounter();
+    uint64_t next = t0;
+    uint32_t displayed = 0;
+    bool ok = true;
+    for (;;)
+    {
+        c8_rollback_stats st[ROLLBACK_PLAYERS];
+        for (uint8_t p = 0; p < ROLLBACK_PLAYERS; ++p)
+            c8_rollback_get_stats(players[p].r, &st[p]);
+        if (st[0].frame >= nframes && st[1].frame >= nframes)
+            break;
+        /* a pair that stops getting anywhere is stuck for good */
+        if ((double)(SDL_GetPerformanceCounter() - t0) / (double)freq > nframes / 60.0 * 2 + 10)
+        {
+            printf("stuck at frames %u / %u\n", st[0].frame, st[1].frame);
+            ok = false;
+            break;
+        }
+
+        for (uint8_t p = 0; p < ROLLBACK_PLAYERS; ++p)
+        {
+            rollback_player* pl = &players[p];
+            const uint64_t a0 = SDL_GetPerformanceCounter();
+            /* player 2 sits out the first lead frames */
+            if (st[p].frame < nframes && (p == 0 || displayed >= ro->lead))
+            {
+                if (ro->taps && p == 1)
+                    pl->keys = st[p].frame % ROLLBACK_TAP_EVERY < 2 ? 1 << 8 : 0;
+                else
+                    pl->keys = rollback_random_keys(pl, ro->hold);
+                c8_rollback_advance(pl->r, pl->keys);
+            }
+            else
+            {
+                c8_rollback_poll(pl->r);
+            }
+            const uint64_t took = SDL_GetPerformanceCounter() - a0;
+            if (took > pl->worst_ticks)
+                pl->worst_ticks = took;
+        }
+        ++displayed;
+
+        if (!ro->fast)
+        {
+            next += freq / 60;
+            const uint64_t now = SDL_GetPerformanceCounter();
+            if (next > now)
+                SDL_Delay((uint32_t)((next - now) * 1000 / freq));
+        }
+    }
+
+    /* both have run every frame, the last keys are still in the air */
+    const uint64_t settle = SDL_GetPerformanceCounter() + freq * (o.send_delay_ms + 500) / 1000;
+    while (ok && SDL_GetPerformanceCounter() < settle)
+    {
+        c8_rollback_stats st[ROLLBACK_PLAYERS];
+        for (uint8_t p = 0; p < ROLLBACK_PLAYERS; ++p)
+        {
+            c8_rollback_poll(players[p].r);
+            c8_rollback_get_stats(players[p].r, &st[p]);
+        }
+        if (st[0].confirmed == nframes && st[1].confirmed == nframes)
+            break;
+        SDL_Delay(1);
+    }
+    const double secs = (double)(SDL_GetPerformanceCounter() - t0) / (double)freq;
+
+    for (uint8_t p = 0; p < ROLLBACK_PLAYERS; ++p)
+    {
+        c8_rollback_stats st;
+        c8_rollback_get_stats(players[p].r, &st);
+        ok = ok && st.confirmed == nframes && !st.desyncs;
+        printf("player %u: %u frames, %u confirmed, %llu stalls, %llu packets out, %llu in\n", p + 1, st.frame,
+            st.confirmed, (unsigned long long)st.stalls, (unsigned long long)st.packets_out,
+            (unsigned long long)st.packets_in);
+        printf("  %llu rollbacks, %llu frames run again, deepest %u, %.2f us a rollback\n",
+            (unsigned long long)st.rollbacks, (unsigned long long)st.resimulated, st.max_depth,
+            st.rollbacks ? st.rollback_secs * 1e6 / (double)st.rollbacks : 0.0);
+        printf("  worst display frame %.1f us, %llu hashes checked, %llu out of sync\n",
+            (double)players[p].worst_ticks * 1e6 / (double)freq, (unsigned long long)st.hashes_checked,
+            (unsigned long long)st.desyncs);
+    }
+
+    const bool same = c8_state_hash(&players[0].m.s) == c8_state_hash(&players[1].m.s);
+    printf("%u display frames in %.2f s, machines %s\n", displayed, secs, same ? "match" : "DIFFER");
+
+    for (uint8_t p = 0; p < ROLLBACK_PLAYERS; ++p)
+        c8_rollback_destroy(players[p].r);
+    return ok && same;
+}
+
+int main(int argc, char** argv)
+{
+    rollback_run_opts ro;
+    memset(&ro, 0, sizeof(ro));
+    ro.nframes = 600;
+    ro.hold = 6;
+    bool all = false;
+    c8_rollback_defaults(&ro.o);
+    ro.o.send_delay_ms = 100;
+
+    for (int a = 1; a < argc; ++a)
+    {
+        if (!strcmp(argv[a], "--frames") && a + 1 < argc)
+            ro.nframes = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--delay") && a + 1 < argc)
+            ro.o.send_delay_ms = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--rollback") && a + 1 < argc)
+            ro.o.max_rollback = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--hold") && a + 1 < argc)
+            ro.hold = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--lead") && a + 1 < argc)
+            ro.lead = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--fast"))
+            ro.fast = true;
+        else if (!strcmp(argv[a], "--all"))
+            all = true;
+        else
+            ro.rom_file = argv[a];
+    }
+
+    if (!ro.rom_file)
+    {
+        fprintf(stderr, "usage: c8rollback rom.ch8 [--frames N] [--delay MS] [--rollback N] [--hold N] [--lead N] "
+            "[--fast] [--all]\n");
+        return 1;
+    }
+
+    bool ok = rollback_run(&ro);
+    if (all)
+    {
+        rollback_run_opts nodelay = ro;
+        nodelay.o.send_delay_ms = 0;
+        ok = rollback_run(&nodelay) && ok;
+        rollback_run_opts uneven = ro;
+        uneven.lead = 5;
+        ok = rollback_run(&uneven) && ok;
+        rollback_run_opts taps = ro;
+        taps.taps = true;
+        /* flat out the keys come a dozen frames a packet and the guess hardly ever
+           lands on a tap, at 60 a second it lands on every one */
+        taps.fast = false;
+        ok = rollback_run(&taps) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+/* c8sweep - run one rom under a range of CXNN seeds
+
+    c8sweep rom.ch8 [--seeds N] [--first S] [--cycles C] [--lanes N] [--compare]
+
+seeds S .. S+N-1 (default 1 .. 10000) each run C cycles (default 10000), up to 32 at
+a time in lockstep lanes. prints how many different screens they finished on and
+the most common ones. --compare runs every seed again on its own machine, checks it
+ends up in exactly the same state and prints how much faster the lanes were.
+*/
+
+/* plain console main, no SDL2main */
+#define SDL_MAIN_HANDLED
+#include "../c8_lanes.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SWEEP_TOP               (5)
+
+typedef struct
+{
+    uint64_t hash;
+    uint32_t count;
+    uint32_t first_seed;
+} sweep_screen;
+
+static uint64_t sweep_hash(const void* data, size_t len)
+{
+    /* fnv-1a */
+    const uint8_t* p = data;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t n = 0; n < len; ++n)
+    {
+        h ^= p[n];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+/* open addressing, cap is a power of two at least twice the seed count */
+static void sweep_count(sweep_screen* tab, uint32_t cap, uint64_t hash, uint32_t seed, uint32_t* distinct)
+{
+    uint32_t at = (uint32_t)hash & (cap - 1);
+    while (tab[at].count && tab[at].hash != hash)
+        at = (at + 1) & (cap - 1);
+    if (!tab[at].count)
+    {
+        tab[at].hash = hash;
+        tab[at].first_seed = seed;
+        ++*distinct;
+    }
+    ++tab[at].count;
+}
+
+static int sweep_by_count(const void* a, const void* b)
+{
+    const sweep_screen* sa = a;
+    const sweep_screen* sb = b;
+    return sa->count != sb->count ? (sa->count < sb->count ? 1 : -1) : (sa->first_seed > sb->first_seed) - (sa->first_seed < sb->first_seed);
+}
+
+static double sweep_secs(uint64_t ticks)
+{
+    return (double)ticks / (double)SDL_GetPerformanceFrequency();
+}
+
+int main(int argc, char** argv)
+{
+    const char* rom_file = NULL;
+    uint32_t nseeds = 10000;
+    uint32_t first = 1;
+    uint32_t ncycles = 10000;
+    uint32_t nlanes = C8_LANES_MAX;
+    bool compare = false;
+
+    for (int a = 1; a < argc; ++a)
+    {
+        if (!strcmp(argv[a], "--seeds") && a + 1 < argc)
+            nseeds = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--first") && a + 1 < argc)
+            first = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--cycles") && a + 1 < argc)
+            ncycles = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--lanes") && a + 1 < argc)
+            nlanes = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--compare"))
+            compare = true;
+        else
+            rom_file = argv[a];
+    }
+
+    if (!rom_file || !nseeds || !nlanes || nlanes > C8_LANES_MAX)
+    {
+        fprintf(stderr, "usage: c8sweep rom.ch8 [--seeds N] [--first S] [--cycles C] [--lanes 1-%d] [--compare]\n", C8_LANES_MAX);
+        return 1;
+    }
+
+    static c8_machine base;
+    if (!c8_load_rom(&base, rom_file))
+        return 1;
+    c8_init(&base);
+
+    c8_lanes* ln = c8_lanes_create();
+    uint32_t cap = 1;
+    while (cap < nseeds * 2)
+        cap <<= 1;
+    sweep_screen* screens = calloc(cap, sizeof(sweep_screen));
+    uint64_t* states = compare ? malloc(sizeof(uint64_t) * nseeds) : NULL;
+    if (!ln || !screens || (compare && !states))
+    {
+        fprintf(stderr, "c8sweep: out of memory\n");
+        return 1;
+    }
+
+    uint32_t distinct = 0;
+    uint32_t faulted = 0;
+    uint64_t grouped = 0, single = 0;
+    /* only the running gets timed, hashing the results is the same work either way */
+    uint64_t lane_ticks = 0;
+    for (uint32_t done = 0; done < nseeds; done += nlanes)
+    {
+        uint32_t seeds[C8_LANES_MAX];
+        const uint8_t n = (uint8_t)(nseeds - done < nlanes ? nseeds - done : nlanes);
+        for (uint8_t l = 0; l < n; ++l)
+            seeds[l] = first + done + l;
+
+        const uint64_t t0 = SDL_GetPerformanceCounter();
+        c8_lanes_start(ln, &base, n, seeds);
+        c8_lanes_run(ln, ncycles);
+        lane_ticks += SDL_GetPerformanceCounter() - t0;
+
+        const uint32_t live = c8_lanes_live(ln);
+        for (uint8_t l = 0; l < n; ++l)
+        {
+            const c8_machine* m = c8_lanes_machine(ln, l);
+            if (!(live & (1u << l)))
+                ++faulted;
+            sweep_count(screens, cap, sweep_hash(&m->s.screen, sizeof(m->s.screen)), seeds[l], &distinct);
+            if (states)
+                states[done + l] = sweep_hash(&m->s, c8_state_size(&m->s));
+        }
+        uint64_t g, s;
+        c8_lanes_stats(ln, &g, &s);
+        grouped += g;
+        single += s;
+    }
+    const double lane_secs = sweep_secs(lane_ticks);
+    const double total = (double)nseeds * ncycles;
+
+    printf("%u seeds x %u cycles: %u different screens, %u faulted\n", nseeds, ncycles, distinct, faulted);
+    printf("lanes: %.3f s, %.1f M cycles/s, %.1f%% of ops run grouped\n", lane_secs, total / lane_secs / 1e6,
+        grouped + single ? 100.0 * (double)grouped / (double)(grouped + single) : 0.0);
+
+    qsort(screens, cap, sizeof(sweep_screen), sweep_by_count);
+    for (uint32_t t = 0; t < SWEEP_TOP && t < distinct; ++t)
+        printf("  %016llx  %6u seeds, first %u\n", (unsigned long long)screens[t].hash, screens[t].count, screens[t].first_seed);
+
+    if (compare)
+    {
+        static c8_machine plain;
+        uint32_t mismatched = 0;
+        uint64_t plain_ticks = 0;
+        for (uint32_t n = 0; n < nseeds; ++n)
+        {
+            const uint64_t t0 = SDL_GetPerformanceCounter();
+            c8_state_copy(&plain.s, &base.s);
+            plain.initd = base.initd;
+            plain.rom_loaded = base.rom_loaded;
+            plain.rom_size = base.rom_size;
+            c8_debug_attach(&plain, true);
+            c8_seed(&plain, first + n);
+            for (uint32_t c = 0; c < ncycles && !plain.faulted; ++c)
+                c8_cycle(&plain);
+            plain_ticks += SDL_GetPerformanceCounter() - t0;
+            if (sweep_hash(&plain.s, c8_state_size(&plain.s)) != states[n])
+            {
+                if (!mismatched)
+                    fprintf(stderr, "c8sweep: seed %u ends up different on its own\n", first + n);
+                ++mismatched;
+            }
+        }
+        const double plain_secs = sweep_secs(plain_ticks);
+        printf("one at a time: %.3f s, %.1f M cycles/s - lanes %.1fx faster, %u of %u seeds differ\n", plain_secs,
+            total / plain_secs / 1e6, plain_secs / lane_secs, mismatched, nseeds);
+        if (mismatched)
+            return 1;
+    }
+
+    free(states);
+    free(screens);
+    c8_lanes_destroy(ln);
+    return 0;
+}
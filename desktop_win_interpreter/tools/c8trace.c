@@ -0,0 +1,230 @@
+/* c8trace - turn a binary trace written with --trace back into text, and answer
+questions about it through an index built next to the trace
+
+    c8trace file.c8t                            dump as text
+    c8trace index file.c8t                      (re)build file.c8t.idx
+    c8trace writes file.c8t ADDR [FROM [TO]]    every write to memory at ADDR
+    c8trace changes file.c8t REG [FROM [TO]]    every change to V0-VF, I, SP, DT or ST
+    c8trace last file.c8t REG VALUE CYCLE       last time REG became VALUE before CYCLE
+    c8trace pc file.c8t ADDR [PATTERN]          every op run at ADDR, PATTERN like DXYN
+
+query commands build the index first if there isnt one yet, or if the one there was
+built from a different trace.
+*/
+
+#include "../c8_trace_index.h"
+#include "../c8_disasm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <SDL.h>
+
+static void c8trace_usage(void)
+{
+    fprintf(stderr,
+        "usage: c8trace file.c8t\n"
+        "       c8trace index file.c8t\n"
+        "       c8trace writes file.c8t ADDR [FROM [TO]]\n"
+        "       c8trace changes file.c8t REG [FROM [TO]]\n"
+        "       c8trace last file.c8t REG VALUE CYCLE\n"
+        "       c8trace pc file.c8t ADDR [PATTERN]\n");
+}
+
+static int c8trace_dump(const char* filename)
+{
+    c8_trace_reader* rd = c8_trace_reader_open(filename);
+    if (!rd)
+        return 1;
+
+    c8_trace_rec rec;
+    char mn[48];
+    char name[16];
+    while (c8_trace_reader_next(rd, &rec))
+    {
+        c8_disasm_op(rec.op, NULL, mn, sizeof(mn));
+        printf("%10llu  0x%03x  %04x  %-*s", (unsigned long long)rec.cycle, rec.pc, rec.op, rec.ndeltas ? 24 : 0, mn);
+        for (uint8_t d = 0; d < rec.ndeltas; ++d)
+        {
+            c8_trace_delta_name(&rec.deltas[d], name, sizeof(name));
+            printf(" %s=0x%02x", name, rec.deltas[d].val);
+        }
+        printf("\n");
+    }
+
+    c8_trace_reader_close(rd);
+    return 0;
+}
+
+/* V0-VF, I, SP, DT, ST -> trace delta kind, -1 if not a register */
+static int c8trace_parse_reg(const char* s)
+{
+    if (toupper((unsigned char)s[0]) == 'V' && isxdigit((unsigned char)s[1]) && !s[2])
+        return (int)strtol(s + 1, NULL, 16);
+
+    static const struct { const char* name; int kind; } regs[] = {
+        { "I", C8_TRACE_I }, { "SP", C8_TRACE_SP }, { "DT", C8_TRACE_DT }, { "ST", C8_TRACE_ST },
+    };
+    for (size_t r = 0; r < sizeof(regs) / sizeof(regs[0]); ++r)
+    {
+        if (!SDL_strcasecmp(s, regs[r].name))
+            return regs[r].kind;
+    }
+    return -1;
+}
+
+/* "DXYN" -> mask 0xf000 value 0xd000. any non hex digit is a wildcard */
+static bool c8trace_parse_pattern(const char* s, uint16_t* mask, uint16_t* value)
+{
+    if (strlen(s) != 4)
+        return false;
+    *mask = *value = 0;
+    for (int c = 0; c < 4; ++c)
+    {
+        *mask <<= 4;
+        *value <<= 4;
+        char ch = s[c];
+        if (isxdigit((unsigned char)ch))
+        {
+            *mask |= 0xf;
+            *value |= isdigit((unsigned char)ch) ? ch - '0' : toupper((unsigned char)ch) - 'A' + 10;
+        }
+    }
+    return true;
+}
+
+typedef struct
+{
+    uint16_t mask;
+    uint16_t value;
+    uint64_t shown;
+} c8trace_print_ctx;
+
+static bool c8trace_print_entry(const c8_ix_entry* e, void* ctx)
+{
+    c8trace_print_ctx* pc = ctx;
+    if ((e->op & pc->mask) != pc->value)
+        return true;
+
+    char mn[48];
+    c8_disasm_op(e->op, NULL, mn, sizeof(mn));
+    printf("%10llu  0x%03x  %04x  %-24s 0x%02x\n", (unsigned long long)e->cycle, e->pc, e->op, mn, e->val);
+    ++pc->shown;
+    return true;
+}
+
+typedef struct
+{
+    uint16_t value;
+    bool found;
+    c8_ix_entry last;
+} c8trace_last_ctx;
+
+static bool c8trace_track_last(const c8_ix_entry* e, void* ctx)
+{
+    c8trace_last_ctx* lc = ctx;
+    if (e->val == lc->value)
+    {
+        lc->last = *e;
+        lc->found = true;
+    }
+    return true;
+}
+
+static c8_ix* c8trace_open_index(const char* filename)
+{
+    c8_ix* ix = c8_ix_open(filename);
+    if (ix)
+        return ix;
+
+    fprintf(stderr, "building index for %s...\n", filename);
+    if (!c8_ix_build(filename))
+        return NULL;
+    return c8_ix_open(filename);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        c8trace_usage();
+        return 1;
+    }
+
+    if (argc == 2)
+        return c8trace_dump(argv[1]);
+
+    const char* cmd = argv[1];
+    const char* filename = argv[2];
+
+    if (!strcmp(cmd, "index"))
+        return c8_ix_build(filename) ? 0 : 1;
+
+    c8_ix* ix = c8trace_open_index(filename);
+    if (!ix)
+        return 1;
+
+    const uint64_t t0 = SDL_GetPerformanceCounter();
+    c8trace_print_ctx pctx = { 0, 0, 0 };
+    int rc = 0;
+
+    if (!strcmp(cmd, "writes") && argc >= 4)
+    {
+        uint16_t addr = (uint16_t)strtoul(argv[3], NULL, 0);
+        uint64_t lo = argc > 4 ? strtoull(argv[4], NULL, 0) : 0;
+        uint64_t hi = argc > 5 ? strtoull(argv[5], NULL, 0) : UINT64_MAX;
+        c8_ix_query(ix, C8_IX_KEY_MEM(addr), lo, hi, c8trace_print_entry, &pctx);
+    }
+    else if (!strcmp(cmd, "changes") && argc >= 4 && c8trace_parse_reg(argv[3]) >= 0)
+    {
+        uint64_t lo = argc > 4 ? strtoull(argv[4], NULL, 0) : 0;
+        uint64_t hi = argc > 5 ? strtoull(argv[5], NULL, 0) : UINT64_MAX;
+        c8_ix_query(ix, C8_IX_KEY_REG(c8trace_parse_reg(argv[3])), lo, hi, c8trace_print_entry, &pctx);
+    }
+    else if (!strcmp(cmd, "last") && argc >= 6 && c8trace_parse_reg(argv[3]) >= 0)
+    {
+        int reg = c8trace_parse_reg(argv[3]);
+        uint16_t value = (uint16_t)strtoul(argv[4], NULL, 0);
+        uint64_t before = strtoull(argv[5], NULL, 0);
+        c8trace_last_ctx lctx = { value, false, { 0 } };
+
+        if (reg <= C8_TRACE_VF)
+        {
+            lctx.found = c8_ix_last_before(ix, C8_IX_KEY_REGVAL(reg, value & 0xff), before, &lctx.last);
+        }
+        else
+        {
+            /* no per value keys for the 16 bit registers, walk the change list instead */
+            c8_ix_query(ix, C8_IX_KEY_REG(reg), 0, before, c8trace_track_last, &lctx);
+        }
+
+        if (lctx.found)
+            c8trace_print_entry(&lctx.last, &pctx);
+        else
+            printf("never\n");
+    }
+    else if (!strcmp(cmd, "pc") && argc >= 4)
+    {
+        uint16_t addr = (uint16_t)strtoul(argv[3], NULL, 0);
+        if (argc > 4 && !c8trace_parse_pattern(argv[4], &pctx.mask, &pctx.value))
+        {
+            fprintf(stderr, "bad op pattern '%s', want 4 chars like DXYN\n", argv[4]);
+            rc = 1;
+        }
+        else
+        {
+            c8_ix_query(ix, C8_IX_KEY_PC(addr), 0, UINT64_MAX, c8trace_print_entry, &pctx);
+        }
+    }
+    else
+    {
+        c8trace_usage();
+        rc = 1;
+    }
+
+    const double ms = (double)(SDL_GetPerformanceCounter() - t0) * 1000.0 / (double)SDL_GetPerformanceFrequency();
+    if (!rc)
+        fprintf(stderr, "%llu results in %.2f ms\n", (unsigned long long)pctx.shown, ms);
+
+    c8_ix_close(ix);
+    return rc;
+}
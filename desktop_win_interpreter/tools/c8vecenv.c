@@ -0,0 +1,158 @@
+/* c8vecenv - step lots of copies of a rom with random keys, as training would
+
+    c8vecenv rom.ch8 [--envs N] [--threads N] [--steps N] [--frames N] [--hires]
+                     [--bytes] [--reward ADDR[:BYTES][:bcd]] [--lives ADDR]
+                     [--done ADDR:VALUE]
+
+runs --steps (default 10000) steps of --envs (default 64) envs, each holding a
+random key, or none, for a few frames at a time. prints frames a second over all of
+them and how the episodes went. --reward is where the rom keeps its score, --lives
+a byte that counts down and costs a point each time it does. --frames cuts episodes
+off after that many steps.
+*/
+
+/* plain console main, no SDL2main */
+#define SDL_MAIN_HANDLED
+#include "../c8_vecenv.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* steps a random key is held for */
+#define VECENV_HOLD             (8)
+
+static bool vecenv_parse_reward(const char* arg, c8_reward_src* r)
+{
+    char* end;
+    r->addr = (uint16_t)strtoul(arg, &end, 0);
+    r->bytes = 1;
+    r->bcd = false;
+    r->scale = 1.0f;
+    if (*end == ':')
+        r->bytes = (uint8_t)strtoul(end + 1, &end, 0);
+    if (!strcmp(end, ":bcd"))
+    {
+        r->bcd = true;
+        end += 4;
+    }
+    return *end == '\0' && end != arg && r->bytes >= 1 && r->bytes <= 4;
+}
+
+int main(int argc, char** argv)
+{
+    const char* rom_file = NULL;
+    uint32_t nsteps = 10000;
+    c8_vecenv_opts o;
+    c8_vecenv_defaults(&o);
+
+    for (int a = 1; a < argc; ++a)
+    {
+        if (!strcmp(argv[a], "--envs") && a + 1 < argc)
+            o.nenvs = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--threads") && a + 1 < argc)
+            o.threads = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--steps") && a + 1 < argc)
+            nsteps = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--frames") && a + 1 < argc)
+            o.max_frames = (uint32_t)strtoul(argv[++a], NULL, 0);
+        else if (!strcmp(argv[a], "--hires"))
+            o.obs_hires = true;
+        else if (!strcmp(argv[a], "--bytes"))
+            o.obs_format = C8_OBS_BYTES;
+        else if ((!strcmp(argv[a], "--reward") || !strcmp(argv[a], "--lives")) && a + 1 < argc &&
+            o.nrewards < C8_VECENV_MAX_REWARDS)
+        {
+            const bool lives = !strcmp(argv[a], "--lives");
+            c8_reward_src* r = &o.rewards[o.nrewards++];
+            if (!vecenv_parse_reward(argv[++a], r))
+            {
+                fprintf(stderr, "c8vecenv: bad %s '%s'\n", lives ? "--lives" : "--reward", argv[a]);
+                return 1;
+            }
+            if (lives)
+                r->scale = -1.0f;
+        }
+        else if (!strcmp(argv[a], "--done") && a + 1 < argc)
+        {
+            char* end;
+            o.done_on_mem = true;
+            o.done_addr = (uint16_t)strtoul(argv[++a], &end, 0);
+            o.done_value = *end == ':' ? (uint8_t)strtoul(end + 1, NULL, 0) : 0;
+        }
+        else
+            rom_file = argv[a];
+    }
+
+    if (!rom_file || !o.nenvs)
+    {
+        fprintf(stderr, "usage: c8vecenv rom.ch8 [--envs N] [--threads N] [--steps N] [--frames N] [--hires] "
+            "[--bytes] [--reward ADDR[:BYTES][:bcd]] [--lives ADDR] [--done ADDR:VALUE]\n");
+        return 1;
+    }
+
+    static c8_machine base;
+    if (!c8_load_rom(&base, rom_file))
+        return 1;
+    c8_init(&base);
+
+    c8_vecenv* v = c8_vecenv_create(&o, &base);
+    uint16_t* keys = calloc(o.nenvs, sizeof(uint16_t));
+    double* returns = calloc(o.nenvs, sizeof(double));
+    if (!v || !keys || !returns)
+    {
+        fprintf(stderr, "c8vecenv: couldnt make %u envs\n", o.nenvs);
+        return 1;
+    }
+
+    uint32_t rng = 0x2545f491;
+    uint64_t episodes = 0, cut = 0, lit = 0;
+    double total_return = 0.0;
+    const float* rewards = c8_vecenv_rewards(v);
+    const uint8_t* dones = c8_vecenv_dones(v);
+    const uint64_t t0 = SDL_GetPerformanceCounter();
+    for (uint32_t step = 0; step < nsteps; ++step)
+    {
+        if (step % VECENV_HOLD == 0)
+        {
+            for (uint32_t n = 0; n < o.nenvs; ++n)
+            {
+                rng ^= rng << 13;
+                rng ^= rng >> 17;
+                rng ^= rng << 5;
+                /* one in 17 lets go of everything */
+                const uint32_t k = (rng >> 8) % 17;
+                keys[n] = k < 16 ? (uint16_t)(1 << k) : 0;
+            }
+        }
+        c8_vecenv_step(v, keys);
+        for (uint32_t n = 0; n < o.nenvs; ++n)
+        {
+            returns[n] += rewards[n];
+            if (dones[n])
+            {
+                ++episodes;
+                cut += (dones[n] & C8_VECENV_CUT) != 0;
+                total_return += returns[n];
+                returns[n] = 0.0;
+            }
+        }
+    }
+    const double secs = (double)(SDL_GetPerformanceCounter() - t0) / (double)SDL_GetPerformanceFrequency();
+
+    /* something to show the observations are there */
+    const uint8_t* obs = c8_vecenv_obs(v);
+    for (size_t b = 0; b < c8_vecenv_obs_size(v) * o.nenvs; ++b)
+        lit += obs[b] != 0;
+
+    const double frames = (double)nsteps * o.nenvs;
+    printf("%u envs x %u steps in %.2f s: %.0f frames/s, %.1f M ops/s\n", o.nenvs, nsteps, secs,
+        secs > 0 ? frames / secs : 0.0, secs > 0 ? frames * o.frame_cycles / secs / 1e6 : 0.0);
+    printf("  %llu episodes ended (%llu cut short), mean return %.2f\n", (unsigned long long)episodes,
+        (unsigned long long)cut, episodes ? total_return / (double)episodes : 0.0);
+    printf("  %zu byte observations, %llu nonzero bytes in the last ones\n", c8_vecenv_obs_size(v),
+        (unsigned long long)lit);
+
+    free(returns);
+    free(keys);
+    c8_vecenv_destroy(v);
+    return 0;
+}